@@ -10,6 +10,8 @@ using namespace eokas;
 
 static void eokas_main(coder_t& coder, const String& fileName, const String& cmd);
 
+static omis_fp_model_t fp_model(const String& name);
+
 static void about(void);
 
 static void help(void);
@@ -32,10 +34,14 @@ int main(int argc, char** argv) {
 
     program.subCommand("compile", "")
         .option("--file,-f", "", "")
+        .option("--gc", "", StringValue::falseValue)
+        .option("--fp-model", "", "strict")
         .action([&](const cli::Command& cmd) -> void {
             auto file = cmd.fetchValue("--file").string();
             if (file.isEmpty())
                 throw std::invalid_argument("The argument 'file' is empty.");
+            coder.get_options().gc = cmd.fetchValue("--gc").value<bool>();
+            coder.get_options().fp_model = fp_model(cmd.fetchValue("--fp-model").string());
 
             printf("=> Source file: %s\n", file.cstr());
 
@@ -44,10 +50,14 @@ int main(int argc, char** argv) {
 
     program.subCommand("run", "")
         .option("--file,-f", "", "")
+        .option("--gc", "", StringValue::falseValue)
+        .option("--fp-model", "", "strict")
         .action([&](const cli::Command& cmd) -> void {
             auto file = cmd.fetchValue("--file").string();
             if (file.isEmpty())
                 throw std::invalid_argument("The argument 'file' is empty.");
+            coder.get_options().gc = cmd.fetchValue("--gc").value<bool>();
+            coder.get_options().fp_model = fp_model(cmd.fetchValue("--fp-model").string());
             if (!File::exists(file))
                 throw std::invalid_argument(
                         String::format("The source file '%s' is not found.", file.cstr()).cstr());
@@ -111,6 +121,16 @@ static void eokas_main(coder_t& coder, const String& fileName, const String& cmd
     out.close();
 }
 
+static omis_fp_model_t fp_model(const String& name) {
+    if (name == "strict")
+        return omis_fp_model_t::STRICT;
+    if (name == "contract")
+        return omis_fp_model_t::CONTRACT;
+    if (name == "fast")
+        return omis_fp_model_t::FAST;
+    throw std::invalid_argument(String::format("The float model '%s' is undefined.", name.cstr()).cstr());
+}
+
 static void about(void) {
     printf("eokas %s\n", _EOKAS_VERSION);
 }
@@ -122,6 +142,14 @@ static void help(void) {
 
         "\nfileName [-c] [-e] [-t]\n"
         "\tComple or Execute a file, show exec-time.\n"
+
+        "\n--gc\n"
+        "\tCollect the objects made by the program with the runtime GC.\n"
+
+        "\n--fp-model=strict|contract|fast\n"
+        "\tHow float math may be rewritten: 'contract' fuses a * b + c into FMAs,\n"
+        "\t'fast' also reorders it, so float reductions can be vectorized.\n"
+        "\tA function marked '#fastmath' is always 'fast'.\n"
    );
 }
 
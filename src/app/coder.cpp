@@ -12,9 +12,14 @@ namespace eokas {
         _DeletePointer(engine);
     }
 
+    omis_options_t& coder_t::get_options() {
+        return engine->get_options();
+    }
+
     omis_module_t* coder_t::encode(ast_node_module_t* node) {
         return engine->load_module(node->name, [&]() -> omis_module_t* {
             omis_module_coder_t* mod = new omis_module_coder_t(engine->get_bridge(), node->name);
+            mod->set_options(engine->get_options());
             if(!mod->encode_module(node)) {
                 _DeletePointer(mod);
                 return nullptr;
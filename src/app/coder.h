@@ -11,6 +11,7 @@ namespace eokas {
         coder_t();
         ~coder_t();
 
+        omis_options_t& get_options();
         omis_module_t* encode(ast_node_module_t* node);
         String dump(omis_module_t* mod);
         void jit(omis_module_t* mod);
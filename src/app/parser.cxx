@@ -128,10 +128,79 @@ namespace eokas
 	}
 	
 	/**
-	 * type := ID '<' type '>'
+	 * type := ['#soa'] type_item {'[' [int] ']'}
+	 * type_item := ID '<' type '>' | func_type
 	*/
 	ast_node_type_t* parser_t::parse_type(ast_node_t* p)
 	{
+		bool soa = false;
+		if(this->check_token(token_t::POUND, false))
+		{
+			if(!this->check_token(token_t::ID, true, false))
+				return nullptr;
+			if(this->token().value != "soa")
+			{
+				this->error("The type attribute '%s' is undefined", this->token().value.cstr());
+				return nullptr;
+			}
+			this->next_token();
+			soa = true;
+		}
+		
+		ast_node_type_t* node = this->parse_type_item(p);
+		if(node == nullptr)
+			return nullptr;
+		
+		while(this->check_token(token_t::LSB, false))
+		{
+			// T[], a slice.
+			if(this->check_token(token_t::RSB, false))
+			{
+				auto* slice = factory->create<ast_node_type_t>(p);
+				slice->name = "[]";
+				slice->args.push_back(node);
+				node->parent = slice;
+				node = slice;
+				continue;
+			}
+			
+			auto* length = dynamic_cast<ast_node_literal_int_t*>(this->parse_literal_int(nullptr));
+			if(length == nullptr)
+				return nullptr;
+			if(length->value <= 0)
+			{
+				this->error("The length of an array must be greater than 0");
+				return nullptr;
+			}
+			if(!this->check_token(token_t::RSB))
+				return nullptr;
+			
+			auto* array = factory->create<ast_node_type_t>(p);
+			array->name = "[]";
+			array->length = static_cast<u64_t>(length->value);
+			array->args.push_back(node);
+			node->parent = array;
+			node = array;
+		}
+		
+		if(soa)
+		{
+			if(node->name != "[]" || node->length == 0)
+			{
+				this->error("Only arrays can be stored as '#soa'");
+				return nullptr;
+			}
+			node->soa = true;
+		}
+		
+		return node;
+	}
+	
+	ast_node_type_t* parser_t::parse_type_item(ast_node_t* p)
+	{
+		if(this->token().type == token_t::FUNC)
+			return this->parse_type_func(p);
+		
 		if(!this->check_token(token_t::ID, true, false))
 			return nullptr;
 		
@@ -167,6 +236,56 @@ namespace eokas
 		return node;
 	}
 	
+	/**
+	 * func_type := 'func' '(' [['var' | 'val'] ID ':' type {',' ...}] ')' ':' type
+	 * The node is named 'func', its args are the param types followed by the return type.
+	*/
+	ast_node_type_t* parser_t::parse_type_func(ast_node_t* p)
+	{
+		if(!this->check_token(token_t::FUNC))
+			return nullptr;
+		
+		auto* node = factory->create<ast_node_type_t>(p);
+		node->name = "func";
+		
+		if(!this->check_token(token_t::LRB))
+			return nullptr;
+		
+		do
+		{
+			if(this->token().type == token_t::RRB)
+				break;
+			
+			// ['var' | 'val'] ID ':'
+			if(!this->check_token(token_t::VAR, false))
+				this->check_token(token_t::VAL, false);
+			if(!this->check_token(token_t::ID, true, false))
+				return nullptr;
+			this->next_token();
+			if(!this->check_token(token_t::COLON))
+				return nullptr;
+			
+			auto* arg = this->parse_type(node);
+			if(arg == nullptr)
+				return nullptr;
+			node->args.push_back(arg);
+		}
+		while (this->check_token(token_t::COMMA, false));
+		
+		if(!this->check_token(token_t::RRB))
+			return nullptr;
+		
+		// : ret-type
+		if(!this->check_token(token_t::COLON))
+			return nullptr;
+		auto* ret = this->parse_type(node);
+		if(ret == nullptr)
+			return nullptr;
+		node->args.push_back(ret);
+		
+		return node;
+	}
+	
 	ast_node_expr_t* parser_t::parse_expr(ast_node_t* p)
 	{
 		return this->parse_expr_trinary(p);
@@ -257,6 +376,10 @@ namespace eokas
 	*/
 	ast_node_expr_t* parser_t::parse_expr_unary(ast_node_t* p)
 	{
+		// '#fastmath func...', the '#' of a function attribute is not 'size of'.
+		if(this->token().type == token_t::POUND && this->is_func_attr(this->look_ahead_token().value))
+			return this->parse_func_def(p);
+		
 		ast_unary_oper_t oper = this->check_unary_oper(false, true);
 		
 		ast_node_expr_t* right = nullptr;
@@ -467,14 +590,21 @@ namespace eokas
 	}
 	
 	/*
-	func_def => 'func' func_params func_body
+	func_def => {func_attr} 'func' func_params func_body
 	*/
 	ast_node_expr_t* parser_t::parse_func_def(ast_node_t* p)
 	{
+		auto* node = factory->create<ast_node_func_def_t>(p);
+		
+		while(this->token().type == token_t::POUND)
+		{
+			if(!this->parse_func_attr(node))
+				return nullptr;
+		}
+		
 		if(!this->check_token(token_t::FUNC))
 			return nullptr;
 		
-		auto* node = factory->create<ast_node_func_def_t>(p);
 		if(!this->parse_func_params(node))
 			return nullptr;
 		
@@ -492,8 +622,67 @@ namespace eokas
 		return node;
 	}
 	
+	bool parser_t::is_func_attr(const String& name)
+	{
+		return name == "fastmath" || name == "memo";
+	}
+	
+	/**
+	 * func_attr := '#fastmath' | '#memo' ['(' int [',' 'lru'] ')'];
+	 * '#memo' alone caches 1024 results.
+	 * */
+	bool parser_t::parse_func_attr(ast_node_func_def_t* node)
+	{
+		if(!this->check_token(token_t::POUND))
+			return false;
+		
+		if(!this->check_token(token_t::ID, true, false))
+			return false;
+		String name = this->token().value;
+		this->next_token();
+		
+		if(!this->is_func_attr(name))
+		{
+			this->error("The function attribute '%s' is undefined", name.cstr());
+			return false;
+		}
+		if(name == "fastmath")
+		{
+			node->fastmath = true;
+			return true;
+		}
+		
+		node->memo = 1024;
+		if(!this->check_token(token_t::LRB, false))
+			return true;
+		auto* expr = dynamic_cast<ast_node_literal_int_t*>(this->parse_literal_int(nullptr));
+		if(expr == nullptr)
+			return false;
+		if(expr->value <= 0 || expr->value > 0x1000000)
+		{
+			this->error("The memo capacity %d is out of range", (int)expr->value);
+			return false;
+		}
+		node->memo = static_cast<u32_t>(expr->value);
+		if(this->check_token(token_t::COMMA, false))
+		{
+			if(!this->check_token(token_t::ID, true, false))
+				return false;
+			if(this->token().value != "lru")
+			{
+				this->error("The memo policy '%s' is undefined", this->token().value.cstr());
+				return false;
+			}
+			this->next_token();
+			node->memo_lru = true;
+		}
+		if(!this->check_token(token_t::RRB))
+			return false;
+		return true;
+	}
+	
 	/*
-	func_params => '(' [ID] ')'
+	func_params => '(' [['var' | 'val'] ID ':' type {',' ...}] ')'
 	*/
 	bool parser_t::parse_func_params(ast_node_func_def_t* node)
 	{
@@ -505,6 +694,13 @@ namespace eokas
 			if(this->token().type == token_t::RRB)
 				break;
 			
+			// Params are immutable unless declared with 'var'.
+			bool variable = false;
+			if(this->check_token(token_t::VAR, false))
+				variable = true;
+			else
+				this->check_token(token_t::VAL, false);
+			
 			if(!this->check_token(token_t::ID, true, false))
 				return false;
 			const String name = this->token().value;
@@ -531,6 +727,7 @@ namespace eokas
 			
 			arg->name = name;
 			arg->type = type;
+			arg->variable = variable;
 		}
 		while (this->check_token(token_t::COMMA, false));
 		
@@ -590,7 +787,7 @@ namespace eokas
 	}
 	
 	/*
-	object_def => 'make' type_ref '{' [object_field {sep object_field} [sep]] '}'
+	object_def => 'make' type_ref '{' [object_field {sep object_field} [sep]] '}' | 'make' array_type
 	sep => ',' | ';'
 	*/
 	ast_node_expr_t* parser_t::parse_object_def(ast_node_t* p)
@@ -603,6 +800,10 @@ namespace eokas
 		if(node->type == nullptr)
 			return nullptr;
 		
+		// Arrays are made with all elements zeroed.
+		if(node->type->name == "[]")
+			return node;
+		
 		if(!this->check_token(token_t::LCB))
 			return nullptr;
 		
@@ -675,7 +876,7 @@ namespace eokas
 	}
 	
 	/*
-	index_ref => '[' expr ']'
+	index_ref => '[' expr ']' | '[' [expr] '..' [expr] ']'
 	*/
 	ast_node_expr_t* parser_t::parse_index_ref(ast_node_t* p, ast_node_expr_t* primary)
 	{
@@ -684,9 +885,28 @@ namespace eokas
 		if(!this->check_token(token_t::LSB))
 			return nullptr;
 		
-		node->key = this->parse_expr(node);
-		if(node->key == nullptr)
+		if(this->token().type != token_t::DOT2)
+		{
+			node->key = this->parse_expr(node);
+			if(node->key == nullptr)
+				return nullptr;
+		}
+		
+		if(this->check_token(token_t::DOT2, false))
+		{
+			node->slice = true;
+			if(this->token().type != token_t::RSB)
+			{
+				node->end = this->parse_expr(node);
+				if(node->end == nullptr)
+					return nullptr;
+			}
+		}
+		else if(node->key == nullptr)
+		{
+			this->error_token_unexpected();
 			return nullptr;
+		}
 		
 		if(!this->check_token(token_t::RSB))
 			return nullptr;
@@ -727,8 +947,18 @@ namespace eokas
 		
 		switch (this->token().type)
 		{
+			case token_t::POUND:
+				if(this->is_loop_attr(this->look_ahead_token().value))
+				{
+					stmt = this->parse_stmt_loop(p);
+					break;
+				}
+				stmt = this->parse_stmt_struct_def(p);
+				semicolon = true;
+				break;
 			case token_t::STRUCT:
 				stmt = this->parse_stmt_struct_def(p);
+				semicolon = true;
 				break;
 			case token_t::ENUM:
 				stmt = this->parse_stmt_enum_def(p);
@@ -757,6 +987,16 @@ namespace eokas
 			case token_t::IF:
 				stmt = this->parse_stmt_if(p);
 				break;
+			case token_t::MATCH:
+				stmt = this->parse_stmt_match(p);
+				break;
+			case token_t::TRY:
+				stmt = this->parse_stmt_try(p);
+				break;
+			case token_t::THROW:
+				stmt = this->parse_stmt_throw(p);
+				semicolon = true;
+				break;
 			case token_t::LOOP:
 				stmt = this->parse_stmt_loop(p);
 				break;
@@ -775,15 +1015,35 @@ namespace eokas
 	}
 	
 	/**
-	 * struct_def := 'struct' ID '{' struct_member '};';
+	 * struct_def := {layout_attr} 'struct' ID [':' type] '{' struct_member '};';
+	 * layout_attr := '#packed' | '#reorder' | '#cacheline' | '#align' '(' int ')';
 	*/
 	ast_node_struct_def_t* parser_t::parse_stmt_struct_def(ast_node_t* p)
 	{
+		auto* node = factory->create<ast_node_struct_def_t>(p);
+		
+		while(this->token().type == token_t::POUND)
+		{
+			String attr;
+			u32_t arg = 0;
+			if(!this->parse_layout_attr(attr, arg))
+				return nullptr;
+			if(attr == "packed")
+				node->packed = true;
+			else if(attr == "reorder")
+				node->reorder = true;
+			else if(attr == "align" || attr == "cacheline")
+				node->align = arg;
+			else
+			{
+				this->error("The struct attribute '%s' is undefined", attr.cstr());
+				return nullptr;
+			}
+		}
+		
 		if(!this->check_token(token_t::STRUCT))
 			return nullptr;
 		
-		auto* node = factory->create<ast_node_struct_def_t>(p);
-		
 		// ID
 		if(!this->check_token(token_t::ID, true, false))
 			return nullptr;
@@ -791,6 +1051,14 @@ namespace eokas
 		node->name = this->token().value;
 		this->next_token();
 		
+		// [: base]
+		if(this->check_token(token_t::COLON, false))
+		{
+			node->base = this->parse_type(node);
+			if(node->base == nullptr)
+				return nullptr;
+		}
+		
 		// {
 		if(!this->check_token(token_t::LCB))
 			return nullptr;
@@ -813,16 +1081,29 @@ namespace eokas
 	}
 	
 	/**
-	 * struct_member := ('var' | 'val') ID : type [ '=' expr ] ;
+	 * struct_member := {'#align' '(' int ')' | '#cacheline'} ('var' | 'val') ID : type [ '=' expr ] ;
 	*/
 	bool parser_t::parse_stmt_struct_member(ast_node_struct_def_t* p)
 	{
+		u32_t align = 0;
+		while(this->token().type == token_t::POUND)
+		{
+			String attr;
+			if(!this->parse_layout_attr(attr, align))
+				return false;
+			if(attr != "align" && attr != "cacheline")
+			{
+				this->error("The member attribute '%s' is undefined", attr.cstr());
+				return false;
+			}
+		}
+		
 		// (val | var)
 		bool isConst = false;
 		switch (this->token().type)
 		{
-			case token_t::VAL: isConst = true;
-			case token_t::VAR: isConst = false;
+			case token_t::VAL: isConst = true; break;
+			case token_t::VAR: isConst = false; break;
 			default:
 				return false;
 		}
@@ -839,6 +1120,8 @@ namespace eokas
 			this->error_token_unexpected();
 			return false;
 		}
+		node->isConst = isConst;
+		node->align = align;
 		this->next_token();
 		
 		// : type
@@ -859,6 +1142,45 @@ namespace eokas
 		return true;
 	}
 	
+	/**
+	 * layout_attr := '#' ID ['(' int ')'];
+	 * '#cacheline' is a shorthand of '#align(64)'.
+	 * */
+	bool parser_t::parse_layout_attr(String& name, u32_t& arg)
+	{
+		if(!this->check_token(token_t::POUND))
+			return false;
+		
+		if(!this->check_token(token_t::ID, true, false))
+			return false;
+		name = this->token().value;
+		this->next_token();
+		
+		if(name == "cacheline")
+		{
+			arg = 64;
+			return true;
+		}
+		if(name != "align")
+			return true;
+		
+		if(!this->check_token(token_t::LRB))
+			return false;
+		auto* expr = dynamic_cast<ast_node_literal_int_t*>(this->parse_literal_int(nullptr));
+		if(expr == nullptr)
+			return false;
+		arg = static_cast<u32_t>(expr->value);
+		if(arg == 0 || (arg & (arg - 1)) != 0)
+		{
+			this->error("The alignment %d is not a power of 2", (int)arg);
+			return false;
+		}
+		if(!this->check_token(token_t::RRB))
+			return false;
+		
+		return true;
+	}
+	
 	/**
 	 * enum_def := 'enum' ID '{' [enum_member] '}' ';';
 	 * enum_member := ID ['=' expr_int] ',';
@@ -1063,6 +1385,73 @@ namespace eokas
 		return node;
 	}
 	
+	/**
+	 * try := 'try' stmt catch {catch}
+	 * catch := 'catch' '(' ID ':' type ')' stmt
+	 * */
+	ast_node_try_t* parser_t::parse_stmt_try(ast_node_t* p)
+	{
+		if(!this->check_token(token_t::TRY))
+			return nullptr;
+		
+		auto* node = factory->create<ast_node_try_t>(p);
+		
+		node->body = this->parse_stmt(node);
+		if(node->body == nullptr)
+			return nullptr;
+		
+		if(!this->check_token(token_t::CATCH, true, false))
+			return nullptr;
+		
+		while(this->check_token(token_t::CATCH, false))
+		{
+			ast_node_try_t::catch_t tryCatch;
+			
+			if(!this->check_token(token_t::LRB))
+				return nullptr;
+			
+			if(!this->check_token(token_t::ID, true, false))
+				return nullptr;
+			tryCatch.name = this->token().value;
+			this->next_token();
+			
+			if(!this->check_token(token_t::COLON))
+				return nullptr;
+			
+			tryCatch.type = this->parse_type(node);
+			if(tryCatch.type == nullptr)
+				return nullptr;
+			
+			if(!this->check_token(token_t::RRB))
+				return nullptr;
+			
+			tryCatch.body = this->parse_stmt(node);
+			if(tryCatch.body == nullptr)
+				return nullptr;
+			
+			node->catches.push_back(tryCatch);
+		}
+		
+		return node;
+	}
+	
+	/**
+	 * throw := 'throw' expr
+	 * */
+	ast_node_throw_t* parser_t::parse_stmt_throw(ast_node_t* p)
+	{
+		if(!this->check_token(token_t::THROW))
+			return nullptr;
+		
+		auto* node = factory->create<ast_node_throw_t>(p);
+		
+		node->value = this->parse_expr(node);
+		if(node->value == nullptr)
+			return nullptr;
+		
+		return node;
+	}
+	
 	ast_node_if_t* parser_t::parse_stmt_if(ast_node_t* p)
 	{
 		if(!this->check_token(token_t::IF))
@@ -1094,16 +1483,92 @@ namespace eokas
 		return node;
 	}
 	
-	ast_node_loop_t* parser_t::parse_stmt_loop(ast_node_t* p)
+	/**
+	 * match := 'match' '(' expr ')' '{' {match_case} ['else' ':' stmt] '}'
+	 * match_case := expr {',' expr} ':' stmt
+	 * */
+	ast_node_match_t* parser_t::parse_stmt_match(ast_node_t* p)
 	{
-		if(!this->check_token(token_t::LOOP))
+		if(!this->check_token(token_t::MATCH))
 			return nullptr;
 		
+		auto* node = factory->create<ast_node_match_t>(p);
+		
+		if(!this->check_token(token_t::LRB))
+			return nullptr;
+		
+		node->value = this->parse_expr(node);
+		if(node->value == nullptr)
+			return nullptr;
+		
+		if(!this->check_token(token_t::RRB))
+			return nullptr;
+		
+		if(!this->check_token(token_t::LCB))
+			return nullptr;
+		
+		while(!this->check_token(token_t::RCB, false))
+		{
+			if(node->other != nullptr)
+			{
+				this->error("The 'else' case must be the last one of 'match'");
+				return nullptr;
+			}
+			
+			if(this->check_token(token_t::ELSE, false))
+			{
+				if(!this->check_token(token_t::COLON))
+					return nullptr;
+				node->other = this->parse_stmt(node);
+				if(node->other == nullptr)
+					return nullptr;
+				continue;
+			}
+			
+			ast_node_match_t::case_t matchCase;
+			do
+			{
+				auto* value = this->parse_expr(node);
+				if(value == nullptr)
+					return nullptr;
+				matchCase.values.push_back(value);
+			} while (this->check_token(token_t::COMMA, false));
+			
+			if(!this->check_token(token_t::COLON))
+				return nullptr;
+			
+			matchCase.body = this->parse_stmt(node);
+			if(matchCase.body == nullptr)
+				return nullptr;
+			node->cases.push_back(matchCase);
+		}
+		
+		return node;
+	}
+	
+	/**
+	 * loop := {loop_attr} 'loop' '(' (loop_range | loop_init loop_cond loop_step) ')' stmt
+	 * */
+	ast_node_loop_t* parser_t::parse_stmt_loop(ast_node_t* p)
+	{
 		auto* node = factory->create<ast_node_loop_t>(p);
 		
+		while(this->token().type == token_t::POUND)
+		{
+			if(!this->parse_loop_attr(node))
+				return nullptr;
+		}
+		
+		if(!this->check_token(token_t::LOOP))
+			return nullptr;
+		
+
 		if(!this->check_token(token_t::LRB))
 			return nullptr;
 		
+		if(this->token().type == token_t::ID && this->look_ahead_token().type == token_t::ID && this->look_ahead_token().value == "in")
+			return this->parse_stmt_loop_range(node);
+		
 		node->init = this->parse_stmt_loop_init(node);
 		if(node->init == nullptr)
 			return nullptr;
@@ -1126,6 +1591,109 @@ namespace eokas
 		return node;
 	}
 	
+	bool parser_t::is_loop_attr(const String& name)
+	{
+		return name == "unroll" || name == "vectorize" || name == "interleave" || name == "no_alias";
+	}
+	
+	/**
+	 * loop_attr := '#unroll' ['(' int ')'] | '#vectorize' ['(' int ')'] | '#interleave' '(' int ')' | '#no_alias';
+	 * '#unroll' unrolls the loop fully, '#unroll(1)' and '#vectorize(1)' keep the optimizer from doing it.
+	 * */
+	bool parser_t::parse_loop_attr(ast_node_loop_t* node)
+	{
+		if(!this->check_token(token_t::POUND))
+			return false;
+		
+		if(!this->check_token(token_t::ID, true, false))
+			return false;
+		String name = this->token().value;
+		this->next_token();
+		
+		if(!this->is_loop_attr(name))
+		{
+			this->error("The loop attribute '%s' is undefined", name.cstr());
+			return false;
+		}
+		if(name == "no_alias")
+		{
+			node->no_alias = true;
+			return true;
+		}
+		
+		u32_t arg = 0;
+		if(this->check_token(token_t::LRB, name == "interleave"))
+		{
+			auto* expr = dynamic_cast<ast_node_literal_int_t*>(this->parse_literal_int(nullptr));
+			if(expr == nullptr)
+				return false;
+			if(expr->value <= 0)
+			{
+				this->error("The argument of '#%s' must be greater than 0", name.cstr());
+				return false;
+			}
+			arg = static_cast<u32_t>(expr->value);
+			if(!this->check_token(token_t::RRB))
+				return false;
+		}
+		else if(name == "interleave")
+		{
+			return false;
+		}
+		
+		if(name == "unroll")
+		{
+			node->unroll = arg;
+			node->unroll_full = arg == 0;
+		}
+		else if(name == "vectorize")
+		{
+			node->vectorize = arg;
+			node->vectorize_enable = arg != 1;
+		}
+		else
+		{
+			node->interleave = arg;
+		}
+		return true;
+	}
+	
+	/**
+	 * loop_range := ID 'in' expr ('..' | '...') expr ')' stmt
+	 * */
+	ast_node_loop_t* parser_t::parse_stmt_loop_range(ast_node_loop_t* node)
+	{
+		node->counter = this->token().value;
+		this->next_token(); // ID
+		this->next_token(); // in
+		
+		node->begin = this->parse_expr(node);
+		if(node->begin == nullptr)
+			return nullptr;
+		
+		if(this->check_token(token_t::DOT3, false))
+		{
+			node->inclusive = true;
+		}
+		else if(!this->check_token(token_t::DOT2))
+		{
+			return nullptr;
+		}
+		
+		node->end = this->parse_expr(node);
+		if(node->end == nullptr)
+			return nullptr;
+		
+		if(!this->check_token(token_t::RRB))
+			return nullptr;
+		
+		node->body = this->parse_stmt(node);
+		if(node->body == nullptr)
+			return nullptr;
+		
+		return node;
+	}
+	
 	ast_node_stmt_t* parser_t::parse_stmt_loop_init(ast_node_t* p)
 	{
 		auto* stmt = this->parse_stmt_symbol_def(p);
@@ -23,6 +23,8 @@ namespace eokas
 		ast_node_export_t* parse_export(ast_node_t* p);
 		
 		ast_node_type_t* parse_type(ast_node_t* p);
+		ast_node_type_t* parse_type_item(ast_node_t* p);
+		ast_node_type_t* parse_type_func(ast_node_t* p);
 		
 		ast_node_expr_t* parse_expr(ast_node_t* p);
 		ast_node_expr_t* parse_expr_trinary(ast_node_t* p);
@@ -37,6 +39,8 @@ namespace eokas
 		ast_node_expr_t* parse_func_def(ast_node_t* p);
 		bool parse_func_params(ast_node_func_def_t* node);
 		bool parse_func_body(ast_node_func_def_t* node);
+		bool is_func_attr(const String& name);
+		bool parse_func_attr(ast_node_func_def_t* node);
 		ast_node_expr_t* parse_object_def(ast_node_t* p);
 		ast_node_expr_t* parse_func_call(ast_node_t* p, ast_node_expr_t* primary);
 		ast_node_expr_t* parse_array_def(ast_node_t* p);
@@ -47,14 +51,21 @@ namespace eokas
 		ast_node_stmt_t* parse_stmt(ast_node_t* p);
 		ast_node_struct_def_t* parse_stmt_struct_def(ast_node_t* p);
 		bool parse_stmt_struct_member(ast_node_struct_def_t* node);
+		bool parse_layout_attr(String& name, u32_t& arg);
 		ast_node_enum_def_t* parse_stmt_enum_def(ast_node_t* p);
 		ast_node_proc_def_t* parse_stmt_proc_def(ast_node_t* p);
 		ast_node_symbol_def_t* parse_stmt_symbol_def(ast_node_t* p);
 		ast_node_continue_t* parse_stmt_continue(ast_node_t* p);
 		ast_node_break_t* parse_stmt_break(ast_node_t* p);
 		ast_node_return_t* parse_stmt_return(ast_node_t* p);
+		ast_node_try_t* parse_stmt_try(ast_node_t* p);
+		ast_node_throw_t* parse_stmt_throw(ast_node_t* p);
 		ast_node_if_t* parse_stmt_if(ast_node_t* p);
+		ast_node_match_t* parse_stmt_match(ast_node_t* p);
 		ast_node_loop_t* parse_stmt_loop(ast_node_t* p);
+		ast_node_loop_t* parse_stmt_loop_range(ast_node_loop_t* node);
+		bool is_loop_attr(const String& name);
+		bool parse_loop_attr(ast_node_loop_t* node);
 		ast_node_stmt_t* parse_stmt_loop_init(ast_node_t* p);
 		ast_node_expr_t* parse_stmt_loop_cond(ast_node_t* p);
 		ast_node_stmt_t* parse_stmt_loop_step(ast_node_t* p);
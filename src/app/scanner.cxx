@@ -337,7 +337,8 @@ _BeginNamespace(eokas)
 			}
 			m_token.type = token_t::INT_D;
 			
-			if(m_current == '.')
+			// '1..2' is a range, not the float '1.'.
+			if(m_current == '.' && *m_position != '.')
 			{
 				this->save_and_read_char();
 				while (_ascil_is_number(m_current))
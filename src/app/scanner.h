@@ -20,7 +20,7 @@ _BeginNamespace(eokas)
 			VAR, VAL, MAKE,
             MODULE, IMPORT, EXPORT, PUBLIC, PRIVATE,
             FUNC, PROC, STRUCT, ENUM,
-			IF, ELSE, LOOP,  BREAK, CONTINUE, RETURN, TRUE, FALSE,
+			IF, ELSE, MATCH, LOOP,  BREAK, CONTINUE, RETURN, TRY, CATCH, THROW, TRUE, FALSE,
 			COMMA, SEMICOLON, COLON, QUESTION, AT, POUND, DOLLAR,
 			ADD, SUB, MUL, DIV, MOD, XOR, FLIP,
 			LRB, RRB, LSB, RSB, LCB, RCB,
@@ -36,7 +36,7 @@ _BeginNamespace(eokas)
 			"var", "val", "make",
 			"module", "import", "export", "public", "private",
 			"func", "proc", "struct", "enum",
-			"if", "else", "loop", "break", "continue", "return", "true", "false",
+			"if", "else", "match", "loop", "break", "continue", "return", "try", "catch", "throw", "true", "false",
 			",", ";", ":", "?", "@", "#", "$",
 			"+", "-", "*", "/", "%", "^", "~",
 			"(", ")", "[", "]", "{", "}",
@@ -23,7 +23,7 @@ namespace eokas
 
 		STRUCT_DEF, ENUM_DEF, PROC_DEF,
 
-        RETURN, IF, LOOP, BREAK, CONTINUE, BLOCK, ASSIGN, INVOKE,
+        RETURN, IF, MATCH, LOOP, BREAK, CONTINUE, TRY, THROW, BLOCK, ASSIGN, INVOKE,
 	};
 	
 	enum class ast_binary_oper_t
@@ -57,6 +57,10 @@ namespace eokas
 	{
 		String name = "";
 		std::vector<ast_node_type_t*> args = {};
+		// Fixed-size arrays are named '[]', their element type is the only arg.
+		// A '[]' without a length is a slice.
+		u64_t length = 0;
+		bool soa = false;
 		
 		explicit ast_node_type_t(ast_node_t* parent)
 			: ast_node_t(ast_category_t::TYPE, parent)
@@ -83,11 +87,18 @@ namespace eokas
 		{
 			String name = "";
 			ast_node_type_t* type = nullptr;
+			bool variable = false;
 		};
 
 		ast_node_type_t* rtype = nullptr;
 		std::vector<arg_t> args = {};
 		std::vector<ast_node_stmt_t*> body = {};
+		// '#fastmath', the float math of the body may be reordered and contracted.
+		bool fastmath = false;
+		// '#memo(n)', the results of the n latest distinct calls are cached, 0 is no cache.
+		u32_t memo = 0;
+		// '#memo(n, lru)', a 4-way cache dropping the least recently used result instead of direct-mapped.
+		bool memo_lru = false;
 
 		explicit ast_node_func_def_t(ast_node_t* parent)
 			: ast_node_expr_t(ast_category_t::FUNC_DEF, parent)
@@ -225,6 +236,9 @@ namespace eokas
 	{
 		ast_node_expr_t* obj = nullptr;
 		ast_node_expr_t* key = nullptr;
+		// 'obj[key..end]' is a slice, a missing key or end is the start or the end of obj.
+		ast_node_expr_t* end = nullptr;
+		bool slice = false;
 
 		explicit ast_node_array_ref_t(ast_node_t* parent)
 			: ast_node_expr_t(ast_category_t::ARRAY_REF, parent)
@@ -259,10 +273,15 @@ namespace eokas
 			ast_node_type_t* type = nullptr;
 			ast_node_expr_t* value = nullptr;
 			bool isConst = false;
+			u32_t align = 0;
 		};
 
 		String name = "";
+		ast_node_type_t* base = nullptr;
 		std::vector<member_t> members = {};
+		bool packed = false;
+		bool reorder = false;
+		u32_t align = 0;
 
 		explicit ast_node_struct_def_t(ast_node_t* parent)
 			: ast_node_stmt_t(ast_category_t::STRUCT_DEF, parent)
@@ -330,12 +349,42 @@ namespace eokas
 		{ }
 	};
 
+	struct ast_node_match_t : public ast_node_stmt_t
+	{
+		struct case_t
+		{
+			std::vector<ast_node_expr_t*> values = {};
+			ast_node_stmt_t* body = nullptr;
+		};
+
+		ast_node_expr_t* value = nullptr;
+		std::vector<case_t> cases = {};
+		// 'else: stmt', runs if no case has the value.
+		ast_node_stmt_t* other = nullptr;
+
+		explicit ast_node_match_t(ast_node_t* parent)
+			: ast_node_stmt_t(ast_category_t::MATCH, parent)
+		{ }
+	};
+
 	struct ast_node_loop_t : public ast_node_stmt_t
 	{
 		ast_node_stmt_t* init = nullptr;
 		ast_node_expr_t* cond = nullptr;
 		ast_node_stmt_t* step = nullptr;
 		ast_node_stmt_t* body = nullptr;
+		// 'loop(counter in begin..end)' has no init, cond and step, '...' includes the end.
+		String counter = "";
+		ast_node_expr_t* begin = nullptr;
+		ast_node_expr_t* end = nullptr;
+		bool inclusive = false;
+		// '#unroll', '#unroll(n)', '#vectorize', '#vectorize(width)', '#interleave(n)' and '#no_alias'.
+		u32_t unroll = 0;
+		bool unroll_full = false;
+		u32_t vectorize = 0;
+		bool vectorize_enable = false;
+		u32_t interleave = 0;
+		bool no_alias = false;
 
 		explicit ast_node_loop_t(ast_node_t* parent)
 			: ast_node_stmt_t(ast_category_t::LOOP, parent)
@@ -356,6 +405,32 @@ namespace eokas
 		{ }
 	};
 
+	struct ast_node_try_t : public ast_node_stmt_t
+	{
+		struct catch_t
+		{
+			String name = "";
+			ast_node_type_t* type = nullptr;
+			ast_node_stmt_t* body = nullptr;
+		};
+
+		ast_node_stmt_t* body = nullptr;
+		std::vector<catch_t> catches = {};
+
+		explicit ast_node_try_t(ast_node_t* parent)
+			: ast_node_stmt_t(ast_category_t::TRY, parent)
+		{ }
+	};
+
+	struct ast_node_throw_t : public ast_node_stmt_t
+	{
+		ast_node_expr_t* value = nullptr;
+
+		explicit ast_node_throw_t(ast_node_t* parent)
+			: ast_node_stmt_t(ast_category_t::THROW, parent)
+		{ }
+	};
+
 	struct ast_node_block_t : public ast_node_stmt_t
 	{
 		std::vector<ast_node_stmt_t*> stmts = {};
@@ -12,6 +12,7 @@ namespace eokas {
         virtual omis_handle_t make_module(const String& name) = 0;
         virtual void drop_module(omis_handle_t mod) = 0;
         virtual String dump_module(omis_handle_t mod) = 0;
+        virtual bool finalize_module(omis_handle_t mod) = 0;
 
         virtual omis_handle_t type_void() = 0;
         virtual omis_handle_t type_i8() = 0;
@@ -28,6 +29,11 @@ namespace eokas {
         virtual omis_handle_t type_bytes() = 0;
         virtual omis_handle_t type_pointer(omis_handle_t type) = 0;
         virtual omis_handle_t type_func(omis_handle_t ret, const std::vector<omis_handle_t>& args, bool varg) = 0;
+        virtual omis_handle_t type_struct(const String& name) = 0;
+        virtual omis_handle_t type_array(omis_handle_t element, u64_t count) = 0;
+        virtual omis_handle_t type_tuple(const std::vector<omis_handle_t>& members) = 0;
+        virtual omis_handle_t type_vector(omis_handle_t element, u32_t count) = 0;
+        virtual void set_struct_body(omis_handle_t type, const std::vector<omis_handle_t>& members, bool packed) = 0;
         virtual bool is_type_void(omis_handle_t type) = 0;
         virtual bool is_type_i8(omis_handle_t type) = 0;
         virtual bool is_type_i16(omis_handle_t type) = 0;
@@ -40,10 +46,17 @@ namespace eokas {
         virtual bool is_type_func(omis_handle_t type) = 0;
         virtual bool is_type_array(omis_handle_t type) = 0;
         virtual bool is_type_struct(omis_handle_t type) = 0;
+        virtual bool is_type_vector(omis_handle_t type) = 0;
 		virtual String get_type_name(omis_handle_t type) = 0;
         virtual omis_handle_t get_type_size(omis_handle_t type) = 0;
+        virtual u64_t get_type_alloc_size(omis_handle_t type) = 0;
+        virtual u32_t get_type_align(omis_handle_t type) = 0;
+        virtual u64_t get_struct_member_offset(omis_handle_t type, uint32_t index) = 0;
 
         virtual bool can_losslessly_cast(omis_handle_t a, omis_handle_t b) = 0;
+        virtual omis_handle_t get_pointer_element_type(omis_handle_t type) = 0;
+        virtual omis_handle_t get_vector_element_type(omis_handle_t type) = 0;
+        virtual u32_t get_vector_length(omis_handle_t type) = 0;
         virtual omis_handle_t get_func_ret_type(omis_handle_t type_func) = 0;
         virtual uint32_t get_func_arg_count(omis_handle_t type_func) = 0;
         virtual omis_handle_t get_func_arg_type(omis_handle_t type_func, uint32_t index) = 0;
@@ -54,10 +67,21 @@ namespace eokas {
         virtual omis_handle_t value_float(double val) = 0;
         virtual omis_handle_t value_bool(bool val) = 0;
         virtual omis_handle_t value_func(omis_handle_t mod, const String& name, omis_handle_t type) = 0;
-        // virtual omis_handle_t value_array(omis_handle_t element_type) = 0;
+        virtual void set_func_fp_model(omis_handle_t func, omis_fp_model_t model) = 0;
+        virtual void set_func_memo(omis_handle_t func, uint32_t capacity, uint32_t ways) = 0;
+        virtual omis_handle_t value_builtin(omis_handle_t mod, const String& name, omis_handle_t type) = 0;
+        virtual omis_handle_t value_array(omis_handle_t mod, omis_handle_t element_type, const std::vector<omis_handle_t>& elements) = 0;
+        virtual omis_handle_t value_global(omis_handle_t mod, const String& name, omis_handle_t type, omis_handle_t init, bool constant) = 0;
+        virtual omis_handle_t value_vector(const std::vector<omis_handle_t>& elements) = 0;
 
         virtual omis_handle_t get_value_type(omis_handle_t value) = 0;
         virtual void set_value_name(omis_handle_t value, const String& name) = 0;
+        virtual bool is_value_func(omis_handle_t value) = 0;
+        virtual bool is_value_const(omis_handle_t value) = 0;
+        virtual bool is_value_const_int(omis_handle_t value) = 0;
+        virtual bool is_value_const_float(omis_handle_t value) = 0;
+        virtual int64_t get_value_const_int(omis_handle_t value) = 0;
+        virtual double get_value_const_float(omis_handle_t value) = 0;
 
         virtual omis_handle_t create_block(omis_handle_t func, const String& name) = 0;
         virtual omis_handle_t get_active_block() = 0;
@@ -70,9 +94,26 @@ namespace eokas {
         virtual omis_handle_t load(omis_handle_t ptr) = 0;
         virtual omis_handle_t store(omis_handle_t ptr, omis_handle_t val) = 0;
         virtual omis_handle_t gep(omis_handle_t type, omis_handle_t ptr, omis_handle_t index) = 0;
+        virtual omis_handle_t gep_struct(omis_handle_t type, omis_handle_t ptr, uint32_t index) = 0;
+        virtual omis_handle_t gep_array(omis_handle_t type, omis_handle_t ptr, omis_handle_t index) = 0;
+        virtual omis_handle_t copy(omis_handle_t dst, omis_handle_t src, omis_handle_t size) = 0;
+        virtual omis_handle_t check_bounds(omis_handle_t mod, omis_handle_t index, omis_handle_t length) = 0;
+        virtual omis_handle_t check_range(omis_handle_t mod, omis_handle_t begin, omis_handle_t end, omis_handle_t length) = 0;
+        virtual omis_handle_t extract_value(omis_handle_t agg, uint32_t index) = 0;
+        virtual omis_handle_t insert_value(omis_handle_t agg, omis_handle_t val, uint32_t index) = 0;
+        virtual omis_handle_t extract_element(omis_handle_t vec, omis_handle_t index) = 0;
+        virtual omis_handle_t insert_element(omis_handle_t vec, omis_handle_t val, omis_handle_t index) = 0;
+        virtual omis_handle_t splat(omis_handle_t value, u32_t count) = 0;
+        virtual omis_handle_t shuffle(omis_handle_t a, omis_handle_t b, const std::vector<int>& mask) = 0;
+        virtual omis_handle_t reduce(omis_reduce_op_t op, omis_handle_t vec) = 0;
+        virtual omis_handle_t gc_root(omis_handle_t type, const String& name) = 0;
+        virtual omis_handle_t gc_type_descriptor(omis_handle_t mod, omis_handle_t type) = 0;
+        virtual omis_handle_t type_info(omis_handle_t mod, const String& owner, omis_handle_t type, omis_handle_t base) = 0;
+        virtual omis_handle_t closure_of(omis_handle_t mod, omis_handle_t type, omis_handle_t func) = 0;
 
         virtual omis_handle_t neg(omis_handle_t a) = 0;
         virtual omis_handle_t add(omis_handle_t a, omis_handle_t b) = 0;
+        virtual omis_handle_t add_nsw(omis_handle_t a, omis_handle_t b) = 0;
         virtual omis_handle_t sub(omis_handle_t a, omis_handle_t b) = 0;
         virtual omis_handle_t mul(omis_handle_t a, omis_handle_t b) = 0;
         virtual omis_handle_t div(omis_handle_t a, omis_handle_t b) = 0;
@@ -98,11 +139,24 @@ namespace eokas {
 
         virtual omis_handle_t jump(omis_handle_t pos) = 0;
         virtual omis_handle_t jump_cond(omis_handle_t cond, omis_handle_t branch_true, omis_handle_t branch_false) = 0;
+        virtual void set_unwind_dest(omis_handle_t func, omis_handle_t landing) = 0;
+        virtual omis_handle_t landing_pad(omis_handle_t mod, const std::vector<omis_handle_t>& infos) = 0;
+        virtual omis_handle_t catch_matches(omis_handle_t mod, omis_handle_t exception, omis_handle_t info) = 0;
+        virtual omis_handle_t catch_object(omis_handle_t mod, omis_handle_t exception) = 0;
+        virtual omis_handle_t resume(omis_handle_t exception) = 0;
+        virtual omis_handle_t throw_value(omis_handle_t mod, omis_handle_t object, omis_handle_t info) = 0;
+        virtual omis_handle_t jump_switch(omis_handle_t value, omis_handle_t other, const std::vector<std::pair<omis_handle_t, omis_handle_t>>& cases) = 0;
+        virtual void set_loop_hints(omis_handle_t header, omis_handle_t back_edge, const omis_loop_hints_t& hints) = 0;
         virtual omis_handle_t phi(omis_handle_t type, const std::map<omis_handle_t, omis_handle_t>& incomings) = 0;
+        virtual omis_handle_t select(omis_handle_t cond, omis_handle_t a, omis_handle_t b) = 0;
         virtual omis_handle_t call(omis_handle_t func, const std::vector<omis_handle_t>& args) = 0;
+        virtual omis_handle_t call_closure(omis_handle_t code, omis_handle_t env, const std::vector<omis_handle_t>& args) = 0;
         virtual omis_handle_t ret(omis_handle_t value = nullptr) = 0;
+        virtual bool mark_tail_call(omis_handle_t value) = 0;
 
         virtual omis_handle_t bitcast(omis_handle_t value, omis_handle_t type) = 0;
+        virtual omis_handle_t fp_cast(omis_handle_t value, omis_handle_t type) = 0;
+        virtual omis_handle_t int_cast(omis_handle_t value, omis_handle_t type) = 0;
 
         virtual omis_handle_t get_ptr_val(omis_handle_t ptr) = 0;
         virtual omis_handle_t get_ptr_ref(omis_handle_t ptr) = 0;
@@ -7,6 +7,7 @@
 namespace eokas {
     omis_engine_t::omis_engine_t()
         : bridge(nullptr)
+        , options()
         , modules() {
         bridge = llvm_init();
     }
@@ -20,6 +21,10 @@ namespace eokas {
         return this->bridge;
     }
 
+    omis_options_t& omis_engine_t::get_options() {
+        return this->options;
+    }
+
     bool omis_engine_t::add_module(const String &name, omis_module_t *mod) {
         auto iter = this->modules.find(name);
         if(iter != this->modules.end())
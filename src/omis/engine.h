@@ -11,6 +11,7 @@ namespace eokas {
         virtual ~omis_engine_t();
 
         omis_bridge_t* get_bridge();
+        omis_options_t& get_options();
 
         bool add_module(const String& name, omis_module_t* mod);
         omis_module_t* get_module(const String& name);
@@ -21,6 +22,7 @@ namespace eokas {
 
     private:
         omis_bridge_t* bridge;
+        omis_options_t options;
         std::map<String, omis_module_t*> modules;
     };
 }
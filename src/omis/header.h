@@ -4,6 +4,10 @@
 
 #include "../ast/ast.h"
 
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+
 namespace eokas {
     using omis_handle_t = void*;
 
@@ -17,9 +21,46 @@ namespace eokas {
 
     class omis_type_t;
     class omis_struct_t;
+    class omis_array_t;
+    class omis_slice_t;
+    class omis_vector_t;
 
     class omis_value_t;
 
+    struct omis_string_hash_t {
+        size_t operator()(const String& str) const {
+            return std::hash<std::string_view>()(std::string_view(str.cstr(), str.length()));
+        }
+    };
+
+    // How freely float math may be rewritten. 'CONTRACT' lets 'a * b + c' become an FMA,
+    // 'FAST' also reorders sums and products, so float reductions can be vectorized.
+    enum class omis_fp_model_t {
+        STRICT, CONTRACT, FAST,
+    };
+
+    struct omis_options_t {
+        // Objects are collected by the runtime GC instead of being dropped by hand.
+        bool gc = false;
+        // The float model of the functions without '#fastmath'.
+        omis_fp_model_t fp_model = omis_fp_model_t::STRICT;
+    };
+
+    enum class omis_reduce_op_t {
+        ADD, MUL, MIN, MAX, AND, OR,
+    };
+
+    // Tuning of one loop for the optimizer, 0 leaves a count to its cost model.
+    struct omis_loop_hints_t {
+        u32_t unroll = 0;
+        bool unroll_full = false;
+        u32_t vectorize = 0;
+        bool vectorize_enable = false;
+        u32_t interleave = 0;
+        // No iteration reads or writes memory another iteration writes.
+        bool no_alias = false;
+    };
+
     template<typename T>
     using omis_lambda_predicate_t = std::function<bool(const T&)>;
 
@@ -27,6 +68,19 @@ namespace eokas {
     using omis_lambda_type_t = std::function<omis_type_t*()>;
     using omis_lambda_stmt_t = std::function<bool()>;
 
+    // A 'catch' of 'try', binding the caught object of the struct type to 'name'.
+    struct omis_catch_t {
+        String name;
+        omis_lambda_type_t type;
+        omis_lambda_stmt_t body;
+    };
+
+    // A case of 'match', its values must be constant integers.
+    struct omis_match_case_t {
+        std::vector<omis_lambda_expr_t> values;
+        omis_lambda_stmt_t body;
+    };
+
     using omis_lambda_loading_t = std::function<omis_module_t*()>;
 }
 
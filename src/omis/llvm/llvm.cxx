@@ -2,14 +2,25 @@
 
 #include "../bridge.h"
 #include "../model.h"
+#include "../../runtime/allocator.h"
+#include "../../runtime/array.h"
+#include "../../runtime/exception.h"
+#include "../../runtime/gc.h"
+#include "../../runtime/memo.h"
 
 #include <sstream>
+#include <set>
 
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/APSInt.h>
 #include <llvm/ADT/APFloat.h>
 #include <llvm/ADT/STLExtras.h>
 
+#include <llvm/Analysis/CaptureTracking.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
+
+#include <llvm/IR/CFG.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/Module.h>
@@ -19,12 +30,24 @@
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/MDBuilder.h>
+
+#include <llvm/Passes/PassBuilder.h>
+
+#include <llvm/CodeGen/BuiltinGCs.h>
+
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/Local.h>
 
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
 
+#include <llvm/Support/DynamicLibrary.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Host.h>
 #include <llvm/Support/TargetRegistry.h>
@@ -62,8 +85,28 @@ namespace eokas
         llvm::Type* ty_bytes;
         llvm::Type* ty_void_ptr;
 
+        std::string triple;
+        llvm::DataLayout layout;
+        // The float instructions of a function get its flags, see set_active_block.
+        std::map<llvm::Function*, llvm::FastMathFlags> fp_flags;
+        // The '#memo' functions, their bodies are wrapped in a cache lookup by finalize_module.
+        struct memo_t {
+            uint32_t capacity;
+            uint32_t ways;
+        };
+        std::map<llvm::Function*, memo_t> memos;
+        // The landing pads calls in a 'try' unwind to, see call.
+        std::map<llvm::Function*, llvm::BasicBlock*> unwind_dests;
+        // The closures of plain functions, see closure_of.
+        std::map<llvm::Function*, llvm::Constant*> static_closures;
+        // The C functions an 'internal' declaration may bind to, with their C signatures.
+        std::map<String, llvm::FunctionType*> c_builtins;
+
+        static const uint64_t max_stack_object = 64 * 1024;
+        static const uint32_t max_inline_object_maker = 64;
+
         llvm_bridge_t()
-            : omis_bridge_t(), context(), IR(context) {
+            : omis_bridge_t(), context(), IR(context), layout("") {
             ty_void = llvm::Type::getVoidTy(context);
             ty_i8 = llvm::Type::getInt8Ty(context);
             ty_i16 = llvm::Type::getInt16Ty(context);
@@ -78,10 +121,56 @@ namespace eokas
             ty_bool = llvm::Type::getInt1Ty(context);
             ty_bytes = llvm::Type::getInt8PtrTy(context);
             ty_void_ptr = ty_void->getPointerTo();
+
+            auto func = [](llvm::Type* ret, std::vector<llvm::Type*> params) {
+                return llvm::FunctionType::get(ret, params, false);
+            };
+            c_builtins = {
+                {"srand", func(ty_void, {ty_i32})},
+                {"rand", func(ty_i32, {})},
+                {"malloc", func(ty_bytes, {ty_i64})},
+                {"aligned_alloc", func(ty_bytes, {ty_i64, ty_i64})},
+                {"free", func(ty_void, {ty_bytes})},
+                {"eokas_alloc", func(ty_bytes, {ty_i32})},
+                {"eokas_free", func(ty_void, {ty_bytes, ty_i32})},
+                {"eokas_gc_add_root", func(ty_void, {ty_bytes})},
+                {"eokas_gc_alloc", func(ty_bytes, {ty_bytes})},
+                {"eokas_gc_alloc_aligned", func(ty_bytes, {ty_bytes, ty_i64})},
+                {"eokas_array_reserve", func(ty_void, {ty_bytes, ty_i64, ty_i64})},
+                {"eokas_array_release", func(ty_void, {ty_bytes})},
+            };
+            // libm, 'name' takes doubles and 'namef' floats.
+            static const std::map<std::string, uint32_t> libm = {
+                {"sqrt", 1}, {"cbrt", 1}, {"fabs", 1}, {"floor", 1}, {"ceil", 1}, {"trunc", 1}, {"round", 1},
+                {"exp", 1}, {"exp2", 1}, {"log", 1}, {"log2", 1}, {"log10", 1},
+                {"sin", 1}, {"cos", 1}, {"tan", 1}, {"asin", 1}, {"acos", 1}, {"atan", 1},
+                {"sinh", 1}, {"cosh", 1}, {"tanh", 1},
+                {"pow", 2}, {"atan2", 2}, {"hypot", 2}, {"fmod", 2}, {"fmin", 2}, {"fmax", 2},
+                {"fma", 3},
+            };
+            for (auto& pair : libm) {
+                c_builtins[String(pair.first.c_str())] = func(ty_f64, std::vector<llvm::Type*>(pair.second, ty_f64));
+                c_builtins[String((pair.first + "f").c_str())] = func(ty_f32, std::vector<llvm::Type*>(pair.second, ty_f32));
+            }
+
+            // Object sizes are decided at compile time, so modules are laid out for the host from the start.
+            llvm::InitializeNativeTarget();
+            llvm::linkAllBuiltinGCs();
+            triple = llvm::sys::getDefaultTargetTriple();
+            std::string error;
+            auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+            if (target != nullptr) {
+                llvm::TargetOptions opt;
+                auto RM = llvm::Optional<llvm::Reloc::Model>();
+                std::unique_ptr<llvm::TargetMachine> targetMachine(target->createTargetMachine(triple, "generic", "", opt, RM));
+                layout = targetMachine->createDataLayout();
+            }
         }
 
         virtual omis_handle_t make_module(const String& name) override {
             llvm::Module* mod = new llvm::Module(name.cstr(), context);
+            mod->setDataLayout(layout);
+            mod->setTargetTriple(triple);
             return mod;
         }
 
@@ -102,6 +191,539 @@ namespace eokas
             return ret;
         }
 
+        virtual bool finalize_module(omis_handle_t mod) override {
+            auto* module = _Mod(mod);
+
+            // Internal functions which are only ever called directly can use the
+            // fast calling convention, callers and callee are all known here.
+            for (auto& func : *module) {
+                if (func.isDeclaration() || !func.hasLocalLinkage())
+                    continue;
+                if (func.getCallingConv() == llvm::CallingConv::Fast)
+                    continue;
+                bool direct = llvm::all_of(func.uses(), [&](llvm::Use& use) {
+                    auto* call = llvm::dyn_cast<llvm::CallBase>(use.getUser());
+                    return call != nullptr && call->isCallee(&use);
+                });
+                if (!direct)
+                    continue;
+                func.setCallingConv(llvm::CallingConv::Fast);
+                for (auto* user : func.users()) {
+                    llvm::cast<llvm::CallBase>(user)->setCallingConv(llvm::CallingConv::Fast);
+                }
+            }
+
+            this->inline_object_makers(module);
+            this->promote_heap_objects(module);
+
+            // A musttail call is only valid while caller and callee still agree
+            // on the calling convention, fall back to a plain tail call if not.
+            // The shadow-stack GC pops its frame right before returning, which
+            // leaves no musttail call in tail position either.
+            for (auto& func : *module) {
+                for (auto& block : func) {
+                    for (auto& ins : block) {
+                        auto* call = llvm::dyn_cast<llvm::CallInst>(&ins);
+                        if (call == nullptr || !call->isMustTailCall())
+                            continue;
+                        if (call->getCallingConv() != func.getCallingConv() || func.hasGC())
+                            call->setTailCallKind(llvm::CallInst::TCK_Tail);
+                    }
+                }
+            }
+
+            this->infer_func_attrs(module);
+
+            // Objects only passed to params which turned out not to capture them can live on the stack too.
+            this->promote_heap_objects(module);
+
+            // An invoke of a function which turned out not to throw is a plain call,
+            // a landing pad no invoke is left for goes away with it.
+            for (auto& func : *module) {
+                std::vector<llvm::InvokeInst*> invokes;
+                for (auto& block : func) {
+                    auto* invoke = llvm::dyn_cast<llvm::InvokeInst>(block.getTerminator());
+                    if (invoke != nullptr && invoke->doesNotThrow())
+                        invokes.push_back(invoke);
+                }
+                for (auto* invoke : invokes) {
+                    llvm::changeToCall(invoke);
+                }
+                if (!invokes.empty())
+                    llvm::removeUnreachableBlocks(func);
+            }
+
+            // Only now it is known if the functions to memoize are pure.
+            std::set<llvm::Function*> wrappers;
+            for (auto& func : *module) {
+                auto iter = this->memos.find(&func);
+                if (iter == this->memos.end())
+                    continue;
+                if (!func.doesNotAccessMemory() || !func.doesNotThrow()) {
+                    printf("ERROR: The '#memo' function '%s' is not pure, it may touch memory outside its stack.\n", func.getName().str().c_str());
+                    return false;
+                }
+                this->make_memo_wrapper(&func, iter->second);
+                this->memos.erase(iter);
+                wrappers.insert(&func);
+            }
+            this->widen_memo_callers(module, wrappers);
+
+            return true;
+        }
+
+        /**
+         * Moves the body of a '#memo' function into '<name>.impl' and makes the function look its
+         * args up in a cache first. The args and the result are passed to the runtime as 64-bit words.
+         * Recursive calls still go through the cache. The descriptor is constant and
+         * the cache belongs to the runtime, so the function only touches inaccessible memory.
+         * */
+        void make_memo_wrapper(llvm::Function* func, const memo_t& memo) {
+            auto* module = func->getParent();
+            auto* impl = llvm::Function::Create(func->getFunctionType(), llvm::Function::InternalLinkage, func->getName() + ".impl", module);
+            impl->copyAttributesFrom(func);
+            impl->setLinkage(llvm::Function::InternalLinkage);
+            impl->getBasicBlockList().splice(impl->end(), func->getBasicBlockList());
+            for (uint32_t index = 0; index < func->arg_size(); index++) {
+                func->getArg(index)->replaceAllUsesWith(impl->getArg(index));
+            }
+
+            // Matches eokas_memo_t: capacity, ways, key_count.
+            auto* descType = llvm::StructType::get(ty_i32, ty_i32, ty_i32);
+            auto* descValue = llvm::ConstantStruct::get(descType, {
+                llvm::ConstantInt::get(ty_i32, memo.capacity),
+                llvm::ConstantInt::get(ty_i32, memo.ways),
+                llvm::ConstantInt::get(ty_i32, func->arg_size())
+            });
+            auto* desc = new llvm::GlobalVariable(*module, descType, true, llvm::GlobalValue::PrivateLinkage, descValue, "eokas.memo." + func->getName());
+            auto* descPtr = llvm::ConstantExpr::getPointerCast(desc, ty_bytes);
+
+            auto* wordPtr = ty_i64->getPointerTo();
+            auto* lookupType = llvm::FunctionType::get(ty_i32, {ty_bytes, wordPtr, wordPtr}, false);
+            auto* storeType = llvm::FunctionType::get(ty_void, {ty_bytes, wordPtr, ty_i64}, false);
+            auto* lookup = llvm::cast<llvm::Function>(module->getOrInsertFunction("eokas_memo_lookup", lookupType).getCallee());
+            auto* store = llvm::cast<llvm::Function>(module->getOrInsertFunction("eokas_memo_store", storeType).getCallee());
+            for (auto* runtime : {lookup, store}) {
+                runtime->addFnAttr(llvm::Attribute::NoUnwind);
+                runtime->addFnAttr(llvm::Attribute::InaccessibleMemOrArgMemOnly);
+            }
+
+            func->removeFnAttr(llvm::Attribute::ReadNone);
+            func->addFnAttr(llvm::Attribute::InaccessibleMemOnly);
+
+            llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "memo", func));
+            auto* keyType = llvm::ArrayType::get(ty_i64, func->arg_size());
+            auto* key = builder.CreateAlloca(keyType, nullptr, "memo.key");
+            auto* word = builder.CreateAlloca(ty_i64, nullptr, "memo.result");
+            std::vector<llvm::Value*> args;
+            for (auto& arg : func->args()) {
+                args.push_back(&arg);
+                auto* slot = builder.CreateConstGEP2_32(keyType, key, 0, args.size() - 1);
+                builder.CreateStore(this->memo_to_word(builder, &arg), slot);
+            }
+            auto* keyPtr = builder.CreateConstGEP2_32(keyType, key, 0, 0);
+            auto* found = builder.CreateCall(lookup, {descPtr, keyPtr, word});
+
+            auto* hitBlock = llvm::BasicBlock::Create(context, "memo.hit", func);
+            auto* missBlock = llvm::BasicBlock::Create(context, "memo.miss", func);
+            builder.CreateCondBr(builder.CreateICmpNE(found, llvm::ConstantInt::get(ty_i32, 0)), hitBlock, missBlock);
+
+            builder.SetInsertPoint(hitBlock);
+            builder.CreateRet(this->memo_from_word(builder, builder.CreateLoad(ty_i64, word), func->getReturnType()));
+
+            builder.SetInsertPoint(missBlock);
+            auto* result = builder.CreateCall(impl, args);
+            result->setCallingConv(impl->getCallingConv());
+            builder.CreateCall(store, {descPtr, keyPtr, this->memo_to_word(builder, result)});
+            builder.CreateRet(result);
+        }
+
+        /**
+         * The callers of a '#memo' function got their attributes for calling a pure function,
+         * but its cache is written on every call: a readnone caller touches inaccessible memory
+         * from now on, a readonly one writes it. Their own callers are widened in turn.
+         * */
+        void widen_memo_callers(llvm::Module* module, std::set<llvm::Function*> widened) {
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (auto& func : *module) {
+                    if (func.isDeclaration() || widened.find(&func) != widened.end())
+                        continue;
+                    bool calls = false;
+                    for (auto& block : func) {
+                        for (auto& ins : block) {
+                            auto* call = llvm::dyn_cast<llvm::CallBase>(&ins);
+                            if (call != nullptr && widened.find(call->getCalledFunction()) != widened.end())
+                                calls = true;
+                        }
+                    }
+                    if (!calls)
+                        continue;
+                    if (func.hasFnAttribute(llvm::Attribute::ReadNone)) {
+                        func.removeFnAttr(llvm::Attribute::ReadNone);
+                        func.addFnAttr(llvm::Attribute::InaccessibleMemOnly);
+                    }
+                    func.removeFnAttr(llvm::Attribute::ReadOnly);
+                    widened.insert(&func);
+                    changed = true;
+                }
+            }
+        }
+
+        llvm::Value* memo_to_word(llvm::IRBuilder<>& builder, llvm::Value* value) {
+            auto* type = value->getType();
+            if (type->isFloatingPointTy())
+                value = builder.CreateBitCast(value, llvm::IntegerType::get(context, type->getPrimitiveSizeInBits()));
+            return builder.CreateZExtOrTrunc(value, ty_i64);
+        }
+
+        llvm::Value* memo_from_word(llvm::IRBuilder<>& builder, llvm::Value* word, llvm::Type* type) {
+            if (!type->isFloatingPointTy())
+                return builder.CreateTrunc(word, type);
+            auto* bits = builder.CreateTrunc(word, llvm::IntegerType::get(context, type->getPrimitiveSizeInBits()));
+            return builder.CreateBitCast(bits, type);
+        }
+
+        // What a function may do besides working on its own stack.
+        enum class MemoryEffect {NONE, READ, WRITE};
+
+        struct func_effects_t {
+            MemoryEffect memory = MemoryEffect::NONE;
+            bool unwinds = false;
+
+            bool operator!=(const func_effects_t& other) const {
+                return memory != other.memory || unwinds != other.unwinds;
+            }
+        };
+
+        /**
+         * Marks the functions of the module readnone, readonly and nounwind, their pointer
+         * params nocapture and their results noalias where that holds, so the optimizer may
+         * move, merge and vectorize calls like it does with plain instructions.
+         * Every function starts as doing nothing and is widened until nothing changes,
+         * which also settles recursive functions.
+         * */
+        void infer_func_attrs(llvm::Module* module) {
+            std::map<llvm::Function*, func_effects_t> effects;
+            for (auto& func : *module) {
+                if (!func.isDeclaration())
+                    effects[&func] = func_effects_t();
+            }
+
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (auto& pair : effects) {
+                    auto scanned = this->scan_func_effects(*pair.first, effects);
+                    if (scanned != pair.second) {
+                        pair.second = scanned;
+                        changed = true;
+                    }
+                }
+            }
+
+            for (auto& pair : effects) {
+                auto* func = pair.first;
+                if (pair.second.memory == MemoryEffect::NONE)
+                    func->addFnAttr(llvm::Attribute::ReadNone);
+                else if (pair.second.memory == MemoryEffect::READ)
+                    func->addFnAttr(llvm::Attribute::ReadOnly);
+                if (!pair.second.unwinds)
+                    func->addFnAttr(llvm::Attribute::NoUnwind);
+            }
+
+            // A param passed on to a call is only not captured once the callee's param is known
+            // not to be, and a result is only fresh once the callee's result is.
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (auto& pair : effects) {
+                    auto* func = pair.first;
+                    for (auto& arg : func->args()) {
+                        if (!arg.getType()->isPointerTy() || arg.hasNoCaptureAttr())
+                            continue;
+                        if (llvm::PointerMayBeCaptured(&arg, true, true))
+                            continue;
+                        arg.addAttr(llvm::Attribute::NoCapture);
+                        changed = true;
+                    }
+                    if (!func->hasRetAttribute(llvm::Attribute::NoAlias) && this->returns_fresh_object(*func)) {
+                        func->addRetAttr(llvm::Attribute::NoAlias);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        func_effects_t scan_func_effects(llvm::Function& func, const std::map<llvm::Function*, func_effects_t>& effects) {
+            func_effects_t result;
+            auto touch = [&](MemoryEffect effect) {
+                result.memory = std::max(result.memory, effect);
+            };
+            auto isLocal = [](llvm::Value* ptr) {
+                return llvm::isa<llvm::AllocaInst>(llvm::getUnderlyingObject(ptr));
+            };
+
+            // The shadow-stack GC links a frame of every such function into a global chain.
+            if (func.hasGC())
+                touch(MemoryEffect::WRITE);
+
+            // Exceptions thrown into a landing pad only leave the function if it resumes them.
+            bool sawInvoke = false;
+            bool sawResume = false;
+            for (auto& block : func) {
+                for (auto& ins : block) {
+                    if (llvm::isa<llvm::ResumeInst>(&ins)) {
+                        sawResume = true;
+                        continue;
+                    }
+                    if (auto* load = llvm::dyn_cast<llvm::LoadInst>(&ins)) {
+                        if (!isLocal(load->getPointerOperand()))
+                            touch(load->isVolatile() ? MemoryEffect::WRITE : MemoryEffect::READ);
+                        continue;
+                    }
+                    if (auto* store = llvm::dyn_cast<llvm::StoreInst>(&ins)) {
+                        if (!isLocal(store->getPointerOperand()))
+                            touch(MemoryEffect::WRITE);
+                        continue;
+                    }
+                    if (auto* memory = llvm::dyn_cast<llvm::MemIntrinsic>(&ins)) {
+                        if (!isLocal(memory->getDest()))
+                            touch(MemoryEffect::WRITE);
+                        auto* transfer = llvm::dyn_cast<llvm::MemTransferInst>(&ins);
+                        if (transfer != nullptr && !isLocal(transfer->getSource()))
+                            touch(MemoryEffect::READ);
+                        continue;
+                    }
+                    auto* call = llvm::dyn_cast<llvm::CallBase>(&ins);
+                    if (call == nullptr) {
+                        if (ins.mayWriteToMemory())
+                            touch(MemoryEffect::WRITE);
+                        else if (ins.mayReadFromMemory())
+                            touch(MemoryEffect::READ);
+                        continue;
+                    }
+
+                    auto* callee = call->getCalledFunction();
+                    auto known = callee != nullptr ? effects.find(callee) : effects.end();
+                    bool unwinds = false;
+                    if (known != effects.end()) {
+                        touch(known->second.memory);
+                        unwinds = known->second.unwinds;
+                    } else {
+                        // Declared elsewhere or called through a pointer, only the attributes tell.
+                        if (!call->doesNotAccessMemory())
+                            touch(call->onlyReadsMemory() ? MemoryEffect::READ : MemoryEffect::WRITE);
+                        unwinds = !call->doesNotThrow();
+                    }
+                    if (llvm::isa<llvm::InvokeInst>(call))
+                        sawInvoke = sawInvoke || unwinds;
+                    else
+                        result.unwinds = result.unwinds || unwinds;
+                }
+            }
+            result.unwinds = result.unwinds || (sawInvoke && sawResume);
+
+            return result;
+        }
+
+        // Every value returned is an object made by this call, like the result of make().
+        bool returns_fresh_object(llvm::Function& func) {
+            if (!func.getReturnType()->isPointerTy())
+                return false;
+            bool returns = false;
+            for (auto& block : func) {
+                auto* ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator());
+                if (ret == nullptr)
+                    continue;
+                auto* call = llvm::dyn_cast<llvm::CallBase>(ret->getReturnValue()->stripPointerCasts());
+                if (call == nullptr || !call->hasRetAttr(llvm::Attribute::NoAlias))
+                    return false;
+                returns = true;
+            }
+            return returns;
+        }
+
+        /**
+         * A small function returning an object it makes, like 'add' of a vector struct, always
+         * allocates since the object leaves it. Inlined where it is called directly, the object
+         * may not leave the caller and can live on its stack.
+         * */
+        void inline_object_makers(llvm::Module* module) {
+            auto isMaker = [&](llvm::Function* func) {
+                if (func == nullptr || func->isDeclaration() || !func->hasLocalLinkage() || func->hasGC())
+                    return false;
+                if (!func->getReturnType()->isPointerTy() || func->getInstructionCount() > max_inline_object_maker)
+                    return false;
+                if (this->memos.find(func) != this->memos.end())
+                    return false;
+                bool makes = false;
+                for (auto& block : *func) {
+                    for (auto& ins : block) {
+                        auto* call = llvm::dyn_cast<llvm::CallInst>(&ins);
+                        if (call == nullptr)
+                            continue;
+                        if (call->isMustTailCall() || call->getCalledFunction() == func)
+                            return false;
+                        auto* callee = call->getCalledFunction();
+                        auto name = callee != nullptr ? callee->getName() : "";
+                        makes = makes || name == "malloc" || name == "aligned_alloc" || name == "eokas_alloc";
+                    }
+                }
+                return makes;
+            };
+
+            std::vector<llvm::CallInst*> calls;
+            for (auto& func : *module) {
+                if (func.isDeclaration() || func.hasGC())
+                    continue;
+                for (auto& block : func) {
+                    for (auto& ins : block) {
+                        auto* call = llvm::dyn_cast<llvm::CallInst>(&ins);
+                        if (call != nullptr && call->getCalledFunction() != &func && isMaker(call->getCalledFunction()))
+                            calls.push_back(call);
+                    }
+                }
+            }
+            for (auto* call : calls) {
+                // Lifetime markers would hide the slots of the callee from promote_heap_to_stack.
+                llvm::InlineFunctionInfo info;
+                llvm::InlineFunction(*call, info, nullptr, false);
+            }
+        }
+
+        // Objects made in a function which never leave it live on its stack.
+        void promote_heap_objects(llvm::Module* module) {
+            for (auto& func : *module) {
+                if (func.isDeclaration())
+                    continue;
+                llvm::DominatorTree DT(func);
+                llvm::LoopInfo LI(DT);
+                std::vector<std::pair<llvm::CallInst*, bool>> allocs;
+                for (auto& block : func) {
+                    bool inLoop = LI.getLoopFor(&block) != nullptr;
+                    for (auto& ins : block) {
+                        auto* call = llvm::dyn_cast<llvm::CallInst>(&ins);
+                        auto* callee = call != nullptr ? call->getCalledFunction() : nullptr;
+                        if (callee == nullptr)
+                            continue;
+                        auto name = callee->getName();
+                        if (name == "malloc" || name == "aligned_alloc" || name == "eokas_alloc")
+                            allocs.push_back(std::make_pair(call, inLoop));
+                    }
+                }
+                for (auto& pair : allocs) {
+                    this->promote_heap_to_stack(pair.first, pair.second);
+                }
+            }
+        }
+
+        bool promote_heap_to_stack(llvm::CallInst* call, bool inLoop) {
+            // make() casts the memory to the object type right away. malloc is given the object size,
+            // aligned_alloc the alignment and the size, eokas_alloc a size class the compiler picked.
+            if (!call->hasOneUse())
+                return false;
+            auto* cast = llvm::dyn_cast<llvm::BitCastInst>(call->user_back());
+            if (cast == nullptr)
+                return false;
+            auto* type = cast->getDestTy()->getPointerElementType();
+            // Big arrays stay on the heap, the stack is not made for them.
+            if (layout.getTypeAllocSize(type) > max_stack_object)
+                return false;
+            auto name = call->getCalledFunction()->getName();
+            llvm::Align align(16);
+            if (name == "malloc" && call->getArgOperand(0) != llvm::ConstantExpr::getSizeOf(type))
+                return false;
+            if (name == "aligned_alloc") {
+                auto* alignment = llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(0));
+                if (alignment == nullptr || call->getArgOperand(1) != llvm::ConstantExpr::getSizeOf(type))
+                    return false;
+                align = llvm::Align(alignment->getZExtValue());
+            }
+
+            // An object made inside a loop may still be referenced by the next iteration
+            // through a slot, one stack slot is only enough if it is never stored.
+            std::vector<llvm::Instruction*> frees;
+            std::vector<llvm::CallBase*> calls;
+            if (this->is_object_escaped(cast, !inLoop, frees, calls))
+                return false;
+
+            auto& entry = call->getFunction()->getEntryBlock();
+            llvm::IRBuilder<> builder(&entry, entry.getFirstInsertionPt());
+            auto* object = builder.CreateAlloca(type, nullptr, "object");
+            // Explicit layouts are packed bodies, the heap alignment is what their offsets rely on.
+            object->setAlignment(std::max(object->getAlign(), align));
+            cast->replaceAllUsesWith(object);
+            cast->eraseFromParent();
+            call->eraseFromParent();
+            for (auto* ins : frees) {
+                ins->eraseFromParent();
+            }
+            // A tail call must not see the stack of its caller.
+            for (auto* user : calls) {
+                auto* tail = llvm::dyn_cast<llvm::CallInst>(user);
+                if (tail != nullptr)
+                    tail->setTailCallKind(llvm::CallInst::TCK_None);
+            }
+            return true;
+        }
+
+        bool is_object_escaped(llvm::Value* object, bool slots, std::vector<llvm::Instruction*>& frees, std::vector<llvm::CallBase*>& calls) {
+            std::vector<llvm::Value*> refs = {object};
+            std::set<llvm::Value*> visited;
+            while (!refs.empty()) {
+                auto* ref = refs.back();
+                refs.pop_back();
+                if (!visited.insert(ref).second)
+                    continue;
+
+                for (auto* user : ref->users()) {
+                    // Reading, comparing or addressing into the object, or copying from or into it.
+                    if (llvm::isa<llvm::LoadInst>(user) || llvm::isa<llvm::ICmpInst>(user) || llvm::isa<llvm::MemTransferInst>(user))
+                        continue;
+                    if (llvm::isa<llvm::GetElementPtrInst>(user) || llvm::isa<llvm::BitCastInst>(user)) {
+                        refs.push_back(user);
+                        continue;
+                    }
+                    if (auto* store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+                        if (store->getValueOperand() != ref)
+                            continue;
+                        // The reference itself is stored, only a local slot may hold it,
+                        // and everything loaded from that slot is a reference as well.
+                        auto* slot = llvm::dyn_cast<llvm::AllocaInst>(store->getPointerOperand());
+                        if (slot == nullptr || !slots)
+                            return true;
+                        for (auto* slotUser : slot->users()) {
+                            if (llvm::isa<llvm::LoadInst>(slotUser)) {
+                                refs.push_back(slotUser);
+                                continue;
+                            }
+                            auto* slotStore = llvm::dyn_cast<llvm::StoreInst>(slotUser);
+                            if (slotStore == nullptr || slotStore->getValueOperand() == slot)
+                                return true;
+                        }
+                        continue;
+                    }
+                    if (auto* call = llvm::dyn_cast<llvm::CallBase>(user)) {
+                        auto* callee = call->getCalledFunction();
+                        if (callee != nullptr && (callee->getName() == "free" || callee->getName() == "eokas_free")) {
+                            frees.push_back(call);
+                            continue;
+                        }
+                        // Passed to params which neither keep nor return it.
+                        if (call->getCalledOperand() == ref)
+                            return true;
+                        for (uint32_t index = 0; index < call->arg_size(); index++) {
+                            if (call->getArgOperand(index) == ref && !call->doesNotCapture(index))
+                                return true;
+                        }
+                        calls.push_back(call);
+                        continue;
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
         virtual omis_handle_t type_void() override {
             return ty_void;
         }
@@ -168,6 +790,35 @@ namespace eokas
             return funcType;
         }
 
+        virtual omis_handle_t type_struct(const String& name) override {
+            return llvm::StructType::create(context, name.cstr());
+        }
+
+        virtual omis_handle_t type_array(omis_handle_t element, u64_t count) override {
+            return llvm::ArrayType::get(_Ty(element), count);
+        }
+
+        virtual omis_handle_t type_vector(omis_handle_t element, u32_t count) override {
+            return llvm::FixedVectorType::get(_Ty(element), count);
+        }
+
+        // An unnamed struct, passed and stored by value like the scalars.
+        virtual omis_handle_t type_tuple(const std::vector<omis_handle_t>& members) override {
+            std::vector<llvm::Type*> members_type;
+            for(auto& member : members) {
+                members_type.push_back(_Ty(member));
+            }
+            return llvm::StructType::get(context, members_type);
+        }
+
+        virtual void set_struct_body(omis_handle_t type, const std::vector<omis_handle_t>& members, bool packed) override {
+            std::vector<llvm::Type*> members_type;
+            for(auto& member : members) {
+                members_type.push_back(_Ty(member));
+            }
+            llvm::cast<llvm::StructType>(_Ty(type))->setBody(members_type, packed);
+        }
+
         virtual bool is_type_void(omis_handle_t type) override {
             return _Ty(type)->isVoidTy();
         }
@@ -213,8 +864,13 @@ namespace eokas
             return _Ty(type)->isArrayTy();
         }
 
+        virtual bool is_type_vector(omis_handle_t type) override {
+            return _Ty(type)->isVectorTy();
+        }
+
         virtual bool is_type_struct(omis_handle_t type) override {
-            return _Ty(type)->isStructTy();
+            auto* structType = llvm::dyn_cast<llvm::StructType>(_Ty(type));
+            return structType != nullptr && !structType->isLiteral();
         }
 		
 		virtual String get_type_name(omis_handle_t type) override {
@@ -235,6 +891,10 @@ namespace eokas
 				auto eleTy = ty->getArrayElementType();
 				return String::format("Array<%s>", this->get_type_name(eleTy).cstr());
 			}
+			if(ty->isVectorTy()) {
+				auto eleTy = this->get_vector_element_type(ty);
+				return String::format("Vector<%s, %u>", this->get_type_name(eleTy).cstr(), this->get_vector_length(ty));
+			}
 			if(ty->isFunctionTy()) {
 				String str = "func(";
 				uint32_t count = this->get_func_arg_count(ty);
@@ -249,6 +909,17 @@ namespace eokas
 				str += this->get_type_name(this->get_func_ret_type(ty));
 				return str;
 			}
+			if(ty->isStructTy() && llvm::cast<llvm::StructType>(ty)->isLiteral()) {
+				String str = "{";
+				for(uint32_t i = 0; i < ty->getStructNumElements(); i++) {
+					if(i > 0) {
+						str += ", ";
+					}
+					str += this->get_type_name(ty->getStructElementType(i));
+				}
+				str += "}";
+				return str;
+			}
 			if(ty->isStructTy()) {
 				return ty->getStructName().data();
 			}
@@ -261,12 +932,52 @@ namespace eokas
             return size;
         }
 
+        virtual u64_t get_type_alloc_size(omis_handle_t type) override {
+            auto ty = _Ty(type);
+            if (!ty->isSized())
+                return 0;
+            return layout.getTypeAllocSize(ty).getFixedSize();
+        }
+
+        virtual u32_t get_type_align(omis_handle_t type) override {
+            auto ty = _Ty(type);
+            if (!ty->isSized())
+                return 1;
+            return layout.getABITypeAlignment(ty);
+        }
+
+        virtual u64_t get_struct_member_offset(omis_handle_t type, uint32_t index) override {
+            auto structType = llvm::cast<llvm::StructType>(_Ty(type));
+            return layout.getStructLayout(structType)->getElementOffset(index);
+        }
+
         virtual bool can_losslessly_cast(omis_handle_t a, omis_handle_t b) override {
             auto* aT = (llvm::Type*)a;
             auto* bT = (llvm::Type*)b;
             return aT->canLosslesslyBitCastTo(bT);
         }
 
+        virtual omis_handle_t get_pointer_element_type(omis_handle_t type) override {
+            auto ty = _Ty(type);
+            if (!ty->isPointerTy())
+                return nullptr;
+            return ty->getPointerElementType();
+        }
+
+        virtual omis_handle_t get_vector_element_type(omis_handle_t type) override {
+            auto ty = _Ty(type);
+            if (!ty->isVectorTy())
+                return nullptr;
+            return llvm::cast<llvm::FixedVectorType>(ty)->getElementType();
+        }
+
+        virtual u32_t get_vector_length(omis_handle_t type) override {
+            auto ty = _Ty(type);
+            if (!ty->isVectorTy())
+                return 0;
+            return llvm::cast<llvm::FixedVectorType>(ty)->getNumElements();
+        }
+
         virtual omis_handle_t get_func_ret_type(omis_handle_t type_func) override {
 			auto ty = _Ty(type_func);
 			if (ty->isPointerTy() && ty->getPointerElementType()->isFunctionTy()) {
@@ -299,20 +1010,11 @@ namespace eokas
         }
 
         virtual omis_handle_t get_default_value(omis_handle_t type) override {
-            auto ty = _Ty(type);
-            if (ty->isIntegerTy()) {
-                auto bits = ty->getIntegerBitWidth();
-                return llvm::ConstantInt::get(context, llvm::APInt(bits, 0));
-            }
-            if (ty->isFloatingPointTy()) {
-                return llvm::ConstantFP::get(context, llvm::APFloat(0.0f));
-            }
-            return llvm::ConstantPointerNull::get(llvm::Type::getVoidTy(context)->getPointerTo());
+            return llvm::Constant::getNullValue(_Ty(type));
         }
 
         virtual omis_handle_t value_integer(uint64_t val, uint32_t bits) override {
-            auto* type = ty_i64;
-            if(bits == 32) type = ty_i32;
+            auto* type = llvm::IntegerType::get(context, bits);
             return llvm::Constant::getIntegerValue(type, llvm::APInt(bits, val, true));
         }
 
@@ -324,10 +1026,53 @@ namespace eokas
             return llvm::Constant::getIntegerValue(ty_bool, llvm::APInt(1, val ? 1 : 0, true));
         }
 
+        virtual omis_handle_t value_vector(const std::vector<omis_handle_t>& elements) override {
+            std::vector<llvm::Constant*> values;
+            for (auto& element : elements) {
+                auto* value = llvm::dyn_cast<llvm::Constant>(_Val(element));
+                if (value == nullptr)
+                    return nullptr;
+                values.push_back(value);
+            }
+            return llvm::ConstantVector::get(values);
+        }
+
+        // Constant elements live in a read-only global, a single memcpy initializes an array from it.
+        virtual omis_handle_t value_array(omis_handle_t mod, omis_handle_t element_type, const std::vector<omis_handle_t>& elements) override {
+            auto* module = _Mod(mod);
+            std::vector<llvm::Constant*> values;
+            for (auto& element : elements) {
+                auto* value = llvm::dyn_cast<llvm::Constant>(_Val(element));
+                if (value == nullptr)
+                    return nullptr;
+                values.push_back(value);
+            }
+            auto* arrayType = llvm::ArrayType::get(_Ty(element_type), values.size());
+            // Simple element types come back as a ConstantDataArray.
+            auto* init = llvm::ConstantArray::get(arrayType, values);
+            auto* global = new llvm::GlobalVariable(*module, arrayType, true, llvm::GlobalValue::PrivateLinkage, init, "array");
+            global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+            return global;
+        }
+
+        // Constants are exported, variables are only written by the module itself.
+        virtual omis_handle_t value_global(omis_handle_t mod, const String& name, omis_handle_t type, omis_handle_t init, bool constant) override {
+            auto* module = _Mod(mod);
+            auto* ty = _Ty(type);
+            auto* value = init != nullptr ? llvm::cast<llvm::Constant>(_Val(init)) : llvm::Constant::getNullValue(ty);
+            auto linkage = constant ? llvm::GlobalValue::ExternalLinkage : llvm::GlobalValue::InternalLinkage;
+            // Prefixed by the module, a 'val malloc' must neither clash with the C runtime
+            // nor with the globals of another module, nor be taken for a builtin later.
+            auto symbol = module->getName().str() + "." + name.cstr();
+            return new llvm::GlobalVariable(*module, ty, constant, linkage, value, symbol);
+        }
+
         virtual omis_handle_t value_func(omis_handle_t mod, const String& name, omis_handle_t type) override {
             llvm::Module* module = _Mod(mod);
             llvm::FunctionType* funcType = (llvm::FunctionType*)type;
-            llvm::Function* funcPtr = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, name.cstr(), module);
+            // Anonymous functions are only reachable from this module.
+            auto linkage = name.isEmpty() ? llvm::Function::InternalLinkage : llvm::Function::ExternalLinkage;
+            llvm::Function* funcPtr = llvm::Function::Create(funcType, linkage, name.cstr(), module);
 
             llvm::AttributeList attrs;
             funcPtr->setAttributes(attrs);
@@ -336,6 +1081,123 @@ namespace eokas
             return funcPtr;
         }
 
+        virtual void set_func_fp_model(omis_handle_t func, omis_fp_model_t model) override {
+            auto* funcPtr = _Func(func);
+            llvm::FastMathFlags flags;
+            if (model == omis_fp_model_t::CONTRACT) {
+                flags.setAllowContract();
+            } else if (model == omis_fp_model_t::FAST) {
+                flags.setFast();
+                funcPtr->addFnAttr("unsafe-fp-math", "true");
+                funcPtr->addFnAttr("no-nans-fp-math", "true");
+                funcPtr->addFnAttr("no-infs-fp-math", "true");
+                funcPtr->addFnAttr("no-signed-zeros-fp-math", "true");
+            }
+            this->fp_flags[funcPtr] = flags;
+        }
+
+        virtual void set_func_memo(omis_handle_t func, uint32_t capacity, uint32_t ways) override {
+            this->memos[_Func(func)] = {capacity, ways};
+        }
+
+        virtual omis_handle_t value_builtin(omis_handle_t mod, const String& name, omis_handle_t type) override {
+            auto* module = _Mod(mod);
+            auto* ty = _Ty(type);
+            if (ty->isPointerTy())
+                ty = ty->getPointerElementType();
+            if (!ty->isFunctionTy())
+                return nullptr;
+            auto* funcType = llvm::cast<llvm::FunctionType>(ty);
+
+            // Math builtins operate on one float type: f(T, ...) -> T.
+            auto* retType = funcType->getReturnType();
+            bool isFloatFunc = retType->isFloatTy() || retType->isDoubleTy();
+            for (auto* paramType : funcType->params()) {
+                isFloatFunc = isFloatFunc && paramType == retType;
+            }
+
+            static const std::map<String, std::pair<llvm::Intrinsic::ID, uint32_t>> intrinsics = {
+                {"sqrt", {llvm::Intrinsic::sqrt, 1}},
+                {"pow", {llvm::Intrinsic::pow, 2}},
+                {"sin", {llvm::Intrinsic::sin, 1}},
+                {"cos", {llvm::Intrinsic::cos, 1}},
+                {"exp", {llvm::Intrinsic::exp, 1}},
+                {"exp2", {llvm::Intrinsic::exp2, 1}},
+                {"log", {llvm::Intrinsic::log, 1}},
+                {"log2", {llvm::Intrinsic::log2, 1}},
+                {"log10", {llvm::Intrinsic::log10, 1}},
+                {"abs", {llvm::Intrinsic::fabs, 1}},
+                {"floor", {llvm::Intrinsic::floor, 1}},
+                {"ceil", {llvm::Intrinsic::ceil, 1}},
+                {"trunc", {llvm::Intrinsic::trunc, 1}},
+                {"round", {llvm::Intrinsic::round, 1}},
+                {"min", {llvm::Intrinsic::minnum, 2}},
+                {"max", {llvm::Intrinsic::maxnum, 2}},
+                {"fma", {llvm::Intrinsic::fma, 3}},
+            };
+            auto intrinsic = intrinsics.find(name);
+            if (intrinsic != intrinsics.end()) {
+                if (!isFloatFunc || funcType->getNumParams() != intrinsic->second.second)
+                    return nullptr;
+                return llvm::Intrinsic::getDeclaration(module, intrinsic->second.first, {retType});
+            }
+
+            // No intrinsic, but libm has it. Declared without side effects so the
+            // optimizer may hoist them and map them to a vector library.
+            static const std::set<String> mathFuncs = {
+                "tan", "asin", "acos", "atan", "atan2", "sinh", "cosh", "tanh", "cbrt", "hypot",
+            };
+            if (mathFuncs.find(name) != mathFuncs.end()) {
+                if (!isFloatFunc)
+                    return nullptr;
+                String symbol = retType->isFloatTy() ? name + "f" : name;
+                return this->declare_math_func(module, symbol, funcType);
+            }
+
+            // cot(x) = 1 / tan(x)
+            if (name == "cot") {
+                if (!isFloatFunc || funcType->getNumParams() != 1)
+                    return nullptr;
+                String symbol = retType->isFloatTy() ? "tanf" : "tan";
+                auto* tan = this->declare_math_func(module, symbol, funcType);
+                auto* cot = llvm::Function::Create(funcType, llvm::Function::InternalLinkage, "cot", module);
+                cot->addFnAttr(llvm::Attribute::ReadNone);
+                cot->addFnAttr(llvm::Attribute::NoUnwind);
+                cot->addFnAttr(llvm::Attribute::WillReturn);
+                cot->addFnAttr(llvm::Attribute::InlineHint);
+
+                llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", cot));
+                auto* val = builder.CreateCall(tan, {cot->getArg(0)});
+                builder.CreateRet(builder.CreateFDiv(llvm::ConstantFP::get(retType, 1.0), val));
+                return cot;
+            }
+
+            // Anything else is provided by the C runtime under the same name, C does not unwind.
+            // Only the known functions with their C signatures, a call through any other type is undefined.
+            auto cFunc = c_builtins.find(name);
+            if (cFunc == c_builtins.end() || cFunc->second != funcType)
+                return nullptr;
+            auto callee = module->getOrInsertFunction(name.cstr(), funcType);
+            auto* func = llvm::dyn_cast<llvm::Function>(callee.getCallee());
+            if (func != nullptr) {
+                func->addFnAttr(llvm::Attribute::NoUnwind);
+                // The allocators hand out memory nothing else points to.
+                static const std::set<String> allocFuncs = {"malloc", "aligned_alloc", "eokas_alloc", "eokas_gc_alloc", "eokas_gc_alloc_aligned"};
+                if (allocFuncs.find(name) != allocFuncs.end())
+                    func->addRetAttr(llvm::Attribute::NoAlias);
+            }
+            return callee.getCallee();
+        }
+
+        llvm::Function* declare_math_func(llvm::Module* module, const String& name, llvm::FunctionType* type) {
+            auto callee = module->getOrInsertFunction(name.cstr(), type);
+            auto* func = llvm::cast<llvm::Function>(callee.getCallee());
+            func->addFnAttr(llvm::Attribute::ReadNone);
+            func->addFnAttr(llvm::Attribute::NoUnwind);
+            func->addFnAttr(llvm::Attribute::WillReturn);
+            return func;
+        }
+
         // virtual omis_handle_t create_array(omis_handle_t element_type) = 0;
 
         virtual omis_handle_t get_value_type(omis_handle_t value) override {
@@ -346,6 +1208,39 @@ namespace eokas
             return _Val(value)->setName(name.cstr());
         }
 
+        virtual bool is_value_func(omis_handle_t value) override {
+            auto type = _Val(value)->getType();
+            if (type->isPointerTy())
+                type = type->getPointerElementType();
+            return type->isFunctionTy();
+        }
+
+        virtual bool is_value_const(omis_handle_t value) override {
+            return llvm::isa<llvm::Constant>(_Val(value));
+        }
+
+        virtual bool is_value_const_int(omis_handle_t value) override {
+            return llvm::isa<llvm::ConstantInt>(_Val(value));
+        }
+
+        virtual bool is_value_const_float(omis_handle_t value) override {
+            return llvm::isa<llvm::ConstantFP>(_Val(value));
+        }
+
+        virtual int64_t get_value_const_int(omis_handle_t value) override {
+            auto* val = llvm::cast<llvm::ConstantInt>(_Val(value));
+            if (val->getBitWidth() == 1)
+                return (int64_t) val->getZExtValue();
+            return val->getSExtValue();
+        }
+
+        virtual double get_value_const_float(omis_handle_t value) override {
+            auto* val = llvm::cast<llvm::ConstantFP>(_Val(value));
+            if (val->getType()->isFloatTy())
+                return val->getValueAPF().convertToFloat();
+            return val->getValueAPF().convertToDouble();
+        }
+
         virtual omis_handle_t create_block(omis_handle_t func, const String& name) override {
             return llvm::BasicBlock::Create(context, name.cstr(), _Func(func));
         }
@@ -357,6 +1252,9 @@ namespace eokas
 
         virtual void set_active_block(omis_handle_t block) override {
             IR.SetInsertPoint(_Block(block));
+            // The builder puts its flags on every float operation it creates.
+            auto iter = this->fp_flags.find(_Block(block)->getParent());
+            IR.setFastMathFlags(iter != this->fp_flags.end() ? iter->second : llvm::FastMathFlags());
         }
 
         virtual omis_handle_t get_block_tail(omis_handle_t block) override {
@@ -385,9 +1283,272 @@ namespace eokas
             return IR.CreateGEP(_Ty(type), _Val(ptr), _Val(index));
         }
 
+        virtual omis_handle_t gep_struct(omis_handle_t type, omis_handle_t ptr, uint32_t index) override {
+            return IR.CreateStructGEP(_Ty(type), _Val(ptr), index);
+        }
+
+        virtual omis_handle_t gep_array(omis_handle_t type, omis_handle_t ptr, omis_handle_t index) override {
+            auto* zero = llvm::ConstantInt::get(ty_i64, 0);
+            return IR.CreateInBoundsGEP(_Ty(type), _Val(ptr), {zero, _Val(index)});
+        }
+
+        virtual omis_handle_t copy(omis_handle_t dst, omis_handle_t src, omis_handle_t size) override {
+            return IR.CreateMemCpy(_Val(dst), llvm::MaybeAlign(), _Val(src), llvm::MaybeAlign(), _Val(size));
+        }
+
+        // Continues in a new block if 0 <= index < length, the failure path is cold and never returns.
+        virtual omis_handle_t check_bounds(omis_handle_t mod, omis_handle_t index, omis_handle_t length) override {
+            auto* module = _Mod(mod);
+            auto* failType = llvm::FunctionType::get(ty_void, {ty_i64, ty_i64}, false);
+            auto* fail = llvm::cast<llvm::Function>(module->getOrInsertFunction("eokas_bounds_error", failType).getCallee());
+            fail->addFnAttr(llvm::Attribute::NoReturn);
+            fail->addFnAttr(llvm::Attribute::Cold);
+            fail->addFnAttr(llvm::Attribute::NoUnwind);
+
+            auto* index64 = IR.CreateSExtOrTrunc(_Val(index), ty_i64);
+            auto* length64 = IR.CreateZExtOrTrunc(_Val(length), ty_i64);
+            auto* inBounds = IR.CreateICmpULT(index64, length64);
+
+            auto* func = IR.GetInsertBlock()->getParent();
+            auto* okBlock = llvm::BasicBlock::Create(context, "bounds.ok", func);
+            auto* failBlock = llvm::BasicBlock::Create(context, "bounds.fail", func);
+            llvm::MDBuilder weights(context);
+            IR.CreateCondBr(inBounds, okBlock, failBlock, weights.createBranchWeights(1 << 20, 1));
+
+            IR.SetInsertPoint(failBlock);
+            IR.CreateCall(fail, {index64, length64});
+            IR.CreateUnreachable();
+
+            IR.SetInsertPoint(okBlock);
+            return inBounds;
+        }
+
+        // Continues in a new block if 0 <= begin <= end <= length, like check_bounds.
+        virtual omis_handle_t check_range(omis_handle_t mod, omis_handle_t begin, omis_handle_t end, omis_handle_t length) override {
+            auto* module = _Mod(mod);
+            auto* failType = llvm::FunctionType::get(ty_void, {ty_i64, ty_i64, ty_i64}, false);
+            auto* fail = llvm::cast<llvm::Function>(module->getOrInsertFunction("eokas_range_error", failType).getCallee());
+            fail->addFnAttr(llvm::Attribute::NoReturn);
+            fail->addFnAttr(llvm::Attribute::Cold);
+            fail->addFnAttr(llvm::Attribute::NoUnwind);
+
+            auto* begin64 = IR.CreateSExtOrTrunc(_Val(begin), ty_i64);
+            auto* end64 = IR.CreateSExtOrTrunc(_Val(end), ty_i64);
+            auto* length64 = IR.CreateZExtOrTrunc(_Val(length), ty_i64);
+            // Unsigned, a negative bound is larger than any length.
+            auto* inRange = IR.CreateAnd(IR.CreateICmpULE(end64, length64), IR.CreateICmpULE(begin64, end64));
+
+            auto* func = IR.GetInsertBlock()->getParent();
+            auto* okBlock = llvm::BasicBlock::Create(context, "range.ok", func);
+            auto* failBlock = llvm::BasicBlock::Create(context, "range.fail", func);
+            llvm::MDBuilder weights(context);
+            IR.CreateCondBr(inRange, okBlock, failBlock, weights.createBranchWeights(1 << 20, 1));
+
+            IR.SetInsertPoint(failBlock);
+            IR.CreateCall(fail, {begin64, end64, length64});
+            IR.CreateUnreachable();
+
+            IR.SetInsertPoint(okBlock);
+            return inRange;
+        }
+
+        virtual omis_handle_t extract_value(omis_handle_t agg, uint32_t index) override {
+            return IR.CreateExtractValue(_Val(agg), {index});
+        }
+
+        virtual omis_handle_t insert_value(omis_handle_t agg, omis_handle_t val, uint32_t index) override {
+            return IR.CreateInsertValue(_Val(agg), _Val(val), {index});
+        }
+
+        virtual omis_handle_t extract_element(omis_handle_t vec, omis_handle_t index) override {
+            return IR.CreateExtractElement(_Val(vec), _Val(index));
+        }
+
+        virtual omis_handle_t insert_element(omis_handle_t vec, omis_handle_t val, omis_handle_t index) override {
+            return IR.CreateInsertElement(_Val(vec), _Val(val), _Val(index));
+        }
+
+        virtual omis_handle_t splat(omis_handle_t value, u32_t count) override {
+            return IR.CreateVectorSplat(count, _Val(value));
+        }
+
+        virtual omis_handle_t shuffle(omis_handle_t a, omis_handle_t b, const std::vector<int>& mask) override {
+            return IR.CreateShuffleVector(_Val(a), _Val(b), mask);
+        }
+
+        // Float sums and products are reduced in lane order, like the scalar code would,
+        // unless the float model of the function allows reordering them.
+        virtual omis_handle_t reduce(omis_reduce_op_t op, omis_handle_t vec) override {
+            auto* value = _Val(vec);
+            auto* itemType = llvm::cast<llvm::VectorType>(value->getType())->getElementType();
+            if (itemType->isFloatingPointTy()) {
+                switch (op) {
+                    case omis_reduce_op_t::ADD: return IR.CreateFAddReduce(llvm::ConstantFP::getNegativeZero(itemType), value);
+                    case omis_reduce_op_t::MUL: return IR.CreateFMulReduce(llvm::ConstantFP::get(itemType, 1.0), value);
+                    case omis_reduce_op_t::MIN: return IR.CreateFPMinReduce(value);
+                    case omis_reduce_op_t::MAX: return IR.CreateFPMaxReduce(value);
+                    default: break;
+                }
+            } else if (itemType->isIntegerTy()) {
+                switch (op) {
+                    case omis_reduce_op_t::ADD: return IR.CreateAddReduce(value);
+                    case omis_reduce_op_t::MUL: return IR.CreateMulReduce(value);
+                    case omis_reduce_op_t::MIN: return IR.CreateIntMinReduce(value, true);
+                    case omis_reduce_op_t::MAX: return IR.CreateIntMaxReduce(value, true);
+                    case omis_reduce_op_t::AND: return IR.CreateAndReduce(value);
+                    case omis_reduce_op_t::OR: return IR.CreateOrReduce(value);
+                }
+            }
+
+            printf("Type of the vector is invalid.\n");
+            return nullptr;
+        }
+
+        // Where the references are in an object, arrays and nested structs included.
+        void collect_gc_refs(llvm::Type* type, uint64_t base, std::vector<llvm::Constant*>& offsets) {
+            if (type->isPointerTy()) {
+                // Any data pointer, the items of a slice are not objects but keep the array they are in alive.
+                if (!type->getPointerElementType()->isFunctionTy())
+                    offsets.push_back(llvm::ConstantInt::get(ty_i64, base));
+            } else if (auto* structType = llvm::dyn_cast<llvm::StructType>(type)) {
+                auto* structLayout = layout.getStructLayout(structType);
+                for (uint32_t index = 0; index < structType->getNumElements(); index++) {
+                    this->collect_gc_refs(structType->getElementType(index), base + structLayout->getElementOffset(index), offsets);
+                }
+            } else if (auto* arrayType = llvm::dyn_cast<llvm::ArrayType>(type)) {
+                auto stride = layout.getTypeAllocSize(arrayType->getElementType());
+                for (uint64_t index = 0; index < arrayType->getNumElements(); index++) {
+                    this->collect_gc_refs(arrayType->getElementType(), base + index * stride, offsets);
+                }
+            }
+        }
+
+        virtual omis_handle_t gc_root(omis_handle_t type, const String& name) override {
+            auto* func = IR.GetInsertBlock()->getParent();
+            func->setGC("shadow-stack");
+
+            // Roots are declared in the entry block and start out null, the
+            // collector may run before the slot is first stored to.
+            auto& entry = func->getEntryBlock();
+            llvm::IRBuilder<> builder(&entry, entry.getFirstInsertionPt());
+            auto* slot = builder.CreateAlloca(_Ty(type), nullptr, name.cstr());
+            auto* gcroot = llvm::Intrinsic::getDeclaration(func->getParent(), llvm::Intrinsic::gcroot);
+            builder.CreateCall(gcroot, {builder.CreateBitCast(slot, ty_bytes->getPointerTo()), llvm::ConstantPointerNull::get(llvm::Type::getInt8PtrTy(context))});
+            builder.CreateStore(llvm::Constant::getNullValue(_Ty(type)), slot);
+            return slot;
+        }
+
+        virtual omis_handle_t gc_type_descriptor(omis_handle_t mod, omis_handle_t type) override {
+            auto* module = _Mod(mod);
+            auto* objectType = _Ty(type);
+            std::string name = "eokas.gc.";
+            if (auto* structType = llvm::dyn_cast<llvm::StructType>(objectType)) {
+                name += structType->getName().str();
+            } else {
+                llvm::raw_string_ostream stream(name);
+                objectType->print(stream);
+                stream.flush();
+            }
+            auto* desc = module->getGlobalVariable(name, true);
+
+            if (desc == nullptr) {
+                // Matches eokas_gc_type_t: size, ref_count, ref_offsets.
+                std::vector<llvm::Constant*> offsets;
+                this->collect_gc_refs(objectType, 0, offsets);
+                auto* offsetsType = llvm::ArrayType::get(ty_i64, offsets.size());
+                auto* refs = new llvm::GlobalVariable(*module, offsetsType, true, llvm::GlobalValue::PrivateLinkage,
+                                                      llvm::ConstantArray::get(offsetsType, offsets), name + ".refs");
+
+                auto* descType = llvm::StructType::get(ty_i64, ty_i64, ty_i64->getPointerTo());
+                auto* descValue = llvm::ConstantStruct::get(descType, {
+                    llvm::ConstantInt::get(ty_i64, layout.getTypeAllocSize(objectType)),
+                    llvm::ConstantInt::get(ty_i64, offsets.size()),
+                    llvm::ConstantExpr::getPointerCast(refs, ty_i64->getPointerTo())
+                });
+                desc = new llvm::GlobalVariable(*module, descType, true, llvm::GlobalValue::PrivateLinkage, descValue, name);
+            }
+
+            return llvm::ConstantExpr::getPointerCast(desc, ty_bytes);
+        }
+
+        /**
+         * A std::type_info of the Itanium C++ ABI: a __class_type_info for a struct without base,
+         * a __si_class_type_info pointing at the type_info of the base otherwise.
+         * The vtables come from the C++ runtime, the personality routine walks the bases with them.
+         * Every module referring to the struct emits the same symbol and name string, both carry the
+         * module declaring it, so structs of the same name in different modules stay different types.
+         * */
+        virtual omis_handle_t type_info(omis_handle_t mod, const String& owner, omis_handle_t type, omis_handle_t base) override {
+            auto* module = _Mod(mod);
+            auto name = std::string(owner.cstr()) + "." + llvm::cast<llvm::StructType>(_Ty(type))->getName().str();
+            auto* info = module->getGlobalVariable("eokas.typeinfo." + name, true);
+
+            if (info == nullptr) {
+                auto* vtableName = base != nullptr ? "_ZTVN10__cxxabiv120__si_class_type_infoE" : "_ZTVN10__cxxabiv117__class_type_infoE";
+                auto* vtable = module->getOrInsertGlobal(vtableName, ty_bytes);
+                // The vtable pointer skips the offset-to-top and the type_info of the vtable.
+                std::vector<llvm::Constant*> fields = {
+                    llvm::ConstantExpr::getPointerCast(llvm::ConstantExpr::getInBoundsGetElementPtr(ty_bytes, vtable, llvm::ConstantInt::get(ty_i32, 2)), ty_bytes),
+                    llvm::ConstantExpr::getPointerCast(IR.CreateGlobalString("eokas." + name, "eokas.typename." + name, 0, module), ty_bytes)
+                };
+                if (base != nullptr)
+                    fields.push_back(llvm::cast<llvm::Constant>(_Val(base)));
+
+                auto* infoValue = llvm::ConstantStruct::getAnon(context, fields);
+                info = new llvm::GlobalVariable(*module, infoValue->getType(), true, llvm::GlobalValue::LinkOnceODRLinkage, infoValue, "eokas.typeinfo." + name);
+            }
+
+            return llvm::ConstantExpr::getPointerCast(info, ty_bytes);
+        }
+
+        /**
+         * The closure of a function capturing nothing, a constant record whose code
+         * skips the environment and calls the function. Null if the function does not
+         * take and return what the closure type does.
+         * */
+        virtual omis_handle_t closure_of(omis_handle_t mod, omis_handle_t type, omis_handle_t func) override {
+            auto* module = _Mod(mod);
+            auto* closureType = llvm::cast<llvm::StructType>(_Ty(type));
+            auto* codeType = llvm::cast<llvm::FunctionType>(closureType->getElementType(0)->getPointerElementType());
+            auto* target = llvm::dyn_cast<llvm::Function>(_Val(func));
+            if (target == nullptr)
+                return nullptr;
+
+            auto* targetType = target->getFunctionType();
+            if (targetType->getReturnType() != codeType->getReturnType() || targetType->getNumParams() + 1 != codeType->getNumParams())
+                return nullptr;
+            for (uint32_t index = 0; index < targetType->getNumParams(); index++) {
+                if (targetType->getParamType(index) != codeType->getParamType(index + 1))
+                    return nullptr;
+            }
+
+            auto iter = this->static_closures.find(target);
+            if (iter != this->static_closures.end())
+                return iter->second;
+
+            auto* code = llvm::Function::Create(codeType, llvm::Function::InternalLinkage, target->getName() + ".closure", module);
+            llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", code));
+            std::vector<llvm::Value*> args;
+            for (uint32_t index = 1; index < code->arg_size(); index++) {
+                args.push_back(code->getArg(index));
+            }
+            auto* call = builder.CreateCall(target, args);
+            call->setCallingConv(target->getCallingConv());
+            call->setTailCall();
+            if (call->getType()->isVoidTy())
+                builder.CreateRetVoid();
+            else
+                builder.CreateRet(call);
+
+            auto* closure = new llvm::GlobalVariable(*module, closureType, true, llvm::GlobalValue::PrivateLinkage,
+                                                     llvm::ConstantStruct::get(closureType, {code}), target->getName() + ".env");
+            this->static_closures[target] = closure;
+            return closure;
+        }
+
         virtual omis_handle_t neg(omis_handle_t a) override {
             auto rhs = _Val(a);
-            auto rtype = rhs->getType();
+            auto rtype = rhs->getType()->getScalarType();
 
             if (rtype->isIntegerTy())
                 return IR.CreateNeg(rhs);
@@ -399,45 +1560,99 @@ namespace eokas
             return nullptr;
         }
 
+        // Mixed f32/f64 operands are computed in f64.
+        void unify_float(llvm::Value*& lhs, llvm::Value*& rhs) {
+            if (lhs->getType() == rhs->getType())
+                return;
+            if (lhs->getType()->isFloatTy())
+                lhs = IR.CreateFPExt(lhs, rhs->getType());
+            else
+                rhs = IR.CreateFPExt(rhs, lhs->getType());
+        }
+
+        void unify_int(llvm::Value*& lhs, llvm::Value*& rhs) {
+            auto lbits = lhs->getType()->getScalarSizeInBits();
+            auto rbits = rhs->getType()->getScalarSizeInBits();
+            if (lbits == rbits)
+                return;
+            if (lbits < rbits)
+                lhs = IR.CreateSExt(lhs, rhs->getType());
+            else
+                rhs = IR.CreateSExt(rhs, lhs->getType());
+        }
+
+        // A scalar operand of a vector operation is converted to the item type and
+        // repeated in every lane. Returns false if the operands can not be combined.
+        bool unify_vector(llvm::Value*& lhs, llvm::Value*& rhs) {
+            auto* ltype = lhs->getType();
+            auto* rtype = rhs->getType();
+            if (!ltype->isVectorTy() && !rtype->isVectorTy())
+                return true;
+            if (ltype->isVectorTy() && rtype->isVectorTy())
+                return ltype == rtype;
+
+            auto*& scalar = ltype->isVectorTy() ? rhs : lhs;
+            auto* vectorType = llvm::cast<llvm::FixedVectorType>(ltype->isVectorTy() ? ltype : rtype);
+            auto* itemType = vectorType->getElementType();
+            auto* scalarType = scalar->getType();
+            if (itemType->isIntegerTy() && scalarType->isIntegerTy())
+                scalar = IR.CreateSExtOrTrunc(scalar, itemType);
+            else if (itemType->isFloatingPointTy() && scalarType->isFloatingPointTy())
+                scalar = IR.CreateFPCast(scalar, itemType);
+            else if (itemType->isFloatingPointTy() && scalarType->isIntegerTy())
+                scalar = IR.CreateSIToFP(scalar, itemType);
+            else
+                return false;
+            scalar = IR.CreateVectorSplat(vectorType->getNumElements(), scalar);
+            return true;
+        }
+
         enum class ArithOp {ADD, SUB, MUL, DIV, MOD};
         omis_handle_t arith(ArithOp op, omis_handle_t a, omis_handle_t b) {
             using ins_type_t = std::function<llvm::Value *(llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS)>;
-            using func_type_t = llvm::Value *(llvm::IRBuilder<>::*)(llvm::Value *LHS, llvm::Value *RHS);
 
             static std::map<ArithOp, ins_type_t> ins_i = {
-                {ArithOp::ADD, (func_type_t) &llvm::IRBuilder<>::CreateAdd},
-                {ArithOp::SUB, (func_type_t) &llvm::IRBuilder<>::CreateSub},
-                {ArithOp::MUL, (func_type_t) &llvm::IRBuilder<>::CreateMul},
-                {ArithOp::DIV, (func_type_t) &llvm::IRBuilder<>::CreateSDiv},
-                {ArithOp::MOD, (func_type_t) &llvm::IRBuilder<>::CreateSRem},
+                {ArithOp::ADD, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateAdd(LHS, RHS); }},
+                {ArithOp::SUB, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateSub(LHS, RHS); }},
+                {ArithOp::MUL, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateMul(LHS, RHS); }},
+                {ArithOp::DIV, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateSDiv(LHS, RHS); }},
+                {ArithOp::MOD, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateSRem(LHS, RHS); }},
             };
 
             static std::map<ArithOp, ins_type_t> ins_f = {
-                {ArithOp::ADD, (func_type_t) &llvm::IRBuilder<>::CreateFAdd},
-                {ArithOp::SUB, (func_type_t) &llvm::IRBuilder<>::CreateFSub},
-                {ArithOp::MUL, (func_type_t) &llvm::IRBuilder<>::CreateFMul},
-                {ArithOp::DIV, (func_type_t) &llvm::IRBuilder<>::CreateFDiv},
-                {ArithOp::MOD, (func_type_t) &llvm::IRBuilder<>::CreateFRem},
+                {ArithOp::ADD, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateFAdd(LHS, RHS); }},
+                {ArithOp::SUB, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateFSub(LHS, RHS); }},
+                {ArithOp::MUL, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateFMul(LHS, RHS); }},
+                {ArithOp::DIV, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateFDiv(LHS, RHS); }},
+                {ArithOp::MOD, [](llvm::IRBuilder<> &IR, llvm::Value *LHS, llvm::Value *RHS) { return IR.CreateFRem(LHS, RHS); }},
             };
 
             auto lhs = _Val(a);
             auto rhs = _Val(b);
-            auto ltype = lhs->getType();
-            auto rtype = rhs->getType();
+            if (!this->unify_vector(lhs, rhs)) {
+                printf("Type of LHS or RHS is invalid.\n");
+                return nullptr;
+            }
+            auto ltype = lhs->getType()->getScalarType();
+            auto rtype = rhs->getType()->getScalarType();
 
-            if (ltype->isIntegerTy() && rtype->isIntegerTy())
+            if (ltype->isIntegerTy() && rtype->isIntegerTy()) {
+                this->unify_int(lhs, rhs);
                 return ins_i[op](IR, lhs, rhs);
+            }
 
-            if (ltype->isFloatingPointTy() && rtype->isFloatingPointTy())
+            if (ltype->isFloatingPointTy() && rtype->isFloatingPointTy()) {
+                this->unify_float(lhs, rhs);
                 return ins_f[op](IR, lhs, rhs);
+            }
 
             if (ltype->isIntegerTy() && rtype->isFloatingPointTy()) {
-                lhs = IR.CreateSIToFP(lhs, llvm::Type::getDoubleTy(context));
+                lhs = IR.CreateSIToFP(lhs, rtype);
                 return ins_f[op](IR, lhs, rhs);
             }
 
             if (ltype->isFloatingPointTy() && rtype->isIntegerTy()) {
-                rhs = IR.CreateSIToFP(rhs, llvm::Type::getDoubleTy(context));
+                rhs = IR.CreateSIToFP(rhs, ltype);
                 return ins_f[op](IR, lhs, rhs);
             }
 
@@ -449,6 +1664,14 @@ namespace eokas
             return this->arith(ArithOp::ADD, a, b);
         }
 
+        // An integer add the optimizer may assume does not overflow.
+        virtual omis_handle_t add_nsw(omis_handle_t a, omis_handle_t b) override {
+            auto lhs = _Val(a);
+            auto rhs = _Val(b);
+            this->unify_int(lhs, rhs);
+            return IR.CreateNSWAdd(lhs, rhs);
+        }
+
         virtual omis_handle_t sub(omis_handle_t a, omis_handle_t b) override {
             return this->arith(ArithOp::SUB, a, b);
         }
@@ -487,11 +1710,18 @@ namespace eokas
 
             auto lhs = _Val(a);
             auto rhs = _Val(b);
-            auto ltype = lhs->getType();
-            auto rtype = rhs->getType();
+            if (!this->unify_vector(lhs, rhs)) {
+                printf("Type of LHS or RHS is invalid.\n");
+                return nullptr;
+            }
+            // Vectors are compared lane by lane, into a vector of bools.
+            auto ltype = lhs->getType()->getScalarType();
+            auto rtype = rhs->getType()->getScalarType();
 
-            if (ltype->isIntegerTy() && rtype->isIntegerTy())
+            if (ltype->isIntegerTy() && rtype->isIntegerTy()) {
+                this->unify_int(lhs, rhs);
                 return IR.CreateCmp(op_i[op], lhs, rhs, "", nullptr);
+            }
 
             if (ltype->isPointerTy() && rtype->isPointerTy()) {
                 lhs = IR.CreatePtrToInt(lhs, llvm::Type::getInt64Ty(context));
@@ -499,16 +1729,18 @@ namespace eokas
                 return IR.CreateCmp(op_i[op], lhs, rhs, "", nullptr);
             }
 
-            if (ltype->isFloatingPointTy() && rtype->isFloatingPointTy())
+            if (ltype->isFloatingPointTy() && rtype->isFloatingPointTy()) {
+                this->unify_float(lhs, rhs);
                 return IR.CreateCmp(op_f[op], lhs, rhs, "", nullptr);
+            }
 
             if (ltype->isIntegerTy() && rtype->isFloatingPointTy()) {
-                lhs = IR.CreateSIToFP(lhs, llvm::Type::getDoubleTy(context));
+                lhs = IR.CreateSIToFP(lhs, rtype);
                 return IR.CreateCmp(op_f[op], lhs, rhs, "", nullptr);
             }
 
             if (ltype->isFloatingPointTy() && rtype->isIntegerTy()) {
-                rhs = IR.CreateSIToFP(rhs, llvm::Type::getDoubleTy(context));
+                rhs = IR.CreateSIToFP(rhs, ltype);
                 return IR.CreateCmp(op_f[op], lhs, rhs, "", nullptr);
             }
 
@@ -542,9 +1774,9 @@ namespace eokas
 
         virtual omis_handle_t l_not(omis_handle_t a) override {
             auto rhs = _Val(a);
-            auto rtype = rhs->getType();
+            auto rtype = rhs->getType()->getScalarType();
 
-            if (rtype->isIntegerTy() && rtype->getIntegerBitWidth() == 1)
+            if (rtype->isIntegerTy(1))
                 return IR.CreateNot(rhs);
 
             printf("Type of RHS is invalid.\n");
@@ -581,12 +1813,10 @@ namespace eokas
 
         virtual omis_handle_t b_flip(omis_handle_t a) override {
             auto rhs _Val(a);
-            auto rtype = rhs->getType();
+            auto rtype = rhs->getType()->getScalarType();
 
             if (rtype->isIntegerTy()) {
-                auto bits = rtype->getIntegerBitWidth();
-                auto mask = llvm::ConstantInt::get(rtype, llvm::APInt(bits, 0xFFFFFFFF));
-                return IR.CreateXor(rhs, mask);
+                return IR.CreateNot(rhs);
             }
 
             printf("Type of RHS is invalid.\n");
@@ -596,8 +1826,12 @@ namespace eokas
         virtual omis_handle_t b_and(omis_handle_t a, omis_handle_t b) override {
             auto lhs = _Val(a);
             auto rhs = _Val(b);
-            auto ltype = lhs->getType();
-            auto rtype = rhs->getType();
+            if (!this->unify_vector(lhs, rhs)) {
+                printf("Type of LHS or RHS is invalid.\n");
+                return nullptr;
+            }
+            auto ltype = lhs->getType()->getScalarType();
+            auto rtype = rhs->getType()->getScalarType();
 
             if (ltype->isIntegerTy() && rtype->isIntegerTy()) {
                 return IR.CreateAnd(lhs, rhs);
@@ -610,8 +1844,12 @@ namespace eokas
         virtual omis_handle_t b_or(omis_handle_t a, omis_handle_t b) override {
             auto lhs = _Val(a);
             auto rhs = _Val(b);
-            auto ltype = lhs->getType();
-            auto rtype = rhs->getType();
+            if (!this->unify_vector(lhs, rhs)) {
+                printf("Type of LHS or RHS is invalid.\n");
+                return nullptr;
+            }
+            auto ltype = lhs->getType()->getScalarType();
+            auto rtype = rhs->getType()->getScalarType();
 
             if (ltype->isIntegerTy() && rtype->isIntegerTy()) {
                 return IR.CreateOr(lhs, rhs);
@@ -624,8 +1862,12 @@ namespace eokas
         virtual omis_handle_t b_xor(omis_handle_t a, omis_handle_t b) override {
             auto lhs = _Val(a);
             auto rhs = _Val(b);
-            auto ltype = lhs->getType();
-            auto rtype = rhs->getType();
+            if (!this->unify_vector(lhs, rhs)) {
+                printf("Type of LHS or RHS is invalid.\n");
+                return nullptr;
+            }
+            auto ltype = lhs->getType()->getScalarType();
+            auto rtype = rhs->getType()->getScalarType();
 
             if (ltype->isIntegerTy() && rtype->isIntegerTy()) {
                 return IR.CreateXor(lhs, rhs);
@@ -638,8 +1880,12 @@ namespace eokas
         virtual omis_handle_t b_shl(omis_handle_t a, omis_handle_t b) override {
             auto lhs = _Val(a);
             auto rhs = _Val(b);
-            auto ltype = lhs->getType();
-            auto rtype = rhs->getType();
+            if (!this->unify_vector(lhs, rhs)) {
+                printf("Type of LHS or RHS is invalid.\n");
+                return nullptr;
+            }
+            auto ltype = lhs->getType()->getScalarType();
+            auto rtype = rhs->getType()->getScalarType();
 
             if (ltype->isIntegerTy() && rtype->isIntegerTy()) {
                 return IR.CreateShl(lhs, rhs);
@@ -652,8 +1898,12 @@ namespace eokas
         virtual omis_handle_t b_shr(omis_handle_t a, omis_handle_t b) override {
             auto lhs = _Val(a);
             auto rhs = _Val(b);
-            auto ltype = lhs->getType();
-            auto rtype = rhs->getType();
+            if (!this->unify_vector(lhs, rhs)) {
+                printf("Type of LHS or RHS is invalid.\n");
+                return nullptr;
+            }
+            auto ltype = lhs->getType()->getScalarType();
+            auto rtype = rhs->getType()->getScalarType();
 
             if (ltype->isIntegerTy() && rtype->isIntegerTy()) {
                 // CreateLShr: 逻辑右移：在左边补 0
@@ -674,11 +1924,138 @@ namespace eokas
             return IR.CreateCondBr(_Val(cond), _Block(branch_true), _Block(branch_false));
         }
 
+        // The backend picks a jump table for dense values and a binary search for sparse ones.
+        virtual omis_handle_t jump_switch(omis_handle_t value, omis_handle_t other, const std::vector<std::pair<omis_handle_t, omis_handle_t>>& cases) override {
+            auto* ins = IR.CreateSwitch(_Val(value), _Block(other), cases.size());
+            for (auto& pair : cases) {
+                ins->addCase(llvm::cast<llvm::ConstantInt>(_Val(pair.first)), _Block(pair.second));
+            }
+            return ins;
+        }
+
+        virtual void set_unwind_dest(omis_handle_t func, omis_handle_t landing) override {
+            auto* funcPtr = llvm::cast<llvm::Function>(_Val(func));
+            if (landing == nullptr)
+                this->unwind_dests.erase(funcPtr);
+            else
+                this->unwind_dests[funcPtr] = _Block(landing);
+        }
+
+        // The exception and its type id, the personality stops here only for one of the types in 'infos'.
+        virtual omis_handle_t landing_pad(omis_handle_t mod, const std::vector<omis_handle_t>& infos) override {
+            auto* module = _Mod(mod);
+            auto* func = IR.GetInsertBlock()->getParent();
+            if (!func->hasPersonalityFn()) {
+                auto* personalityType = llvm::FunctionType::get(ty_i32, true);
+                auto personality = module->getOrInsertFunction("__gxx_personality_v0", personalityType);
+                func->setPersonalityFn(llvm::cast<llvm::Constant>(personality.getCallee()));
+            }
+
+            auto* pad = IR.CreateLandingPad(llvm::StructType::get(ty_bytes, ty_i32), infos.size());
+            for (auto& info : infos) {
+                pad->addClause(llvm::cast<llvm::Constant>(_Val(info)));
+            }
+            return pad;
+        }
+
+        virtual omis_handle_t catch_matches(omis_handle_t mod, omis_handle_t exception, omis_handle_t info) override {
+            auto* typeidFor = llvm::Intrinsic::getDeclaration(_Mod(mod), llvm::Intrinsic::eh_typeid_for);
+            auto* selector = IR.CreateExtractValue(_Val(exception), 1);
+            return IR.CreateICmpEQ(selector, IR.CreateCall(typeidFor, {_Val(info)}));
+        }
+
+        virtual omis_handle_t catch_object(omis_handle_t mod, omis_handle_t exception) override {
+            auto* catchType = llvm::FunctionType::get(ty_bytes, {ty_bytes}, false);
+            auto catchFunc = _Mod(mod)->getOrInsertFunction("eokas_catch", catchType);
+            llvm::cast<llvm::Function>(catchFunc.getCallee())->addFnAttr(llvm::Attribute::NoUnwind);
+            return IR.CreateCall(catchFunc, {IR.CreateExtractValue(_Val(exception), 0)});
+        }
+
+        virtual omis_handle_t resume(omis_handle_t exception) override {
+            return IR.CreateResume(_Val(exception));
+        }
+
+        virtual omis_handle_t throw_value(omis_handle_t mod, omis_handle_t object, omis_handle_t info) override {
+            auto* throwType = llvm::FunctionType::get(ty_void, {ty_bytes, ty_bytes}, false);
+            auto throwFunc = _Mod(mod)->getOrInsertFunction("eokas_throw", throwType);
+            llvm::cast<llvm::Function>(throwFunc.getCallee())->addFnAttr(llvm::Attribute::NoReturn);
+            this->call(throwFunc.getCallee(), {object, info});
+            return IR.CreateUnreachable();
+        }
+
+        // Attaches the hints to the back edge as 'llvm.loop' metadata.
+        virtual void set_loop_hints(omis_handle_t header, omis_handle_t back_edge, const omis_loop_hints_t& hints) override {
+            std::vector<llvm::Metadata*> ops;
+            auto hint = [&](const char* name, llvm::Metadata* value = nullptr) {
+                std::vector<llvm::Metadata*> hint_ops = {llvm::MDString::get(context, name)};
+                if (value != nullptr)
+                    hint_ops.push_back(value);
+                ops.push_back(llvm::MDNode::get(context, hint_ops));
+            };
+            auto count = [&](u32_t value) {
+                return llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(ty_i32, value));
+            };
+            auto flag = [&](bool value) {
+                return llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(ty_bool, value));
+            };
+
+            if (hints.unroll_full)
+                hint("llvm.loop.unroll.full");
+            else if (hints.unroll == 1)
+                hint("llvm.loop.unroll.disable");
+            else if (hints.unroll > 1)
+                hint("llvm.loop.unroll.count", count(hints.unroll));
+            if (hints.vectorize_enable)
+                hint("llvm.loop.vectorize.enable", flag(true));
+            if (hints.vectorize > 0)
+                hint("llvm.loop.vectorize.width", count(hints.vectorize));
+            if (hints.interleave > 0)
+                hint("llvm.loop.interleave.count", count(hints.interleave));
+
+            if (hints.no_alias) {
+                // Every memory access of the loop joins one access group, the blocks
+                // of the loop are those reaching the back edge without leaving the header.
+                auto* group = llvm::MDNode::getDistinct(context, {});
+                auto* headerBlock = _Block(header);
+                std::set<llvm::BasicBlock*> blocks = {headerBlock};
+                std::vector<llvm::BasicBlock*> worklist = {llvm::cast<llvm::Instruction>(_Val(back_edge))->getParent()};
+                while (!worklist.empty()) {
+                    auto* block = worklist.back();
+                    worklist.pop_back();
+                    if (!blocks.insert(block).second)
+                        continue;
+                    for (auto* pred : llvm::predecessors(block)) {
+                        worklist.push_back(pred);
+                    }
+                }
+                for (auto* block : blocks) {
+                    for (auto& ins : *block) {
+                        if (ins.mayReadOrWriteMemory())
+                            ins.setMetadata(llvm::LLVMContext::MD_access_group, group);
+                    }
+                }
+                hint("llvm.loop.parallel_accesses", group);
+            }
+
+            if (ops.empty())
+                return;
+            // The loop id refers to itself, so it is distinct from the id of any other loop.
+            ops.insert(ops.begin(), nullptr);
+            auto* loopID = llvm::MDNode::getDistinct(context, ops);
+            loopID->replaceOperandWith(0, loopID);
+            llvm::cast<llvm::Instruction>(_Val(back_edge))->setMetadata(llvm::LLVMContext::MD_loop, loopID);
+        }
+
         virtual omis_handle_t phi(omis_handle_t type, const std::map<omis_handle_t, omis_handle_t>& incomings) override {
             auto phi = IR.CreatePHI(_Ty(type), incomings.size());
             for(auto& pair : incomings) {
                 phi->addIncoming(_Val(pair.first), _Block(pair.second));
             }
+            return phi;
+        }
+
+        virtual omis_handle_t select(omis_handle_t cond, omis_handle_t a, omis_handle_t b) override {
+            return IR.CreateSelect(_Val(cond), _Val(a), _Val(b));
         }
 
         virtual omis_handle_t call(omis_handle_t func, const std::vector<omis_handle_t>& args) override {
@@ -686,7 +2063,72 @@ namespace eokas
             for(auto& arg : args) {
                 args_values.push_back(_Val(arg));
             }
-            return IR.CreateCall(_Func(func), args_values);
+            auto callee = _Val(func);
+            auto type = llvm::cast<llvm::FunctionType>(callee->getType()->getPointerElementType());
+            auto* target = llvm::dyn_cast<llvm::Function>(callee);
+
+            // Inside a 'try' a call which may throw unwinds to its landing pad.
+            auto dest = this->unwind_dests.find(IR.GetInsertBlock()->getParent());
+            bool throws = target == nullptr || (!target->isIntrinsic() && !target->doesNotThrow());
+            if (dest != this->unwind_dests.end() && throws) {
+                auto* next = llvm::BasicBlock::Create(context, "invoke.next", IR.GetInsertBlock()->getParent());
+                auto* invoke = IR.CreateInvoke(type, callee, next, dest->second, args_values);
+                if (target != nullptr)
+                    invoke->setCallingConv(target->getCallingConv());
+                IR.SetInsertPoint(next);
+                return invoke;
+            }
+
+            auto call = IR.CreateCall(type, callee, args_values);
+            if (target != nullptr)
+                call->setCallingConv(target->getCallingConv());
+            return call;
+        }
+
+        // The code of a closure only ever reads its environment, see omis_module_t::type_closure.
+        virtual omis_handle_t call_closure(omis_handle_t code, omis_handle_t env, const std::vector<omis_handle_t>& args) override {
+            std::vector<omis_handle_t> values = {env};
+            values.insert(values.end(), args.begin(), args.end());
+            auto* call = llvm::cast<llvm::CallBase>(_Val(this->call(code, values)));
+            call->addParamAttr(0, llvm::Attribute::NoCapture);
+            call->addParamAttr(0, llvm::Attribute::ReadOnly);
+            return call;
+        }
+
+        virtual bool mark_tail_call(omis_handle_t value) override {
+            auto* call = llvm::dyn_cast<llvm::CallInst>(_Val(value));
+            if (call == nullptr)
+                return false;
+
+            // Only a call whose result is returned untouched is in tail position.
+            auto* block = IR.GetInsertBlock();
+            if (block == nullptr || block->empty() || &block->back() != call)
+                return false;
+
+            auto* target = call->getCalledFunction();
+            if (target != nullptr && target->isIntrinsic())
+                return false;
+
+            // The callee must not see the stack frame of the caller.
+            for (auto& arg : call->args()) {
+                if (!arg->getType()->isPointerTy())
+                    continue;
+                if (llvm::isa<llvm::AllocaInst>(llvm::getUnderlyingObject(arg)))
+                    return false;
+            }
+
+            // musttail guarantees the frame is reused at every opt level, but it
+            // needs identical prototypes and calling conventions on both sides.
+            auto* caller = block->getParent();
+            if (target != nullptr &&
+                target->getFunctionType() == caller->getFunctionType() &&
+                target->getCallingConv() == caller->getCallingConv() &&
+                !caller->isVarArg()) {
+                call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+            } else {
+                call->setTailCallKind(llvm::CallInst::TCK_Tail);
+            }
+            return true;
         }
 
         virtual omis_handle_t ret(omis_handle_t value) override {
@@ -700,6 +2142,14 @@ namespace eokas
             return IR.CreateBitCast(_Val(value), _Ty(type));
         }
 
+        virtual omis_handle_t fp_cast(omis_handle_t value, omis_handle_t type) override {
+            return IR.CreateFPCast(_Val(value), _Ty(type));
+        }
+
+        virtual omis_handle_t int_cast(omis_handle_t value, omis_handle_t type) override {
+            return IR.CreateSExtOrTrunc(_Val(value), _Ty(type));
+        }
+
         virtual omis_handle_t get_ptr_val(omis_handle_t ptr) override {
             auto value = _Val(ptr);
             llvm::Type* type = value->getType();
@@ -708,7 +2158,8 @@ namespace eokas
                     break;
                 if (type->getPointerElementType()->isFunctionTy())
                     break;
-                if (type->getPointerElementType()->isStructTy())
+                // Objects are references, unnamed structs are values.
+                if (this->is_type_struct(type->getPointerElementType()))
                     break;
                 if (type->getPointerElementType()->isArrayTy())
                     break;
@@ -725,6 +2176,10 @@ namespace eokas
             llvm::Type* type = value->getType();
 
             while (type->isPointerTy() && type->getPointerElementType()->isPointerTy()) {
+                // A slot holding a reference is stored into, not the object it refers to.
+                auto* target = type->getPointerElementType()->getPointerElementType();
+                if (this->is_type_struct(target) || target->isFunctionTy() || target->isArrayTy())
+                    break;
                 value = IR.CreateLoad(value);
                 type = value->getType();
             }
@@ -735,6 +2190,34 @@ namespace eokas
         // virtual omis_handle_t make(omis_handle_t type, omis_handle_t count) = 0;
         // virtual void drop(omis_handle_t ptr) = 0;
 
+        /**
+         * The O3 pipeline, tuned for the machine the code is for. It reads what the module
+         * was made with: the loop hints and access groups, 'nsw', the fast-math flags and
+         * the inferred attributes.
+         * */
+        void optimize_module(llvm::Module* module, llvm::TargetMachine* machine) {
+            llvm::LoopAnalysisManager loopAnalyses;
+            llvm::FunctionAnalysisManager funcAnalyses;
+            llvm::CGSCCAnalysisManager sccAnalyses;
+            llvm::ModuleAnalysisManager moduleAnalyses;
+
+            llvm::PipelineTuningOptions tuning;
+            tuning.LoopUnrolling = true;
+            tuning.LoopInterleaving = true;
+            tuning.LoopVectorization = true;
+            tuning.SLPVectorization = true;
+
+            llvm::PassBuilder builder(machine, tuning);
+            builder.registerModuleAnalyses(moduleAnalyses);
+            builder.registerCGSCCAnalyses(sccAnalyses);
+            builder.registerFunctionAnalyses(funcAnalyses);
+            builder.registerLoopAnalyses(loopAnalyses);
+            builder.crossRegisterProxies(loopAnalyses, funcAnalyses, sccAnalyses, moduleAnalyses);
+
+            auto passes = builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+            passes.run(*module, moduleAnalyses);
+        }
+
         virtual bool jit(omis_handle_t mod) override {
             llvm::InitializeNativeTarget();
             llvm::InitializeNativeTargetAsmPrinter();
@@ -742,18 +2225,56 @@ namespace eokas
 
             auto* module = _Mod(mod);
 
-            auto ee = llvm::EngineBuilder(std::unique_ptr<llvm::Module>(module))
-                    .setEngineKind(llvm::EngineKind::JIT)
-                    .create();
+            // The runtime is linked into the compiler, hand its entries to the JIT'd code.
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_alloc", (void*)&eokas_alloc);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_free", (void*)&eokas_free);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_allocator_stats", (void*)&eokas_allocator_stats);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_gc_add_root", (void*)&eokas_gc_add_root);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_gc_alloc", (void*)&eokas_gc_alloc);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_gc_alloc_aligned", (void*)&eokas_gc_alloc_aligned);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_gc_collect", (void*)&eokas_gc_collect);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_gc_stats", (void*)&eokas_gc_stats);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_array_reserve", (void*)&eokas_array_reserve);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_array_release", (void*)&eokas_array_release);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_bounds_error", (void*)&eokas_bounds_error);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_range_error", (void*)&eokas_range_error);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_memo_lookup", (void*)&eokas_memo_lookup);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_memo_store", (void*)&eokas_memo_store);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_throw", (void*)&eokas_throw);
+            llvm::sys::DynamicLibrary::AddSymbol("eokas_catch", (void*)&eokas_catch);
+
+            // The code runs right here, so it is tuned for the host CPU.
+            llvm::EngineBuilder engineBuilder{std::unique_ptr<llvm::Module>(module)};
+            engineBuilder.setEngineKind(llvm::EngineKind::JIT)
+                    .setOptLevel(llvm::CodeGenOpt::Aggressive)
+                    .setMCPU(llvm::sys::getHostCPUName());
+            auto* machine = engineBuilder.selectTarget();
+            if (machine == nullptr)
+                return false;
+            this->optimize_module(module, machine);
+            auto ee = engineBuilder.create(machine);
+            if (ee == nullptr)
+                return false;
 
             ee->finalizeObject();
 
+            // The shadow-stack frames of this module are chained from its own global.
+            auto rootChain = ee->getGlobalValueAddress("llvm_gc_root_chain");
+            if (rootChain != 0)
+                eokas_gc_set_root_chain((void*)rootChain);
+
             llvm::Function* func = module->getFunction("$main");
             if(func == nullptr)
                 return false;
 
             std::vector<llvm::GenericValue> args;
-            auto retval = ee->runFunction(func, args);
+            llvm::GenericValue retval;
+            try {
+                retval = ee->runFunction(func, args);
+            } catch (...) {
+                printf("ERROR: An exception was thrown out of '$main'.\n");
+                return false;
+            }
             llvm::SmallString<32> str;
             retval.IntVal.toString(str, 10, true);
             printf("RET: %s \n", str.c_str());
@@ -778,10 +2299,11 @@ namespace eokas
             auto features = "";
             llvm::TargetOptions opt;
             auto RM = llvm::Optional<llvm::Reloc::Model>();
-            auto targetMachine = target->createTargetMachine(targetTriple, CPU, features, opt, RM);
+            auto targetMachine = target->createTargetMachine(targetTriple, CPU, features, opt, RM, llvm::None, llvm::CodeGenOpt::Aggressive);
 
             module->setDataLayout(targetMachine->createDataLayout());
             module->setTargetTriple(targetTriple);
+            this->optimize_module(module, targetMachine);
 
             auto filename = "output.o";
             std::error_code EC;
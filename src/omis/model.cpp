@@ -1,5 +1,10 @@
 #include "./model.h"
 #include "./bridge.h"
+#include "../runtime/allocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
 
 namespace eokas {
     omis_scope_t::omis_scope_t(omis_scope_t* parent, omis_value_t* func)
@@ -53,8 +58,8 @@ namespace eokas {
         }
     }
 
-    bool omis_scope_t::add_value_symbol(const String& name, omis_value_t* value) {
-        auto symbol = new omis_value_symbol_t{.name =  name, .value = value, .scope = this};
+    bool omis_scope_t::add_value_symbol(const String& name, omis_value_t* value, bool variable) {
+        auto symbol = new omis_value_symbol_t{.name =  name, .value = value, .scope = this, .variable = variable};
         bool ret = this->values.add(name, symbol);
         return ret;
     }
@@ -95,11 +100,13 @@ namespace eokas {
         : bridge(bridge)
         , name(name)
         , handle(nullptr)
+        , options()
         , root(new omis_scope_t(nullptr, nullptr))
         , scope(this->root)
         , usings()
         , types()
-        , values() {
+        , values()
+        , negations() {
         this->handle = bridge->make_module(name.cstr());
     }
 
@@ -129,10 +136,22 @@ namespace eokas {
         return handle;
     }
 
+    const omis_options_t& omis_module_t::get_options() const {
+        return options;
+    }
+
+    void omis_module_t::set_options(const omis_options_t& options) {
+        this->options = options;
+    }
+
     String omis_module_t::dump() {
         return bridge->dump_module(handle);
     }
 
+    bool omis_module_t::finalize() {
+        return bridge->finalize_module(handle);
+    }
+
     bool omis_module_t::using_module(omis_module_t* other) {
         auto iter = std::find(usings.begin(), usings.end(), other);
         if (iter != usings.end())
@@ -167,8 +186,8 @@ namespace eokas {
         return this->get_scope()->get_value_symbol(name, lookup);
     }
 
-    bool omis_module_t::add_value_symbol(const String& name, omis_value_t* type) {
-        return this->get_scope()->add_value_symbol(name, type);
+    bool omis_module_t::add_value_symbol(const String& name, omis_value_t* type, bool variable) {
+        return this->get_scope()->add_value_symbol(name, type, variable);
     }
 
     omis_type_t* omis_module_t::type(omis_handle_t handle) {
@@ -176,7 +195,13 @@ namespace eokas {
         if (iter != this->types.end())
             return iter->second;
 
-        auto type = new omis_type_t(this, handle);
+        omis_type_t* type = nullptr;
+        if (bridge->is_type_vector(handle)) {
+            auto item = this->type(bridge->get_vector_element_type(handle));
+            type = new omis_vector_t(this, handle, item, bridge->get_vector_length(handle));
+        } else {
+            type = new omis_type_t(this, handle);
+        }
         this->types.insert(std::make_pair(handle, type));
 
         return type;
@@ -242,6 +267,133 @@ namespace eokas {
         return this->type(ft);
     }
 	
+    omis_struct_t* omis_module_t::type_struct(const String& name) {
+        auto handle = bridge->type_struct(name);
+        auto type = new omis_struct_t(this, handle);
+        this->types.insert(std::make_pair(handle, type));
+        return type;
+    }
+
+    omis_array_t* omis_module_t::type_array(omis_type_t* element, u64_t length, bool soa) {
+        auto key = std::make_tuple(element, length, soa);
+        auto iter = this->arrays.find(key);
+        if (iter != this->arrays.end())
+            return iter->second;
+
+        omis_handle_t handle = nullptr;
+        if (soa) {
+            auto struct_type = dynamic_cast<omis_struct_t*>(element);
+            if (struct_type == nullptr)
+                return nullptr;
+            // One column per member, in the order of the members.
+            std::vector<omis_handle_t> columns;
+            for (size_t index = 0; index < struct_type->get_member_count(); index++) {
+                auto member = struct_type->get_member(index);
+                columns.push_back(bridge->type_array(member->type->get_handle(), length));
+            }
+            handle = bridge->type_struct(String::format("soa.%s.%llu", this->get_type_name(element).cstr(), (unsigned long long) length));
+            bridge->set_struct_body(handle, columns, false);
+        } else if (length == 0) {
+            // The collector does not trace the heap items of growable arrays.
+            if (options.gc && (element->is_type_struct() || element->is_type_array() || element->get_element_type() != nullptr)) {
+                printf("ERROR: Growable arrays of objects can not be used with the collector.\n");
+                return nullptr;
+            }
+            // Matches eokas_array_t: length, capacity, items.
+            handle = bridge->type_struct(String::format("array.%s", this->get_type_name(element).cstr()));
+            bridge->set_struct_body(handle, {bridge->type_i64(), bridge->type_i64(), bridge->type_pointer(element->get_handle())}, false);
+        } else {
+            handle = bridge->type_array(element->get_handle(), length);
+        }
+
+        auto type = new omis_array_t(this, handle, element, length, soa);
+        this->types[handle] = type;
+        this->arrays.insert(std::make_pair(key, type));
+        return type;
+    }
+
+    omis_slice_t* omis_module_t::type_slice(omis_type_t* item) {
+        // Items and count, the same layout for every slice of the same item type.
+        auto handle = bridge->type_tuple({bridge->type_pointer(item->get_handle()), bridge->type_i64()});
+        auto iter = this->types.find(handle);
+        if (iter != this->types.end()) {
+            auto type = dynamic_cast<omis_slice_t*>(iter->second);
+            if (type != nullptr)
+                return type;
+        }
+
+        auto type = new omis_slice_t(this, handle, item);
+        this->types[handle] = type;
+        return type;
+    }
+
+    omis_vector_t* omis_module_t::type_vector(omis_type_t* item, u32_t length) {
+        bool numeric = this->equals_type(item, this->type_i32()) || this->equals_type(item, this->type_i64()) ||
+                       this->equals_type(item, this->type_f32()) || this->equals_type(item, this->type_f64()) ||
+                       this->equals_type(item, this->type_bool());
+        if (!numeric || length == 0) {
+            printf("ERROR: A vector of '%s' is not supported.\n", this->get_type_name(item).cstr());
+            return nullptr;
+        }
+        auto handle = bridge->type_vector(item->get_handle(), length);
+        return dynamic_cast<omis_vector_t*>(this->type(handle));
+    }
+
+    /**
+     * A function value, it may carry the locals it captures. It is a reference to a
+     * record whose first member is the code, the captures follow it in the record
+     * type_closure_env makes. 'func(A): R' is called as 'R code(i8* env, A)'.
+     * */
+    omis_struct_t* omis_module_t::type_closure(omis_type_t* ret, const std::vector<omis_type_t*>& args) {
+        std::vector<omis_type_t*> params = {this->type_bytes()};
+        params.insert(params.end(), args.begin(), args.end());
+        auto code = this->type_func(ret, params, false);
+        auto iter = this->closures.find(code->get_handle());
+        if (iter != this->closures.end())
+            return iter->second;
+
+        auto type = this->type_struct("closure");
+        type->add_member("code", code->get_pointer_type());
+        type->resolve();
+        this->closures.insert(std::make_pair(code->get_handle(), type));
+        return type;
+    }
+
+    omis_struct_t* omis_module_t::type_closure_env(omis_struct_t* closure, const std::vector<omis_type_t*>& captures) {
+        auto type = this->type_struct("closure.env");
+        if (!type->extends(closure))
+            return nullptr;
+        for (size_t index = 0; index < captures.size(); index++) {
+            type->add_member(String::format("capture.%u", (u32_t) index), captures.at(index));
+        }
+        type->resolve();
+        return type;
+    }
+
+    // A mutable local shared by the closures capturing it.
+    omis_struct_t* omis_module_t::type_box(omis_type_t* type) {
+        auto iter = this->box_types.find(type);
+        if (iter != this->box_types.end())
+            return iter->second;
+
+        auto box = this->type_struct("box");
+        box->add_member("value", type);
+        box->resolve();
+        this->box_types.insert(std::make_pair(type, box));
+        return box;
+    }
+
+    omis_struct_t* omis_module_t::get_closure_type(omis_type_t* type) {
+        auto element = type->get_element_type();
+        if (element == nullptr)
+            return nullptr;
+        for (auto& pair: this->closures) {
+            if (pair.second == element)
+                return pair.second;
+        }
+        return nullptr;
+    }
+
 	String omis_module_t::get_type_name(omis_type_t *type) {
 		return bridge->get_type_name(type->get_handle());
 	}
@@ -251,6 +403,10 @@ namespace eokas {
         return this->value(ret);
     }
 
+    u64_t omis_module_t::get_type_alloc_size(omis_type_t *type) {
+        return bridge->get_type_alloc_size(type->get_handle());
+    }
+
     bool omis_module_t::can_losslessly_bitcast(omis_type_t* a, omis_type_t* b) {
         return bridge->can_losslessly_cast(a->get_handle(), b->get_handle());
     }
@@ -267,6 +423,8 @@ namespace eokas {
     }
 
     omis_value_t* omis_module_t::value(omis_handle_t val) {
+        if (val == nullptr)
+            return nullptr;
         auto type = this->type(bridge->get_value_type(val));
         return this->value(type, val);
     }
@@ -275,6 +433,10 @@ namespace eokas {
         auto type = this->type_i64();
         if (bits == 32)
             type = this->type_i32();
+        else if (bits == 16)
+            type = this->type_i16();
+        else if (bits == 8)
+            type = this->type_i8();
         auto ret = bridge->value_integer(val, bits);
         return this->value(type, ret);
     }
@@ -305,9 +467,101 @@ namespace eokas {
 
         auto type = this->type_func(ret, args, varg);
         auto func = bridge->value_func(this->handle, name, type->get_handle());
+        bridge->set_func_fp_model(func, options.fp_model);
         
 		return this->value(func);
     }
+
+    // Must be set before the body of the function is emitted.
+    void omis_module_t::set_fp_model(omis_value_t* func, omis_fp_model_t model) {
+        bridge->set_func_fp_model(func->get_handle(), model);
+    }
+
+    // The args and the result are cached as 64-bit words, only scalars fit in one.
+    bool omis_module_t::set_memo(omis_value_t* func, u32_t capacity, bool lru) {
+        auto is_scalar = [&](omis_type_t* type) -> bool {
+            auto handle = type->get_handle();
+            return bridge->is_type_i8(handle) || bridge->is_type_i16(handle) || bridge->is_type_i32(handle)
+                || bridge->is_type_i64(handle) || bridge->is_type_f32(handle) || bridge->is_type_f64(handle)
+                || bridge->is_type_bool(handle);
+        };
+
+        if (!is_scalar(this->get_func_ret_type(func))) {
+            printf("ERROR: The result of a '#memo' function must be an integer, a float or a bool.\n");
+            return false;
+        }
+        for (uint32_t index = 0; index < this->get_func_arg_count(func); index++) {
+            if (!is_scalar(this->get_func_arg_type(func, index))) {
+                printf("ERROR: The args of a '#memo' function must be integers, floats or bools.\n");
+                return false;
+            }
+        }
+
+        // A direct-mapped cache by default, 4 ways to keep the recently used results.
+        u32_t ways = lru && capacity >= 4 ? 4 : 1;
+        bridge->set_func_memo(func->get_handle(), capacity - capacity % ways, ways);
+        return true;
+    }
+	
+    omis_value_t* omis_module_t::value_builtin(const String& name, omis_type_t* type) {
+        auto func = bridge->value_builtin(this->handle, name, type->get_handle());
+        if (func == nullptr) {
+            printf("ERROR: The builtin '%s' is not supported with type '%s'.\n", name.cstr(), this->get_type_name(type).cstr());
+            return nullptr;
+        }
+        return this->value(func);
+    }
+	
+    omis_value_t* omis_module_t::value_array(omis_type_t* item, const std::vector<omis_value_t*>& items) {
+        if (items.empty())
+            return nullptr;
+        if (this->type_array(item, items.size()) == nullptr)
+            return nullptr;
+        std::vector<omis_handle_t> handles;
+        for (auto& value: items) {
+            handles.push_back(value->get_handle());
+        }
+        auto ret = bridge->value_array(this->handle, item->get_handle(), handles);
+        if (ret == nullptr)
+            return nullptr;
+        return this->value(ret);
+    }
+	
+    /**
+     * A vector of constants is a constant, the others are built lane by lane.
+     * */
+    omis_value_t* omis_module_t::value_vector(omis_vector_t* type, const std::vector<omis_value_t*>& items) {
+        if (items.size() != type->get_length()) {
+            printf("ERROR: A '%s' needs %u items.\n", this->get_type_name(type).cstr(), type->get_length());
+            return nullptr;
+        }
+
+        std::vector<omis_value_t*> lanes;
+        bool constant = true;
+        for (auto& item: items) {
+            auto lane = this->cast_vector_item(item, type->get_item_type());
+            if (lane == nullptr) {
+                printf("ERROR: The item of type '%s' can not be put into a '%s'.\n", this->get_type_name(item->get_type()).cstr(), this->get_type_name(type).cstr());
+                return nullptr;
+            }
+            constant = constant && (bridge->is_value_const_int(lane->get_handle()) || bridge->is_value_const_float(lane->get_handle()));
+            lanes.push_back(lane);
+        }
+
+        if (constant) {
+            std::vector<omis_handle_t> handles;
+            for (auto& lane: lanes) {
+                handles.push_back(lane->get_handle());
+            }
+            return this->value(type, bridge->value_vector(handles));
+        }
+
+        auto ret = type->get_default_value()->get_handle();
+        for (u32_t index = 0; index < lanes.size(); index++) {
+            ret = bridge->insert_element(ret, lanes.at(index)->get_handle(), this->value_integer(index, 32)->get_handle());
+        }
+        return this->value(type, ret);
+    }
 	
 	omis_type_t* omis_module_t::get_func_ret_type(omis_value_t* func) {
 		auto type = func->get_type()->get_handle();
@@ -330,6 +584,14 @@ namespace eokas {
 		auto ret = bridge->get_func_arg_value(func->get_handle(), index);
 		return this->value(ret);
 	}
+	
+	bool omis_module_t::is_value_func(omis_value_t* value) {
+		return bridge->is_value_func(value->get_handle());
+	}
+	
+	bool omis_module_t::is_value_const(omis_value_t* value) {
+		return bridge->is_value_const(value->get_handle());
+	}
 
     bool omis_module_t::equals_type(omis_type_t* a, omis_type_t* b) {
         return a == b || a->get_handle() == b->get_handle();
@@ -359,6 +621,10 @@ namespace eokas {
     }
 
     omis_value_t* omis_type_t::get_default_value() {
+        if (default_value == nullptr) {
+            auto bridge = module->get_bridge();
+            default_value = module->value(bridge->get_default_value(this->handle));
+        }
         return default_value;
     }
 
@@ -383,6 +649,14 @@ namespace eokas {
         return module->type(ret);
     }
 
+    omis_type_t* omis_type_t::get_element_type() {
+        auto bridge = module->get_bridge();
+        auto ret = bridge->get_pointer_element_type(this->handle);
+        if (ret == nullptr)
+            return nullptr;
+        return module->type(ret);
+    }
+
     omis_struct_t::omis_struct_t(omis_module_t* module, void* handle)
             : omis_type_t(module, handle) {
 
@@ -407,29 +681,41 @@ namespace eokas {
         return this->extends(base_struct);
     }
 
+    /**
+     * The members of the base are copied in front of our own, so the
+     * layout of the base is a prefix of ours, however deep the hierarchy.
+     * */
     bool omis_struct_t::extends(omis_struct_t* base) {
-        if (base == nullptr)
+        if (base == nullptr || this->base != nullptr || !this->members.empty())
             return false;
-        this->add_member("base", base);
+        this->base = base;
         for (auto& m: base->members) {
-            if (m.name == "base")
-                continue;
             if (this->add_member(&m) == nullptr)
                 return false;
         }
         return true;
     }
 
+    omis_struct_t* omis_struct_t::get_base() {
+        return this->base;
+    }
+
     omis_struct_t::member_t* omis_struct_t::add_member(const String& name, omis_type_t* type, omis_value_t* value) {
+        if (this->frozen)
+            return nullptr;
         if (this->get_member(name) != nullptr)
             return nullptr;
         if (type == nullptr && value == nullptr)
             return nullptr;
 
+        this->indices.insert(std::make_pair(name, this->members.size()));
         member_t& m = this->members.emplace_back();
         m.name = name;
         m.type = type;
         m.value = value;
+        m.offset = 0;
+        m.align = 0;
+        m.field = 0;
 
         if (type == nullptr) {
             m.type = value->get_type();
@@ -443,15 +729,17 @@ namespace eokas {
     }
 
     omis_struct_t::member_t* omis_struct_t::add_member(omis_struct_t::member_t* other) {
-        return this->add_member(other->name, other->type, other->value);
+        auto m = this->add_member(other->name, other->type, other->value);
+        if (m != nullptr)
+            m->align = other->align;
+        return m;
     }
 
     omis_struct_t::member_t* omis_struct_t::get_member(const String& name) {
-        for (auto& m: this->members) {
-            if (m.name == name)
-                return &m;
-        }
-        return nullptr;
+        auto iter = this->indices.find(name);
+        if (iter == this->indices.end())
+            return nullptr;
+        return &this->members.at(iter->second);
     }
 
     omis_struct_t::member_t* omis_struct_t::get_member(size_t index) {
@@ -462,11 +750,162 @@ namespace eokas {
     }
 
     size_t omis_struct_t::get_member_index(const String& name) {
-        for (size_t index = 0; index < this->members.size(); index++) {
-            if (this->members.at(index).name == name)
-                return index;
+        auto iter = this->indices.find(name);
+        if (iter == this->indices.end())
+            return -1;
+        return iter->second;
+    }
+
+    size_t omis_struct_t::get_member_count() {
+        return this->members.size();
+    }
+
+    void omis_struct_t::set_layout(bool packed, bool reorder, u32_t align) {
+        this->packed = packed;
+        this->reorder = reorder;
+        this->align = align;
+    }
+
+    u32_t omis_struct_t::get_align() {
+        return this->align;
+    }
+
+    bool omis_struct_t::is_explicit_layout() {
+        return this->explicit_layout;
+    }
+
+    bool omis_struct_t::resolve() {
+        if (this->frozen)
+            return false;
+
+        auto bridge = module->get_bridge();
+        size_t base_count = this->base != nullptr ? this->base->members.size() : 0;
+
+        // Biggest alignment first leaves no holes, the base members stay in front.
+        if (this->reorder) {
+            std::stable_sort(this->members.begin() + base_count, this->members.end(), [&](const member_t& a, const member_t& b) {
+                auto align_a = std::max(bridge->get_type_align(a.type->get_handle()), a.align);
+                auto align_b = std::max(bridge->get_type_align(b.type->get_handle()), b.align);
+                if (align_a != align_b)
+                    return align_a > align_b;
+                return bridge->get_type_alloc_size(a.type->get_handle()) > bridge->get_type_alloc_size(b.type->get_handle());
+            });
+            this->indices.clear();
+            for (size_t index = 0; index < this->members.size(); index++) {
+                this->indices.insert(std::make_pair(this->members.at(index).name, index));
+            }
+        }
+
+        this->explicit_layout = this->packed || this->align != 0 || (this->base != nullptr && this->base->explicit_layout);
+        for (auto& m: this->members) {
+            this->explicit_layout = this->explicit_layout || m.align != 0;
+        }
+
+        std::vector<omis_handle_t> fields;
+        if (!this->explicit_layout) {
+            for (u32_t index = 0; index < this->members.size(); index++) {
+                auto& m = this->members.at(index);
+                m.field = index;
+                fields.push_back(m.type->get_handle());
+            }
+            bridge->set_struct_body(this->handle, fields, false);
+            for (auto& m: this->members) {
+                m.offset = bridge->get_struct_member_offset(this->handle, m.field);
+            }
+            this->align = bridge->get_type_align(this->handle);
+        } else {
+            // Lay the members out by hand in a packed body, holes are filled with bytes.
+            auto pad = [&](u64_t from, u64_t to) {
+                if (to > from)
+                    fields.push_back(bridge->type_array(bridge->type_i8(), to - from));
+            };
+            u64_t offset = 0;
+            u32_t max_align = 1;
+            for (size_t index = 0; index < this->members.size(); index++) {
+                auto& m = this->members.at(index);
+                auto size = bridge->get_type_alloc_size(m.type->get_handle());
+                u32_t member_align = this->packed ? 1 : bridge->get_type_align(m.type->get_handle());
+                member_align = std::max(member_align, m.align);
+                u64_t target = index < base_count ? this->base->members.at(index).offset : (offset + member_align - 1) / member_align * member_align;
+                pad(offset, target);
+                m.offset = target;
+                m.field = (u32_t) fields.size();
+                fields.push_back(m.type->get_handle());
+                offset = target + size;
+                // An aligned member keeps its whole line, nothing else is put after it.
+                if (m.align != 0) {
+                    auto end = (offset + m.align - 1) / m.align * m.align;
+                    pad(offset, end);
+                    offset = end;
+                }
+                max_align = std::max(max_align, member_align);
+            }
+            this->align = std::max(max_align, this->align);
+            auto size = (offset + this->align - 1) / this->align * this->align;
+            pad(offset, size);
+            bridge->set_struct_body(this->handle, fields, true);
         }
-        return -1;
+
+        // The member table is final from here on.
+        this->frozen = true;
+        return true;
+    }
+}
+
+namespace eokas {
+    omis_array_t::omis_array_t(omis_module_t* module, omis_handle_t handle, omis_type_t* item, u64_t length, bool soa)
+            : omis_type_t(module, handle), item(item), length(length), soa(soa) {
+
+    }
+
+    omis_array_t::~omis_array_t() {
+
+    }
+
+    omis_type_t* omis_array_t::get_item_type() {
+        return item;
+    }
+
+    u64_t omis_array_t::get_length() {
+        return length;
+    }
+
+    bool omis_array_t::is_soa() {
+        return soa;
+    }
+
+    bool omis_array_t::is_dynamic() {
+        return length == 0;
+    }
+
+    omis_slice_t::omis_slice_t(omis_module_t* module, omis_handle_t handle, omis_type_t* item)
+            : omis_type_t(module, handle), item(item) {
+
+    }
+
+    omis_slice_t::~omis_slice_t() {
+
+    }
+
+    omis_type_t* omis_slice_t::get_item_type() {
+        return item;
+    }
+
+    omis_vector_t::omis_vector_t(omis_module_t* module, omis_handle_t handle, omis_type_t* item, u32_t length)
+            : omis_type_t(module, handle), item(item), length(length) {
+
+    }
+
+    omis_vector_t::~omis_vector_t() {
+
+    }
+
+    omis_type_t* omis_vector_t::get_item_type() {
+        return item;
+    }
+
+    u32_t omis_vector_t::get_length() {
+        return length;
     }
 }
 
@@ -498,6 +937,247 @@ namespace eokas {
 	}
 }
 
+namespace eokas {
+	bool omis_module_t::get_const_int(omis_value_t *val, i64_t &out) {
+		if (val == nullptr || !bridge->is_value_const_int(val->get_handle()))
+			return false;
+		out = bridge->get_value_const_int(val->get_handle());
+		return true;
+	}
+	
+	bool omis_module_t::get_const_float(omis_value_t *val, f64_t &out) {
+		if (val == nullptr || !bridge->is_value_const_float(val->get_handle()))
+			return false;
+		out = bridge->get_value_const_float(val->get_handle());
+		return true;
+	}
+	
+	u32_t omis_module_t::get_int_bits(omis_type_t *type) {
+		if (this->equals_type(type, this->type_i32()))
+			return 32;
+		if (this->equals_type(type, this->type_i64()))
+			return 64;
+		return 0;
+	}
+	
+	/**
+	 * A lane of a vector must have the item type, literals are re-typed to it.
+	 * Returns nullptr if the value does not fit.
+	 * */
+	omis_value_t *omis_module_t::cast_vector_item(omis_value_t *value, omis_type_t *item) {
+		if (this->equals_type(value->get_type(), item))
+			return value;
+		
+		i64_t val = 0;
+		bool is_float = this->equals_type(item, this->type_f32()) || this->equals_type(item, this->type_f64());
+		if (is_float && this->get_int_bits(value->get_type()) != 0 && this->get_const_int(value, val))
+			value = this->value_float((f64_t) val);
+		
+		auto ret = this->cast_const_int(value, item);
+		if (ret == nullptr)
+			ret = this->cast_const_float(value, item);
+		return ret;
+	}
+	
+	/**
+	 * Evaluates `a op b` at emission time when both operands are constants,
+	 * or when one of them makes the operation an identity (x+0, x*1, x*0...).
+	 * Returns nullptr if the operation has to be emitted.
+	 */
+	omis_value_t *omis_module_t::fold_binary(omis_fold_op_t op, omis_value_t *a, omis_value_t *b) {
+		if (a == nullptr || b == nullptr)
+			return nullptr;
+		
+		i64_t ia = 0, ib = 0;
+		bool ca = this->get_const_int(a, ia);
+		bool cb = this->get_const_int(b, ib);
+		bool same = this->equals_type(a->get_type(), b->get_type());
+		// Every integer width folds, get_int_bits only knows the ones literals have.
+		auto int_bits = [this](omis_type_t *type) -> u32_t {
+			if (this->equals_type(type, this->type_i8()))
+				return 8;
+			if (this->equals_type(type, this->type_i16()))
+				return 16;
+			return this->get_int_bits(type);
+		};
+		u32_t bits = int_bits(a->get_type());
+		
+		// bool == bool, bool != bool
+		if (ca && cb && same && this->equals_type(a->get_type(), this->type_bool())) {
+			if (op == omis_fold_op_t::EQ)
+				return this->value_bool(ia == ib);
+			if (op == omis_fold_op_t::NE)
+				return this->value_bool(ia != ib);
+			return nullptr;
+		}
+		
+		if (bits != 0 && same) {
+			auto wrap = [bits](u64_t val) -> u64_t {
+				return bits == 64 ? val : (u64_t) ((i64_t) (val << (64 - bits)) >> (64 - bits));
+			};
+			u64_t mask = bits == 64 ? ~(u64_t) 0 : ((u64_t) 1 << bits) - 1;
+			i64_t min = bits == 64 ? INT64_MIN : -((i64_t) 1 << (bits - 1));
+			u64_t ua = (u64_t) ia;
+			u64_t ub = (u64_t) ib;
+			
+			if (ca && cb) {
+				switch (op) {
+					case omis_fold_op_t::ADD: return this->value_integer(wrap(ua + ub), bits);
+					case omis_fold_op_t::SUB: return this->value_integer(wrap(ua - ub), bits);
+					case omis_fold_op_t::MUL: return this->value_integer(wrap(ua * ub), bits);
+					case omis_fold_op_t::DIV:
+						if (ib == 0 || (ia == min && ib == -1))
+							return nullptr;
+						return this->value_integer((u64_t) (ia / ib), bits);
+					case omis_fold_op_t::MOD:
+						if (ib == 0 || (ia == min && ib == -1))
+							return nullptr;
+						return this->value_integer((u64_t) (ia % ib), bits);
+					case omis_fold_op_t::AND: return this->value_integer(ua & ub, bits);
+					case omis_fold_op_t::OR: return this->value_integer(ua | ub, bits);
+					case omis_fold_op_t::XOR: return this->value_integer(ua ^ ub, bits);
+					case omis_fold_op_t::SHL:
+						if (ib < 0 || ib >= bits)
+							return nullptr;
+						return this->value_integer(wrap(ua << ib), bits);
+					case omis_fold_op_t::SHR:
+						if (ib < 0 || ib >= bits)
+							return nullptr;
+						return this->value_integer(wrap((ua & mask) >> ib), bits);
+					case omis_fold_op_t::EQ: return this->value_bool(ia == ib);
+					case omis_fold_op_t::NE: return this->value_bool(ia != ib);
+					case omis_fold_op_t::GT: return this->value_bool(ia > ib);
+					case omis_fold_op_t::GE: return this->value_bool(ia >= ib);
+					case omis_fold_op_t::LT: return this->value_bool(ia < ib);
+					case omis_fold_op_t::LE: return this->value_bool(ia <= ib);
+				}
+				return nullptr;
+			}
+			
+			switch (op) {
+				case omis_fold_op_t::ADD:
+					if (cb && ib == 0) return a;
+					if (ca && ia == 0) return b;
+					break;
+				case omis_fold_op_t::SUB:
+					if (cb && ib == 0) return a;
+					if (this->equals_value(a, b)) return this->value_integer(0, bits);
+					break;
+				case omis_fold_op_t::MUL:
+					if (cb && ib == 1) return a;
+					if (ca && ia == 1) return b;
+					if (cb && ib == 0) return b;
+					if (ca && ia == 0) return a;
+					break;
+				case omis_fold_op_t::DIV:
+					if (cb && ib == 1) return a;
+					break;
+				case omis_fold_op_t::MOD:
+					if (cb && ib == 1) return this->value_integer(0, bits);
+					break;
+				case omis_fold_op_t::AND:
+					if (cb && ib == 0) return b;
+					if (ca && ia == 0) return a;
+					if (cb && ib == -1) return a;
+					if (ca && ia == -1) return b;
+					if (this->equals_value(a, b)) return a;
+					break;
+				case omis_fold_op_t::OR:
+					if (cb && ib == 0) return a;
+					if (ca && ia == 0) return b;
+					if (cb && ib == -1) return b;
+					if (ca && ia == -1) return a;
+					if (this->equals_value(a, b)) return a;
+					break;
+				case omis_fold_op_t::XOR:
+					if (cb && ib == 0) return a;
+					if (ca && ia == 0) return b;
+					if (this->equals_value(a, b)) return this->value_integer(0, bits);
+					break;
+				case omis_fold_op_t::SHL:
+				case omis_fold_op_t::SHR:
+					if (cb && ib == 0) return a;
+					break;
+				case omis_fold_op_t::EQ:
+				case omis_fold_op_t::GE:
+				case omis_fold_op_t::LE:
+					if (this->equals_value(a, b)) return this->value_bool(true);
+					break;
+				case omis_fold_op_t::NE:
+				case omis_fold_op_t::GT:
+				case omis_fold_op_t::LT:
+					if (this->equals_value(a, b)) return this->value_bool(false);
+					break;
+			}
+			return nullptr;
+		}
+		
+		// f32 and f64 constants, integers are promoted like the bridge does: an f32 operand
+		// only widens to f64 against an f64 one, an integer takes the type of the other side.
+		auto f32 = this->type_f32();
+		auto f64 = this->type_f64();
+		bool fpa = this->equals_type(a->get_type(), f32) || this->equals_type(a->get_type(), f64);
+		bool fpb = this->equals_type(b->get_type(), f32) || this->equals_type(b->get_type(), f64);
+		if (!fpa && !fpb)
+			return nullptr;
+		bool single = !this->equals_type(a->get_type(), f64) && !this->equals_type(b->get_type(), f64);
+		
+		f64_t fa = 0, fb = 0;
+		bool fca = fpa ? this->get_const_float(a, fa) : (ca && bits != 0);
+		bool fcb = fpb ? this->get_const_float(b, fb) : (cb && int_bits(b->get_type()) != 0);
+		if (!fpa && fca) fa = single ? (f64_t) (f32_t) ia : (f64_t) ia;
+		if (!fpb && fcb) fb = single ? (f64_t) (f32_t) ib : (f64_t) ib;
+		
+		// f32 operands are exact in f64, rounding the f64 result of one operation gives the f32 result.
+		auto value_fp = [this, single, f32](f64_t val) -> omis_value_t * {
+			auto ret = this->value_float(val);
+			return single ? this->cast_const_float(ret, f32) : ret;
+		};
+		
+		if (fca && fcb) {
+			bool unordered = std::isnan(fa) || std::isnan(fb);
+			switch (op) {
+				case omis_fold_op_t::ADD: return value_fp(fa + fb);
+				case omis_fold_op_t::SUB: return value_fp(fa - fb);
+				case omis_fold_op_t::MUL: return value_fp(fa * fb);
+				case omis_fold_op_t::DIV: return value_fp(fa / fb);
+				case omis_fold_op_t::MOD: return value_fp(std::fmod(fa, fb));
+				case omis_fold_op_t::EQ: return this->value_bool(fa == fb);
+				case omis_fold_op_t::NE: return this->value_bool(!unordered && fa != fb);
+				case omis_fold_op_t::GT: return this->value_bool(fa > fb);
+				case omis_fold_op_t::GE: return this->value_bool(fa >= fb);
+				case omis_fold_op_t::LT: return this->value_bool(fa < fb);
+				case omis_fold_op_t::LE: return this->value_bool(fa <= fb);
+				default: return nullptr;
+			}
+		}
+		
+		// Only the identities which hold for every IEEE value, including NaN and -0.0.
+		if (fpa && fpb && same) {
+			switch (op) {
+				case omis_fold_op_t::ADD:
+					if (fcb && fb == 0.0 && std::signbit(fb)) return a;
+					if (fca && fa == 0.0 && std::signbit(fa)) return b;
+					break;
+				case omis_fold_op_t::SUB:
+					if (fcb && fb == 0.0 && !std::signbit(fb)) return a;
+					break;
+				case omis_fold_op_t::MUL:
+					if (fcb && fb == 1.0) return a;
+					if (fca && fa == 1.0) return b;
+					break;
+				case omis_fold_op_t::DIV:
+					if (fcb && fb == 1.0) return a;
+					break;
+				default:
+					break;
+			}
+		}
+		
+		return nullptr;
+	}
+}
+
 namespace eokas {
 	omis_value_t *omis_module_t::create_block(const String &name) {
 		auto func = this->scope->func;
@@ -534,9 +1214,14 @@ namespace eokas {
 	}
 	
 	omis_value_t *omis_module_t::alloc(const String &name, omis_type_t *type, omis_value_t *value) {
-		auto ptr = bridge->alloc(type->get_handle(), name);
+		// A slot holding an object is a root the collector has to see,
+		// a slice is no pointer the slot could hold, the values stored to it are rooted instead.
+		bool slice = dynamic_cast<omis_slice_t *>(type) != nullptr;
+		auto ptr = this->is_gc_ref(type) && !slice ? bridge->gc_root(type->get_handle(), name) : bridge->alloc(type->get_handle(), name);
 		if(value != nullptr) {
 			auto ret = bridge->store(ptr, value->get_handle());
+			if (slice && this->is_gc_ref(type))
+				this->gc_root(value);
 		}
 		return this->value(ptr);
 	}
@@ -552,106 +1237,214 @@ namespace eokas {
 	}
 	
 	omis_value_t *omis_module_t::neg(omis_value_t *a) {
+		i64_t ival = 0;
+		f64_t fval = 0;
+		u32_t bits = this->get_int_bits(a->get_type());
+		if (bits != 0 && this->get_const_int(a, ival))
+			return this->value_integer(0ull - (u64_t) ival, bits);
+		if (this->equals_type(a->get_type(), this->type_f64()) && this->get_const_float(a, fval))
+			return this->value_float(-fval);
+		
 		auto ret = bridge->neg(a->get_handle());
 		return this->value(a->get_type(), ret);
 	}
 	
 	omis_value_t *omis_module_t::add(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::ADD, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->add(a->get_handle(), b->get_handle());
 		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::sub(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::SUB, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->sub(a->get_handle(), b->get_handle());
 		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::mul(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::MUL, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->mul(a->get_handle(), b->get_handle());
 		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::div(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::DIV, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->div(a->get_handle(), b->get_handle());
 		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::mod(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::MOD, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->mod(a->get_handle(), b->get_handle());
 		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::eq(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::EQ, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->eq(a->get_handle(), b->get_handle());
-		return this->value(this->type_bool(), ret);
+		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::ne(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::NE, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->ne(a->get_handle(), b->get_handle());
-		return this->value(this->type_bool(), ret);
+		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::gt(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::GT, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->gt(a->get_handle(), b->get_handle());
-		return this->value(this->type_bool(), ret);
+		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::ge(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::GE, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->ge(a->get_handle(), b->get_handle());
-		return this->value(this->type_bool(), ret);
+		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::lt(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::LT, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->lt(a->get_handle(), b->get_handle());
-		return this->value(this->type_bool(), ret);
+		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::le(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::LE, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->le(a->get_handle(), b->get_handle());
-		return this->value(this->type_bool(), ret);
+		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::l_not(omis_value_t *a) {
+		i64_t val = 0;
+		if (this->equals_type(a->get_type(), this->type_bool()) && this->get_const_int(a, val))
+			return this->value_bool(val == 0);
+		
+		// !!b => b
+		auto iter = this->negations.find(a);
+		if (iter != this->negations.end())
+			return iter->second;
+		
 		auto ret = bridge->l_not(a->get_handle());
-		return this->value(this->type_bool(), ret);
+		auto val_not = this->value(ret);
+		this->negations[val_not] = a;
+		return val_not;
 	}
 	
 	omis_value_t *omis_module_t::l_and(omis_value_t *a, omis_value_t *b) {
+		i64_t val = 0;
+		if (this->equals_type(a->get_type(), this->type_bool()) && this->equals_type(b->get_type(), this->type_bool())) {
+			if (this->get_const_int(a, val))
+				return val != 0 ? b : a;
+			if (this->get_const_int(b, val))
+				return val != 0 ? a : b;
+			if (this->equals_value(a, b))
+				return a;
+		}
+		
 		auto ret = bridge->l_and(a->get_handle(), b->get_handle());
-		return this->value(this->type_bool(), ret);
+		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::l_or(omis_value_t *a, omis_value_t *b) {
+		i64_t val = 0;
+		if (this->equals_type(a->get_type(), this->type_bool()) && this->equals_type(b->get_type(), this->type_bool())) {
+			if (this->get_const_int(a, val))
+				return val != 0 ? a : b;
+			if (this->get_const_int(b, val))
+				return val != 0 ? b : a;
+			if (this->equals_value(a, b))
+				return a;
+		}
+		
 		auto ret = bridge->l_or(a->get_handle(), b->get_handle());
-		return this->value(this->type_bool(), ret);
+		return this->value(ret);
 	}
 	
 	omis_value_t *omis_module_t::b_flip(omis_value_t *a) {
+		i64_t val = 0;
+		u32_t bits = this->get_int_bits(a->get_type());
+		if (bits != 0 && this->get_const_int(a, val))
+			return this->value_integer(~((u64_t) val), bits);
+		
 		auto ret = bridge->b_flip(a->get_handle());
 		return this->value(a->get_type(), ret);
 	}
 	
 	omis_value_t *omis_module_t::b_and(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::AND, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->b_and(a->get_handle(), b->get_handle());
 		return this->value(a->get_type(), ret);
 	}
 	
 	omis_value_t *omis_module_t::b_or(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::OR, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->b_or(a->get_handle(), b->get_handle());
 		return this->value(a->get_type(), ret);
 	}
 	
 	omis_value_t *omis_module_t::b_xor(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::XOR, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->b_xor(a->get_handle(), b->get_handle());
 		return this->value(a->get_type(), ret);
 	}
 	
 	omis_value_t *omis_module_t::b_shl(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::SHL, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->b_shl(a->get_handle(), b->get_handle());
 		return this->value(a->get_type(), ret);
 	}
 	
 	omis_value_t *omis_module_t::b_shr(omis_value_t *a, omis_value_t *b) {
+		auto folded = this->fold_binary(omis_fold_op_t::SHR, a, b);
+		if (folded != nullptr)
+			return folded;
+		
 		auto ret = bridge->b_shr(a->get_handle(), b->get_handle());
 		return this->value(a->get_type(), ret);
 	}
@@ -666,6 +1459,15 @@ namespace eokas {
 		return this->value(ret);
 	}
 	
+	omis_value_t *omis_module_t::jump_switch(omis_value_t *value, omis_value_t *other, const std::vector<std::pair<omis_value_t *, omis_value_t *>> &cases) {
+		std::vector<std::pair<omis_handle_t, omis_handle_t>> cases_handles;
+		for (auto &pair: cases) {
+			cases_handles.push_back(std::make_pair(pair.first->get_handle(), pair.second->get_handle()));
+		}
+		auto ret = bridge->jump_switch(value->get_handle(), other->get_handle(), cases_handles);
+		return this->value(ret);
+	}
+	
 	omis_value_t *omis_module_t::phi(omis_type_t *type, const std::map<omis_value_t *, omis_value_t *> &incomings) {
 		std::map<omis_handle_t, omis_handle_t> incomings_handles;
 		for (auto &pair : incomings) {
@@ -675,13 +1477,34 @@ namespace eokas {
 		return this->value(ret);
 	}
 	
+	omis_value_t *omis_module_t::select(omis_value_t *cond, omis_value_t *a, omis_value_t *b) {
+		i64_t val = 0;
+		if (this->get_const_int(cond, val))
+			return val != 0 ? a : b;
+		if (this->equals_value(a, b))
+			return a;
+		
+		// c ? true : false => c, c ? false : true => !c
+		i64_t val_a = 0, val_b = 0;
+		if (this->equals_type(a->get_type(), this->type_bool()) &&
+			this->get_const_int(a, val_a) && this->get_const_int(b, val_b)) {
+			return val_a != 0 ? cond : this->l_not(cond);
+		}
+		
+		auto ret = bridge->select(cond->get_handle(), a->get_handle(), b->get_handle());
+		return this->value(a->get_type(), ret);
+	}
+	
 	omis_value_t *omis_module_t::call(omis_value_t *func, const std::vector<omis_value_t *> &args) {
 		std::vector<omis_handle_t> args_values;
 		for (auto &arg : args) {
 			args_values.push_back(arg->get_handle());
 		}
 		auto ret = bridge->call(func->get_handle(), args_values);
-		return this->value(ret);
+		auto val = this->value(ret);
+		if (this->is_gc_ref(val->get_type()))
+			this->gc_root(val);
+		return val;
 	}
 	
 	omis_value_t *omis_module_t::call(const String &func_name, const std::vector<omis_value_t *> &args) {
@@ -704,6 +1527,476 @@ namespace eokas {
 		return this->value(ret);
 	}
 	
+	/**
+	 * Float literals are always f64, re-type one to the float type the context expects.
+	 * Returns nullptr when the value is not a float constant or the type is not a float type.
+	 * */
+	omis_value_t *omis_module_t::cast_const_float(omis_value_t *value, omis_type_t *type) {
+		f64_t val = 0;
+		if (!this->get_const_float(value, val))
+			return nullptr;
+		if (!this->equals_type(type, this->type_f32()) && !this->equals_type(type, this->type_f64()))
+			return nullptr;
+		auto ret = bridge->fp_cast(value->get_handle(), type->get_handle());
+		return this->value(type, ret);
+	}
+	
+	/**
+	 * Integer literals are i32 or i64, re-type one to the integer type the context expects.
+	 * Returns nullptr when the value is not an integer constant, the type is not an integer type
+	 * or the value does not fit into it.
+	 * */
+	omis_value_t *omis_module_t::cast_const_int(omis_value_t *value, omis_type_t *type) {
+		i64_t val = 0;
+		if (!this->get_const_int(value, val) || this->equals_type(value->get_type(), this->type_bool()))
+			return nullptr;
+		u32_t bits = 0;
+		if (this->equals_type(type, this->type_i8()))
+			bits = 8;
+		else if (this->equals_type(type, this->type_i16()))
+			bits = 16;
+		else if (this->equals_type(type, this->type_i32()))
+			bits = 32;
+		else if (this->equals_type(type, this->type_i64()))
+			bits = 64;
+		if (bits == 0)
+			return nullptr;
+		if (bits < 64) {
+			i64_t limit = i64_t(1) << (bits - 1);
+			if (val < -limit || val >= limit * 2)
+				return nullptr;
+		}
+		return this->value_integer((u64_t) val, bits);
+	}
+	
+	omis_value_t *omis_module_t::make_closure(omis_struct_t *env, omis_value_t *code, const std::vector<omis_value_t *> &captures) {
+		auto record = this->make(env);
+		if (record == nullptr)
+			return nullptr;
+		this->store(this->gep_struct(record, env, 0), code);
+		for (u32_t index = 0; index < captures.size(); index++) {
+			this->store(this->gep_struct(record, env, index + 1), captures.at(index));
+		}
+		return this->bitcast(record, env->get_base()->get_pointer_type());
+	}
+	
+	omis_value_t *omis_module_t::get_closure_code(omis_value_t *closure) {
+		auto type = this->get_closure_type(closure->get_type());
+		if (type == nullptr)
+			return nullptr;
+		return this->load(this->gep_struct(closure, type, 0));
+	}
+	
+	omis_value_t *omis_module_t::call_closure(omis_value_t *code, omis_value_t *closure, const std::vector<omis_value_t *> &args) {
+		std::vector<omis_handle_t> args_values;
+		for (auto &arg : args) {
+			args_values.push_back(arg->get_handle());
+		}
+		auto env = this->bitcast(closure, this->type_bytes());
+		auto ret = bridge->call_closure(code->get_handle(), env->get_handle(), args_values);
+		auto val = this->value(ret);
+		if (this->is_gc_ref(val->get_type()))
+			this->gc_root(val);
+		return val;
+	}
+	
+	/**
+	 * A function capturing nothing where a closure is expected, it gets a constant record.
+	 * Returns nullptr when the value is not a function, the type is not a closure
+	 * or their signatures differ.
+	 * */
+	omis_value_t *omis_module_t::cast_closure(omis_value_t *value, omis_type_t *type) {
+		auto closure = this->get_closure_type(type);
+		if (closure == nullptr || !bridge->is_value_func(value->get_handle()) || !bridge->is_value_const(value->get_handle()))
+			return nullptr;
+		auto ret = bridge->closure_of(this->handle, closure->get_handle(), value->get_handle());
+		if (ret == nullptr)
+			return nullptr;
+		return this->value(type, ret);
+	}
+	
+	omis_value_t *omis_module_t::gep_struct(omis_value_t *ptr, omis_struct_t *type, u32_t index) {
+		auto member = type->get_member(index);
+		if (member == nullptr)
+			return nullptr;
+		auto ret = bridge->gep_struct(type->get_handle(), ptr->get_handle(), member->field);
+		return this->value(ret);
+	}
+	
+	omis_value_t *omis_module_t::gep_array(omis_value_t *ptr, omis_array_t *type, omis_value_t *index) {
+		if (type->is_dynamic()) {
+			auto items = this->load(this->value(bridge->gep_struct(type->get_handle(), ptr->get_handle(), 2)));
+			auto ret = bridge->gep(type->get_item_type()->get_handle(), items->get_handle(), index->get_handle());
+			return this->value(ret);
+		}
+		auto ret = bridge->gep_array(type->get_handle(), ptr->get_handle(), index->get_handle());
+		return this->value(ret);
+	}
+	
+	/**
+	 * Emits the bounds check of 'a[index]'. Constant indexes into fixed-size arrays
+	 * and vectors are checked right here, returns false if one is out of bounds.
+	 * */
+	bool omis_module_t::check_index(omis_value_t *ptr, omis_value_t *index) {
+		auto length = this->array_length(ptr);
+		if (length == nullptr)
+			return false;
+		
+		i64_t val = 0, count = 0;
+		if (this->get_const_int(index, val) && this->get_const_int(length, count)) {
+			if (val >= 0 && val < count)
+				return true;
+			printf("ERROR: The index %lld is out of the bounds of an array of length %lld.\n", (long long) val, (long long) count);
+			return false;
+		}
+		
+		bridge->check_bounds(this->handle, index->get_handle(), length->get_handle());
+		return true;
+	}
+	
+	omis_value_t *omis_module_t::array_length(omis_value_t *ptr) {
+		if (dynamic_cast<omis_slice_t *>(ptr->get_type()) != nullptr)
+			return this->value(bridge->extract_value(ptr->get_handle(), 1));
+		auto vector_type = dynamic_cast<omis_vector_t *>(ptr->get_type());
+		if (vector_type == nullptr)
+			vector_type = dynamic_cast<omis_vector_t *>(ptr->get_type()->get_element_type());
+		if (vector_type != nullptr)
+			return this->value_integer(vector_type->get_length(), 64);
+		auto type = dynamic_cast<omis_array_t *>(ptr->get_type()->get_element_type());
+		if (type == nullptr) {
+			printf("ERROR: The value is not an array.\n");
+			return nullptr;
+		}
+		if (!type->is_dynamic())
+			return this->value_integer(type->get_length(), 64);
+		auto field = bridge->gep_struct(type->get_handle(), ptr->get_handle(), 0);
+		return this->load(this->value(field));
+	}
+	
+	/**
+	 * Appends in place while there is room, the runtime only grows the items when there is not.
+	 * */
+	omis_value_t *omis_module_t::array_append(omis_value_t *ptr, omis_value_t *value) {
+		auto type = dynamic_cast<omis_array_t *>(ptr->get_type()->get_element_type());
+		if (type == nullptr || !type->is_dynamic()) {
+			printf("ERROR: Only growable arrays can be appended to.\n");
+			return nullptr;
+		}
+		
+		auto item_type = type->get_item_type();
+		auto narrowed = this->cast_const_float(value, item_type);
+		if (narrowed == nullptr)
+			narrowed = this->cast_const_int(value, item_type);
+		if (narrowed != nullptr)
+			value = narrowed;
+		// Struct items are stored inline, the object is copied into the array.
+		if ((item_type->is_type_struct() || item_type->is_type_array()) && this->equals_type(value->get_type(), item_type->get_pointer_type()))
+			value = this->load(value);
+		if (!this->equals_type(value->get_type(), item_type)) {
+			printf("ERROR: The value does not match the item type of the array.\n");
+			return nullptr;
+		}
+		
+		auto length_ptr = this->value(bridge->gep_struct(type->get_handle(), ptr->get_handle(), 0));
+		auto capacity_ptr = this->value(bridge->gep_struct(type->get_handle(), ptr->get_handle(), 1));
+		auto length = this->load(length_ptr);
+		auto capacity = this->load(capacity_ptr);
+		
+		auto append_grow = this->create_block("append.grow");
+		auto append_store = this->create_block("append.store");
+		this->jump_cond(this->eq(length, capacity), append_grow, append_store);
+		
+		this->set_active_block(append_grow);
+		auto reserve = this->value_builtin("eokas_array_reserve", this->type_func(this->type_void(), {this->type_bytes(), this->type_i64(), this->type_i64()}, false));
+		if (reserve == nullptr)
+			return nullptr;
+		this->call(reserve, {this->bitcast(ptr, this->type_bytes()), this->get_type_size(item_type), this->add(length, this->value_integer(1, 64))});
+		this->jump(append_store);
+		
+		this->set_active_block(append_store);
+		this->store(this->gep_array(ptr, type, length), value);
+		return this->store(length_ptr, this->add(length, this->value_integer(1, 64)));
+	}
+	
+	/**
+	 * Initializes an array made for a literal. Constant items are copied from
+	 * a read-only global in one go, the others are stored one by one.
+	 * */
+	omis_value_t *omis_module_t::array_fill(omis_value_t *ptr, omis_array_t *type, const std::vector<omis_value_t *> &items) {
+		auto item_type = type->get_item_type();
+		auto count = this->value_integer(items.size(), 64);
+		
+		if (type->is_dynamic()) {
+			auto reserve = this->value_builtin("eokas_array_reserve", this->type_func(this->type_void(), {this->type_bytes(), this->type_i64(), this->type_i64()}, false));
+			if (reserve == nullptr)
+				return nullptr;
+			this->call(reserve, {this->bitcast(ptr, this->type_bytes()), this->get_type_size(item_type), count});
+			this->store(this->value(bridge->gep_struct(type->get_handle(), ptr->get_handle(), 0)), count);
+		}
+		
+		bool constant = !items.empty();
+		for (auto &item: items) {
+			i64_t ival = 0;
+			f64_t fval = 0;
+			constant = constant && (this->get_const_int(item, ival) || this->get_const_float(item, fval));
+		}
+		if (constant) {
+			auto values = this->value_array(item_type, items);
+			if (values != nullptr) {
+				auto dst = ptr;
+				if (type->is_dynamic())
+					dst = this->load(this->value(bridge->gep_struct(type->get_handle(), ptr->get_handle(), 2)));
+				return this->copy(dst, values, this->mul(this->get_type_size(item_type), count));
+			}
+		}
+		
+		for (size_t index = 0; index < items.size(); index++) {
+			this->store(this->gep_array(ptr, type, this->value_integer(index, 64)), items.at(index));
+		}
+		return ptr;
+	}
+	
+	/**
+	 * 'a[begin..end]', the items [begin, end) of an array or a slice, without copying them.
+	 * A null begin is the first item and a null end is the length.
+	 * A slice of a growable array points into its current items, 'append' may move them,
+	 * so a slice taken before an 'append' to its array must not be used after it.
+	 * */
+	omis_value_t *omis_module_t::slice(omis_value_t *value, omis_value_t *begin, omis_value_t *end) {
+		auto i64 = this->type_i64();
+		omis_type_t *item_type = nullptr;
+		omis_value_t *items = nullptr;
+		omis_value_t *length = nullptr;
+		
+		auto slice_type = dynamic_cast<omis_slice_t *>(value->get_type());
+		auto array_type = dynamic_cast<omis_array_t *>(value->get_type()->get_element_type());
+		if (slice_type != nullptr) {
+			item_type = slice_type->get_item_type();
+			items = this->value(bridge->extract_value(value->get_handle(), 0));
+			length = this->value(bridge->extract_value(value->get_handle(), 1));
+		} else if (array_type != nullptr) {
+			if (array_type->is_soa()) {
+				printf("ERROR: A '#soa' array can not be sliced.\n");
+				return nullptr;
+			}
+			item_type = array_type->get_item_type();
+			if (array_type->is_dynamic())
+				items = this->load(this->value(bridge->gep_struct(array_type->get_handle(), value->get_handle(), 2)));
+			else
+				items = this->gep_array(value, array_type, this->value_integer(0, 64));
+			length = this->array_length(value);
+			// A slice passed on at once is rooted nowhere, this function keeps a collected array alive meanwhile.
+			if (this->is_gc_ref(value->get_type()))
+				this->gc_root(value);
+		} else {
+			printf("ERROR: Only arrays and slices can be sliced.\n");
+			return nullptr;
+		}
+		
+		for (auto bound: {begin, end}) {
+			if (bound != nullptr && this->get_int_bits(bound->get_type()) == 0) {
+				printf("ERROR: The bounds of a slice must be integers.\n");
+				return nullptr;
+			}
+		}
+		begin = begin != nullptr ? this->value(bridge->int_cast(begin->get_handle(), i64->get_handle())) : nullptr;
+		end = end != nullptr ? this->value(bridge->int_cast(end->get_handle(), i64->get_handle())) : nullptr;
+		
+		// The bounds of a fixed-size array are checked right here when they are constants.
+		i64_t lo = 0, hi = 0;
+		bool constant = array_type != nullptr && !array_type->is_dynamic() &&
+						(begin == nullptr || this->get_const_int(begin, lo)) &&
+						(end == nullptr || this->get_const_int(end, hi));
+		if (constant) {
+			if (end == nullptr)
+				hi = (i64_t) array_type->get_length();
+			if (lo < 0 || lo > hi || (u64_t) hi > array_type->get_length()) {
+				printf("ERROR: The range [%lld, %lld) is out of the bounds of an array of length %llu.\n", (long long) lo, (long long) hi, (unsigned long long) array_type->get_length());
+				return nullptr;
+			}
+		}
+		
+		bool whole = begin == nullptr && end == nullptr;
+		if (begin == nullptr)
+			begin = this->value_integer(0, 64);
+		if (end == nullptr)
+			end = length;
+		if (!constant && !whole)
+			bridge->check_range(this->handle, begin->get_handle(), end->get_handle(), length->get_handle());
+		
+		auto type = this->type_slice(item_type);
+		auto first = bridge->gep(item_type->get_handle(), items->get_handle(), begin->get_handle());
+		auto ret = bridge->insert_value(type->get_default_value()->get_handle(), first, 0);
+		ret = bridge->insert_value(ret, this->sub(end, begin)->get_handle(), 1);
+		return this->value(ret);
+	}
+	
+	omis_value_t *omis_module_t::gep_slice(omis_value_t *slice, omis_value_t *index) {
+		auto type = dynamic_cast<omis_slice_t *>(slice->get_type());
+		if (type == nullptr)
+			return nullptr;
+		auto items = bridge->extract_value(slice->get_handle(), 0);
+		auto ret = bridge->gep(type->get_item_type()->get_handle(), items, index->get_handle());
+		return this->value(ret);
+	}
+	
+	/**
+	 * Arrays pass as slices of all their items where a slice is expected,
+	 * returns null if the value is not such an array.
+	 * */
+	omis_value_t *omis_module_t::cast_slice(omis_value_t *value, omis_type_t *type) {
+		auto slice_type = dynamic_cast<omis_slice_t *>(type);
+		auto array_type = dynamic_cast<omis_array_t *>(value->get_type()->get_element_type());
+		if (slice_type == nullptr || array_type == nullptr || array_type->is_soa())
+			return nullptr;
+		if (!this->equals_type(array_type->get_item_type(), slice_type->get_item_type()))
+			return nullptr;
+		return this->slice(value, nullptr, nullptr);
+	}
+	
+	/**
+	 * Lane 'index' of a vector. A vector in a variable gives the address of the lane,
+	 * so it can be assigned to, a vector value gives the lane itself.
+	 * */
+	omis_value_t *omis_module_t::vector_lane(omis_value_t *vec, omis_value_t *index) {
+		auto slot_type = dynamic_cast<omis_vector_t *>(vec->get_type()->get_element_type());
+		if (slot_type != nullptr)
+			return this->value(bridge->gep_array(slot_type->get_handle(), vec->get_handle(), index->get_handle()));
+		if (dynamic_cast<omis_vector_t *>(vec->get_type()) != nullptr)
+			return this->value(bridge->extract_element(vec->get_handle(), index->get_handle()));
+		printf("ERROR: The value is not a vector.\n");
+		return nullptr;
+	}
+	
+	/**
+	 * The lanes of a picked from a and b, lane i of b is lane 'length + i'.
+	 * The result has as many lanes as there are indexes.
+	 * */
+	omis_value_t *omis_module_t::shuffle(omis_value_t *a, omis_value_t *b, const std::vector<int> &lanes) {
+		auto type = dynamic_cast<omis_vector_t *>(a->get_type());
+		if (type == nullptr || (b != nullptr && !this->equals_type(type, b->get_type()))) {
+			printf("ERROR: Only vectors of the same type can be shuffled.\n");
+			return nullptr;
+		}
+		
+		int count = (int) type->get_length() * (b != nullptr ? 2 : 1);
+		for (auto lane: lanes) {
+			if (lane < 0 || lane >= count) {
+				printf("ERROR: The lane %d is out of the bounds of the shuffled vectors.\n", lane);
+				return nullptr;
+			}
+		}
+		if (this->type_vector(type->get_item_type(), (u32_t) lanes.size()) == nullptr)
+			return nullptr;
+		
+		auto other = b != nullptr ? b : type->get_default_value();
+		auto ret = bridge->shuffle(a->get_handle(), other->get_handle(), lanes);
+		return this->value(ret);
+	}
+	
+	omis_value_t *omis_module_t::reduce(omis_reduce_op_t op, omis_value_t *vec) {
+		auto type = dynamic_cast<omis_vector_t *>(vec->get_type());
+		if (type == nullptr) {
+			printf("ERROR: Only vectors can be reduced.\n");
+			return nullptr;
+		}
+		auto ret = bridge->reduce(op, vec->get_handle());
+		return this->value(ret);
+	}
+	
+	/**
+	 * A scalar is repeated in every lane where a vector is expected,
+	 * returns null if the value is neither such a scalar nor a vector of the type.
+	 * */
+	omis_value_t *omis_module_t::cast_vector(omis_value_t *value, omis_type_t *type) {
+		auto vector_type = dynamic_cast<omis_vector_t *>(type);
+		if (vector_type == nullptr || dynamic_cast<omis_vector_t *>(value->get_type()) != nullptr)
+			return nullptr;
+		auto item = this->cast_vector_item(value, vector_type->get_item_type());
+		if (item == nullptr)
+			return nullptr;
+		auto ret = bridge->splat(item->get_handle(), vector_type->get_length());
+		return this->value(type, ret);
+	}
+	
+	omis_value_t *omis_module_t::copy(omis_value_t *dst, omis_value_t *src, omis_value_t *size) {
+		auto ret = bridge->copy(dst->get_handle(), src->get_handle(), size->get_handle());
+		return this->value(this->type_void(), ret);
+	}
+	
+	/**
+	 * The address of member 'member' of element 'index' in a '#soa' array,
+	 * the element is found in the column of that member.
+	 * */
+	omis_value_t *omis_module_t::gep_soa(omis_value_t *ptr, omis_array_t *type, u32_t member, omis_value_t *index) {
+		auto struct_type = dynamic_cast<omis_struct_t *>(type->get_item_type());
+		auto struct_member = struct_type != nullptr ? struct_type->get_member(member) : nullptr;
+		if (struct_member == nullptr)
+			return nullptr;
+		auto column = bridge->gep_struct(type->get_handle(), ptr->get_handle(), member);
+		auto column_type = bridge->type_array(struct_member->type->get_handle(), type->get_length());
+		auto ret = bridge->gep_array(column_type, column, index->get_handle());
+		return this->value(ret);
+	}
+	
+	/**
+	 * Keep a reference in a shadow-stack slot, so the collector sees it
+	 * as long as the function runs, even if it only lives in a register.
+	 * */
+	omis_value_t *omis_module_t::gc_root(omis_value_t *value) {
+		// A slice keeps the array alive through the pointer to its items.
+		if (dynamic_cast<omis_slice_t *>(value->get_type()) != nullptr)
+			value = this->value(bridge->extract_value(value->get_handle(), 0));
+		auto slot = bridge->gc_root(value->get_type()->get_handle(), "");
+		bridge->store(slot, value->get_handle());
+		return this->value(slot);
+	}
+	
+	// The top scope of '$main', not the blocks in it.
+	bool omis_module_t::is_module_scope(omis_scope_t *scope) {
+		return scope->parent == this->root;
+	}
+	
+	/**
+	 * A constant value becomes the initializer of the global, any other value
+	 * is stored by the code running at this point of '$main'.
+	 * A global holding an object is a root the collector has to see.
+	 * */
+	omis_value_t *omis_module_t::global(const String &name, omis_type_t *type, omis_value_t *value, bool variable) {
+		bool constant = bridge->is_value_const(value->get_handle());
+		auto ptr = bridge->value_global(this->handle, name, type->get_handle(), constant ? value->get_handle() : nullptr, constant && !variable);
+		if (this->is_gc_ref(type)) {
+			auto add_root = this->value_builtin("eokas_gc_add_root", this->type_func(this->type_void(), {this->type_bytes()}, false));
+			if (add_root == nullptr)
+				return nullptr;
+			this->call(add_root, {this->bitcast(this->value(ptr), this->type_bytes())});
+		}
+		if (!constant)
+			bridge->store(ptr, value->get_handle());
+		return this->value(ptr);
+	}
+	
+	// The C++ type_info which exceptions of the struct are thrown and caught with, named after the module declaring it.
+	omis_value_t *omis_module_t::type_info(omis_struct_t *type) {
+		omis_handle_t base = nullptr;
+		if (type->get_base() != nullptr)
+			base = this->type_info(type->get_base())->get_handle();
+		auto owner = type->get_module() != nullptr ? type->get_module() : this;
+		return this->value(bridge->type_info(this->handle, owner->get_name(), type->get_handle(), base));
+	}
+	
+	bool omis_module_t::is_gc_ref(omis_type_t *type) {
+		if (!options.gc)
+			return false;
+		if (dynamic_cast<omis_slice_t *>(type) != nullptr)
+			return true;
+		auto element = type->get_element_type();
+		auto array_type = dynamic_cast<omis_array_t *>(element);
+		if (array_type != nullptr && array_type->is_dynamic())
+			return false;
+		return element != nullptr && (element->is_type_struct() || element->is_type_array());
+	}
+	
 	omis_value_t *omis_module_t::get_ptr_val(omis_value_t *ptr) {
 		auto ret = bridge->get_ptr_val(ptr->get_handle());
 		return this->value(ret);
@@ -715,31 +2008,144 @@ namespace eokas {
 	}
 	
 	omis_value_t *omis_module_t::make(omis_type_t *type) {
-		auto len = this->get_type_size(type);
-		auto ptr = this->call("malloc", {len});
+		// The runtime hands out 16-byte aligned blocks, over-aligned structs are allocated on their own.
+		auto struct_type = dynamic_cast<omis_struct_t *>(type);
+		bool aligned = struct_type != nullptr && struct_type->get_align() > 16;
 		
-		auto cond = [&]() -> omis_value_t * {
-			return this->eq(ptr, this->value_integer(0, 64));
-		};
-		auto body = [&]() -> bool {
-			return true;
-		};
-		this->stmt_branch(cond, body, nullptr);
+		if (this->is_gc_ref(type->get_pointer_type())) {
+			auto desc = this->value(bridge->gc_type_descriptor(this->handle, type->get_handle()));
+			omis_value_t *ptr = nullptr;
+			if (aligned) {
+				auto alloc = this->value_builtin("eokas_gc_alloc_aligned", this->type_func(this->type_bytes(), {this->type_bytes(), this->type_i64()}, false));
+				if (alloc == nullptr)
+					return nullptr;
+				ptr = this->call(alloc, {desc, this->value_integer(struct_type->get_align(), 64)});
+			} else {
+				auto alloc = this->value_builtin("eokas_gc_alloc", this->type_func(this->type_bytes(), {this->type_bytes()}, false));
+				if (alloc == nullptr)
+					return nullptr;
+				ptr = this->call(alloc, {desc});
+			}
+			auto val = this->bitcast(ptr, type->get_pointer_type());
+			this->gc_root(val);
+			return val;
+		}
+		
+		if (aligned) {
+			auto aligned_alloc = this->value_builtin("aligned_alloc", this->type_func(this->type_bytes(), {this->type_i64(), this->type_i64()}, false));
+			if (aligned_alloc == nullptr)
+				return nullptr;
+			auto ptr = this->call(aligned_alloc, {this->value_integer(struct_type->get_align(), 64), this->get_type_size(type)});
+			return this->bitcast(ptr, type->get_pointer_type());
+		}
+		
+		// Small objects come from the runtime's per-thread size class lists.
+		auto size_class = eokas_size_class(bridge->get_type_alloc_size(type->get_handle()));
+		if (size_class != EOKAS_SIZE_CLASS_NONE) {
+			auto alloc = this->value_builtin("eokas_alloc", this->type_func(this->type_bytes(), {this->type_i32()}, false));
+			if (alloc == nullptr)
+				return nullptr;
+			auto ptr = this->call(alloc, {this->value_integer(size_class, 32)});
+			return this->bitcast(ptr, type->get_pointer_type());
+		}
 		
-		auto val = this->bitcast(ptr, type);
+		auto malloc = this->value_builtin("malloc", this->type_func(this->type_bytes(), {this->type_i64()}, false));
+		if (malloc == nullptr)
+			return nullptr;
+		auto len = this->get_type_size(type);
+		auto ptr = this->call(malloc, {len});
+		auto val = this->bitcast(ptr, type->get_pointer_type());
 		return val;
 	}
 	
+	/**
+	 * The size class 'count' items of the type are served from, a constant count can fit one.
+	 * make(type, count) and drop(ptr, count) both decide by it, so a block goes back where it came from.
+	 * */
+	u32_t omis_module_t::get_size_class(omis_type_t *type, omis_value_t *count) {
+		i64_t val = 0;
+		auto struct_type = dynamic_cast<omis_struct_t *>(type);
+		bool aligned = struct_type != nullptr && struct_type->get_align() > 16;
+		if (type == nullptr || aligned || !this->get_const_int(count, val) || val <= 0)
+			return EOKAS_SIZE_CLASS_NONE;
+		auto size = bridge->get_type_alloc_size(type->get_handle());
+		if (size != 0 && (u64_t) val > UINT64_MAX / size)
+			return EOKAS_SIZE_CLASS_NONE;
+		return eokas_size_class(size * (u64_t) val);
+	}
+	
 	omis_value_t *omis_module_t::make(omis_type_t *type, omis_value_t *count) {
+		auto size_class = this->get_size_class(type, count);
+		if (size_class != EOKAS_SIZE_CLASS_NONE) {
+			auto alloc = this->value_builtin("eokas_alloc", this->type_func(this->type_bytes(), {this->type_i32()}, false));
+			if (alloc == nullptr)
+				return nullptr;
+			auto ptr = this->call(alloc, {this->value_integer(size_class, 32)});
+			return this->bitcast(ptr, type->get_pointer_type());
+		}
+		
+		auto malloc = this->value_builtin("malloc", this->type_func(this->type_bytes(), {this->type_i64()}, false));
+		if (malloc == nullptr)
+			return nullptr;
 		auto stride = this->get_type_size(type);
 		auto len = this->mul(stride, count);
-		auto ptr = this->call("malloc", {len});
-		auto val = this->bitcast(ptr, type);
+		auto ptr = this->call(malloc, {len});
+		auto val = this->bitcast(ptr, type->get_pointer_type());
 		return val;
 	}
 	
 	omis_value_t *omis_module_t::drop(omis_value_t *ptr) {
-		return this->call("free", {ptr});
+		// Collected objects are never freed by hand.
+		if (this->is_gc_ref(ptr->get_type()))
+			return nullptr;
+		
+		auto bytes = this->bitcast(ptr, this->type_bytes());
+		
+		auto array_type = dynamic_cast<omis_array_t *>(ptr->get_type()->get_element_type());
+		if (array_type != nullptr && array_type->is_dynamic()) {
+			auto release = this->value_builtin("eokas_array_release", this->type_func(this->type_void(), {this->type_bytes()}, false));
+			if (release == nullptr)
+				return nullptr;
+			this->call(release, {bytes});
+		}
+		
+		// Give the object back to the size class make(type) took it from, over-aligned structs came from aligned_alloc.
+		// Items of make(type, count) are freed by drop(ptr, count) instead.
+		auto type = ptr->get_type()->get_element_type();
+		auto struct_type = dynamic_cast<omis_struct_t *>(type);
+		bool aligned = struct_type != nullptr && struct_type->get_align() > 16;
+		auto size_class = type != nullptr && !aligned ? eokas_size_class(bridge->get_type_alloc_size(type->get_handle())) : EOKAS_SIZE_CLASS_NONE;
+		if (size_class != EOKAS_SIZE_CLASS_NONE) {
+			auto free = this->value_builtin("eokas_free", this->type_func(this->type_void(), {this->type_bytes(), this->type_i32()}, false));
+			if (free == nullptr)
+				return nullptr;
+			return this->call(free, {bytes, this->value_integer(size_class, 32)});
+		}
+		
+		auto free = this->value_builtin("free", this->type_func(this->type_void(), {this->type_bytes()}, false));
+		if (free == nullptr)
+			return nullptr;
+		return this->call(free, {bytes});
+	}
+	
+	/**
+	 * Frees the items make(type, count) allocated, the count must be the one they were made with.
+	 * */
+	omis_value_t *omis_module_t::drop(omis_value_t *ptr, omis_value_t *count) {
+		auto bytes = this->bitcast(ptr, this->type_bytes());
+		
+		auto size_class = this->get_size_class(ptr->get_type()->get_element_type(), count);
+		if (size_class != EOKAS_SIZE_CLASS_NONE) {
+			auto free = this->value_builtin("eokas_free", this->type_func(this->type_void(), {this->type_bytes(), this->type_i32()}, false));
+			if (free == nullptr)
+				return nullptr;
+			return this->call(free, {bytes, this->value_integer(size_class, 32)});
+		}
+		
+		auto free = this->value_builtin("free", this->type_func(this->type_void(), {this->type_bytes()}, false));
+		if (free == nullptr)
+			return nullptr;
+		return this->call(free, {bytes});
 	}
 	
 	omis_value_t * omis_module_t::expr_branch(const omis_lambda_expr_t &lambda_cond, const omis_lambda_expr_t &lambda_true, const omis_lambda_expr_t &lambda_false) {
@@ -766,6 +2172,7 @@ namespace eokas {
 		if (true_val == nullptr)
 			return nullptr;
 		true_val = this->get_ptr_val(true_val);
+		auto true_tail = this->get_active_block();
 		this->jump(trinary_end);
 		
 		this->set_active_block(trinary_false);
@@ -773,6 +2180,7 @@ namespace eokas {
 		if (false_val == nullptr)
 			return nullptr;
 		false_val = this->get_ptr_val(false_val);
+		auto false_tail = this->get_active_block();
 		this->jump(trinary_end);
 		
 		this->set_active_block(trinary_end);
@@ -781,9 +2189,118 @@ namespace eokas {
 			return nullptr;
 		}
 		
+		if (this->equals_value(true_val, false_val))
+			return true_val;
+		
+		// The arms may have opened blocks of their own (nested trinary or
+		// short-circuit expressions), so the incomings are the arm tails.
 		auto phi = this->phi(true_val->get_type(), {
-			{true_val,  trinary_true},
-			{false_val, trinary_false}
+			{true_val,  true_tail},
+			{false_val, false_tail}
+		});
+		
+		return phi;
+	}
+	
+	/**
+	 * Evaluate both arms unconditionally and pick one with a select.
+	 * The caller is responsible for the arms being free of side effects.
+	 * */
+	omis_value_t *omis_module_t::expr_select(const omis_lambda_expr_t &lambda_cond, const omis_lambda_expr_t &lambda_true, const omis_lambda_expr_t &lambda_false) {
+		auto *cond = lambda_cond();
+		if (cond == nullptr)
+			return nullptr;
+		cond = this->get_ptr_val(cond);
+		if (!this->equals_type(cond->get_type(), this->type_bool())) {
+			printf("ERROR: Condition must be a bool value.\n");
+			return nullptr;
+		}
+		
+		auto *true_val = lambda_true();
+		if (true_val == nullptr)
+			return nullptr;
+		true_val = this->get_ptr_val(true_val);
+		
+		auto *false_val = lambda_false();
+		if (false_val == nullptr)
+			return nullptr;
+		false_val = this->get_ptr_val(false_val);
+		
+		if (!this->equals_type(true_val->get_type(), false_val->get_type())) {
+			printf("ERROR: Type of true-branch must be the same as false-branch.\n");
+			return nullptr;
+		}
+		
+		return this->select(cond, true_val, false_val);
+	}
+	
+	omis_value_t *omis_module_t::expr_and(const omis_lambda_expr_t &lambda_lhs, const omis_lambda_expr_t &lambda_rhs) {
+		return this->expr_short_circuit(true, lambda_lhs, lambda_rhs);
+	}
+	
+	omis_value_t *omis_module_t::expr_or(const omis_lambda_expr_t &lambda_lhs, const omis_lambda_expr_t &lambda_rhs) {
+		return this->expr_short_circuit(false, lambda_lhs, lambda_rhs);
+	}
+	
+	/**
+	 * Lower 'lhs && rhs' / 'lhs || rhs' so that rhs is only evaluated when lhs
+	 * does not already decide the result. The lhs is always evaluated first.
+	 * */
+	omis_value_t *omis_module_t::expr_short_circuit(bool is_and, const omis_lambda_expr_t &lambda_lhs, const omis_lambda_expr_t &lambda_rhs) {
+		auto *lhs = lambda_lhs();
+		if (lhs == nullptr)
+			return nullptr;
+		lhs = this->get_ptr_val(lhs);
+		if (!this->equals_type(lhs->get_type(), this->type_bool())) {
+			printf("ERROR: Operands of logic operators must be bool values.\n");
+			return nullptr;
+		}
+		
+		// A constant lhs either decides the result or reduces to rhs.
+		i64_t lhs_const = 0;
+		if (this->get_const_int(lhs, lhs_const)) {
+			if ((lhs_const != 0) != is_and)
+				return lhs;
+			auto *rhs = lambda_rhs();
+			if (rhs == nullptr)
+				return nullptr;
+			rhs = this->get_ptr_val(rhs);
+			if (!this->equals_type(rhs->get_type(), this->type_bool())) {
+				printf("ERROR: Operands of logic operators must be bool values.\n");
+				return nullptr;
+			}
+			return rhs;
+		}
+		
+		auto lhs_tail = this->get_active_block();
+		auto logic_rhs = this->create_block(is_and ? "and.rhs" : "or.rhs");
+		auto logic_end = this->create_block(is_and ? "and.end" : "or.end");
+		
+		if (is_and)
+			this->jump_cond(lhs, logic_rhs, logic_end);
+		else
+			this->jump_cond(lhs, logic_end, logic_rhs);
+		
+		this->set_active_block(logic_rhs);
+		auto *rhs = lambda_rhs();
+		if (rhs == nullptr)
+			return nullptr;
+		rhs = this->get_ptr_val(rhs);
+		if (!this->equals_type(rhs->get_type(), this->type_bool())) {
+			printf("ERROR: Operands of logic operators must be bool values.\n");
+			return nullptr;
+		}
+		auto rhs_tail = this->get_active_block();
+		this->jump(logic_end);
+		
+		this->set_active_block(logic_end);
+		auto decided = this->value_bool(!is_and);
+		if (this->equals_value(rhs, decided))
+			return decided;
+		
+		auto phi = this->phi(this->type_bool(), {
+			{decided, lhs_tail},
+			{rhs,     rhs_tail}
 		});
 		
 		return phi;
@@ -803,7 +2320,7 @@ namespace eokas {
 		return true;
 	}
 	
-	bool omis_module_t::stmt_symbol_def(const String &name, const std::optional<omis_lambda_type_t> &lambda_type, const omis_lambda_expr_t &lambda_expr) {
+	bool omis_module_t::stmt_symbol_def(const String &name, bool variable, const std::optional<omis_lambda_type_t> &lambda_type, const omis_lambda_expr_t &lambda_expr) {
 		auto exists = this->get_value_symbol(name, false);
 		if (exists != nullptr) {
 			printf("ERROR: The symbol '%s' is aready defined.", name.cstr());
@@ -833,8 +2350,32 @@ namespace eokas {
 			do {
 				if (stype == vtype)
 					break;
+				auto cexpr = this->cast_const_float(expr, stype);
+				if (cexpr != nullptr) {
+					expr = cexpr;
+					vtype = stype;
+					break;
+				}
+				cexpr = this->cast_vector(expr, stype);
+				if (cexpr != nullptr) {
+					expr = cexpr;
+					vtype = stype;
+					break;
+				}
+				cexpr = this->cast_closure(expr, stype);
+				if (cexpr != nullptr) {
+					expr = cexpr;
+					vtype = stype;
+					break;
+				}
 				if (this->can_losslessly_bitcast(vtype, stype))
 					break;
+				cexpr = this->cast_slice(expr, stype);
+				if (cexpr != nullptr) {
+					expr = cexpr;
+					vtype = stype;
+					break;
+				}
 				/*
 				if (vtype->isPointerTy() && vtype->getPointerElementType() == stype) {
 					stype = dtype = vtype;
@@ -856,8 +2397,27 @@ namespace eokas {
 			return false;
 		}
 		
-		auto symbol = this->alloc(name, stype, expr);
-		if (!this->add_value_symbol(name, symbol)) {
+		// Immutable symbols are bound to their SSA value directly,
+		// only mutable ones need a stack slot to be stored into.
+		// Symbols of the module are globals, '$main' is only their init function.
+		// Constant vals still fold wherever they are used, the global exports them.
+		omis_value_t *symbol = nullptr;
+		if (this->is_module_scope(this->scope)) {
+			symbol = stype != vtype ? this->bitcast(expr, stype) : expr;
+			if (variable || !bridge->is_value_const(symbol->get_handle()))
+				symbol = this->global(name, stype, symbol, variable);
+			else if (!bridge->is_value_func(symbol->get_handle()) && this->global(name, stype, symbol, variable) == nullptr)
+				return false;
+			if (symbol == nullptr)
+				return false;
+		} else if (variable) {
+			symbol = this->alloc(name, stype, expr);
+		} else {
+			symbol = stype != vtype ? this->bitcast(expr, stype) : expr;
+			if (this->is_gc_ref(stype))
+				this->gc_root(symbol);
+		}
+		if (!this->add_value_symbol(name, symbol, variable)) {
 			printf("ERROR: There is a symbol named %s in this scope.\n", name.cstr());
 			return false;
 		}
@@ -873,7 +2433,24 @@ namespace eokas {
 		
 		auto ptr = this->get_ptr_ref(lhs);
 		auto val = this->get_ptr_val(rhs);
+		// Literals take the type of the slot, 'a[i].x = 1.0' stores an f32 into an f32 member.
+		auto slot_type = ptr->get_type()->get_element_type();
+		if (slot_type != nullptr) {
+			auto narrowed = this->cast_const_float(val, slot_type);
+			if (narrowed == nullptr)
+				narrowed = this->cast_const_int(val, slot_type);
+			if (narrowed == nullptr)
+				narrowed = this->cast_slice(val, slot_type);
+			if (narrowed == nullptr)
+				narrowed = this->cast_vector(val, slot_type);
+			if (narrowed == nullptr)
+				narrowed = this->cast_closure(val, slot_type);
+			if (narrowed != nullptr)
+				val = narrowed;
+		}
 		this->store(ptr, val);
+		if (dynamic_cast<omis_slice_t *>(val->get_type()) != nullptr && this->is_gc_ref(val->get_type()))
+			this->gc_root(val);
 		
 		return true;
 	}
@@ -904,6 +2481,17 @@ namespace eokas {
 		}
 		expr = this->get_ptr_val(expr);
 		
+		auto cexpr = this->cast_const_float(expr, expected_ret_type);
+		if (cexpr == nullptr)
+			cexpr = this->cast_slice(expr, expected_ret_type);
+		if (cexpr == nullptr)
+			cexpr = this->cast_vector(expr, expected_ret_type);
+		if (cexpr == nullptr)
+			cexpr = this->cast_closure(expr, expected_ret_type);
+		if (cexpr != nullptr) {
+			expr = cexpr;
+		}
+		
 		auto actual_ret_type = expr->get_type();
 		if ((!this->equals_type(actual_ret_type, expected_ret_type)) &&
 			(!this->can_losslessly_bitcast(actual_ret_type, expected_ret_type))) {
@@ -911,6 +2499,11 @@ namespace eokas {
 			return false;
 		}
 		
+		// Returning the result of a call as is makes it a tail call.
+		if (this->equals_type(actual_ret_type, expected_ret_type)) {
+			bridge->mark_tail_call(expr->get_handle());
+		}
+		
 		this->ret(expr);
 		
 		return true;
@@ -966,10 +2559,189 @@ namespace eokas {
 		return true;
 	}
 	
+	/**
+	 * Runs the body of the case listing the value, or 'other' if none does.
+	 * Cases never fall through, so all of them become one switch.
+	 * */
+	bool omis_module_t::stmt_match(const omis_lambda_expr_t &lambda_value,
+								   const std::vector<omis_match_case_t> &cases,
+								   const omis_lambda_stmt_t &lambda_other) {
+		auto value = lambda_value();
+		if (value == nullptr)
+			return false;
+		value = this->get_ptr_val(value);
+		u32_t bits = this->get_int_bits(value->get_type());
+		if (bits == 0) {
+			printf("ERROR: The value of 'match' must be an integer.\n");
+			return false;
+		}
+		
+		auto match_other = this->create_block("match.other");
+		auto match_end = this->create_block("match.end");
+		std::vector<omis_value_t *> bodies;
+		std::vector<std::pair<omis_value_t *, omis_value_t *>> labels;
+		std::set<i64_t> keys;
+		for (auto &match_case: cases) {
+			auto body = this->create_block("match.case");
+			bodies.push_back(body);
+			for (auto &lambda_key: match_case.values) {
+				i64_t key = 0;
+				if (!this->get_const_int(lambda_key(), key)) {
+					printf("ERROR: The cases of 'match' must be constant integers.\n");
+					return false;
+				}
+				// The labels are of the type of the value, -1 and 255 are the same case of an i8.
+				u64_t label = (u64_t) key;
+				if (bits < 64) {
+					i64_t limit = i64_t(1) << (bits - 1);
+					if (key < -limit || key >= limit * 2) {
+						printf("ERROR: The case %lld of 'match' is out of the range of the value.\n", (long long)key);
+						return false;
+					}
+					label &= (u64_t(1) << bits) - 1;
+				}
+				if (!keys.insert((i64_t) label).second) {
+					printf("ERROR: The case %lld of 'match' is listed twice.\n", (long long)key);
+					return false;
+				}
+				labels.push_back(std::make_pair(this->value_integer(key, bits), body));
+			}
+		}
+		this->jump_switch(value, match_other, labels);
+		
+		for (size_t index = 0; index <= cases.size(); index++) {
+			auto block = index < cases.size() ? bodies[index] : match_other;
+			this->set_active_block(block);
+			if (!(index < cases.size() ? cases[index].body() : lambda_other()))
+				return false;
+			if (!this->is_terminator_ins())
+				this->jump(match_end);
+		}
+		
+		this->set_active_block(match_end);
+		
+		return true;
+	}
+	
+	/**
+	 * In the body every call which may throw is an invoke unwinding to the landing pad of the 'try'.
+	 * The landing pad lists the types caught here and by the 'try's around it in the same function,
+	 * so the personality routine stops at it only if one of them matches. If none of the catches
+	 * here does, the exception goes on to the 'try' around, or out of the function.
+	 * */
+	bool omis_module_t::stmt_try(const omis_lambda_stmt_t &lambda_body, const std::vector<omis_catch_t> &catches) {
+		auto func = this->scope->func;
+		omis_try_t *outer = nullptr;
+		for (auto *item: this->tries) {
+			if (item->func == func)
+				outer = item;
+		}
+		
+		omis_try_t current;
+		current.func = func;
+		current.landing = this->create_block("try.landing");
+		current.dispatch = this->create_block("try.dispatch");
+		auto try_end = this->create_block("try.end");
+		
+		std::vector<omis_struct_t *> types;
+		for (auto &item: catches) {
+			auto *type = dynamic_cast<omis_struct_t *>(item.type());
+			if (type == nullptr) {
+				printf("ERROR: Only objects can be caught.\n");
+				return false;
+			}
+			types.push_back(type);
+			current.infos.push_back(this->type_info(type));
+		}
+		
+		this->tries.push_back(&current);
+		bridge->set_unwind_dest(func->get_handle(), current.landing->get_handle());
+		bool body = lambda_body();
+		this->tries.pop_back();
+		bridge->set_unwind_dest(func->get_handle(), outer != nullptr ? outer->landing->get_handle() : nullptr);
+		if (!body)
+			return false;
+		if (!this->is_terminator_ins())
+			this->jump(try_end);
+		
+		std::vector<omis_handle_t> infos;
+		for (auto iter = this->tries.rbegin(); iter != this->tries.rend(); ++iter) {
+			if ((*iter)->func != func)
+				continue;
+			for (auto *info: (*iter)->infos) {
+				infos.push_back(info->get_handle());
+			}
+		}
+		// The personality routine picks the first clause which matches, the catches here come first, in source order.
+		std::vector<omis_handle_t> handles;
+		for (auto *info: current.infos) {
+			handles.push_back(info->get_handle());
+		}
+		infos.insert(infos.begin(), handles.begin(), handles.end());
+		this->set_active_block(current.landing);
+		auto pad = this->value(bridge->landing_pad(this->handle, infos));
+		current.incomings[pad] = current.landing;
+		this->jump(current.dispatch);
+		
+		this->set_active_block(current.dispatch);
+		auto exception = this->phi(pad->get_type(), current.incomings);
+		for (size_t index = 0; index < catches.size(); index++) {
+			auto catch_body = this->create_block("catch.body");
+			auto catch_next = this->create_block("catch.next");
+			auto matches = this->value(bridge->catch_matches(this->handle, exception->get_handle(), current.infos[index]->get_handle()));
+			this->jump_cond(matches, catch_body, catch_next);
+			
+			this->set_active_block(catch_body);
+			this->push_scope();
+			auto object = this->value(bridge->catch_object(this->handle, exception->get_handle()));
+			object = this->bitcast(object, types[index]->get_pointer_type());
+			if (this->is_gc_ref(object->get_type()))
+				this->gc_root(object);
+			if (!this->add_value_symbol(catches[index].name, object) || !catches[index].body()) {
+				this->pop_scope();
+				return false;
+			}
+			this->pop_scope();
+			if (!this->is_terminator_ins())
+				this->jump(try_end);
+			
+			this->set_active_block(catch_next);
+		}
+		if (outer != nullptr) {
+			outer->incomings[exception] = this->get_active_block();
+			this->jump(outer->dispatch);
+		} else {
+			bridge->resume(exception->get_handle());
+		}
+		
+		this->set_active_block(try_end);
+		
+		return true;
+	}
+	
+	bool omis_module_t::stmt_throw(const omis_lambda_expr_t &lambda_value) {
+		auto value = lambda_value();
+		if (value == nullptr)
+			return false;
+		value = this->get_ptr_val(value);
+		auto *type = dynamic_cast<omis_struct_t *>(value->get_type()->get_element_type());
+		if (type == nullptr) {
+			printf("ERROR: Only objects can be thrown.\n");
+			return false;
+		}
+		// The static type is thrown, a 'catch' of any of its bases matches it.
+		auto object = this->bitcast(value, this->type_bytes());
+		bridge->throw_value(this->handle, object->get_handle(), this->type_info(type)->get_handle());
+		// Statements after the 'throw' are never run, they still need a block to go to.
+		this->set_active_block(this->create_block("throw.end"));
+		return true;
+	}
+	
 	bool omis_module_t::stmt_loop(const omis_lambda_stmt_t &lambda_init,
 								  const omis_lambda_expr_t &lambda_cond,
 								  const omis_lambda_stmt_t &lambda_step,
-								  const omis_lambda_stmt_t &lambda_body) {
+								  const omis_lambda_stmt_t &lambda_body,
+								  const omis_loop_hints_t &hints) {
 		this->push_scope();
 		
 		auto loop_cond = this->create_block("loop.cond");
@@ -1022,7 +2794,8 @@ namespace eokas {
 		{
 			if (!lambda_step())
 				return false;
-			this->jump(loop_cond);
+			auto back_edge = this->jump(loop_cond);
+			bridge->set_loop_hints(loop_cond->get_handle(), back_edge->get_handle(), hints);
 		}
 		
 		this->set_active_block(loop_end);
@@ -1035,6 +2808,69 @@ namespace eokas {
 		return true;
 	}
 	
+	/**
+	 * 'loop(i in begin..end)', the bounds are evaluated once and 'i' is immutable in the body.
+	 * The counter lives in a slot of its own, which SSA promotion turns into the
+	 * canonical induction variable: one phi, stepped by a 'nsw' add of 1.
+	 * An inclusive range leaves at its end before stepping, which may be the largest value of its type.
+	 * */
+	bool omis_module_t::stmt_loop_range(const String &counter,
+										const omis_lambda_expr_t &lambda_begin,
+										const omis_lambda_expr_t &lambda_end,
+										bool inclusive,
+										const omis_lambda_stmt_t &lambda_body,
+										const omis_loop_hints_t &hints) {
+		omis_value_t *slot = nullptr;
+		omis_value_t *end = nullptr;
+		
+		auto init = [&]() -> bool {
+			auto begin = lambda_begin();
+			end = lambda_end();
+			if (begin == nullptr || end == nullptr)
+				return false;
+			begin = this->get_ptr_val(begin);
+			end = this->get_ptr_val(end);
+			auto begin_bits = this->get_int_bits(begin->get_type());
+			auto end_bits = this->get_int_bits(end->get_type());
+			if (begin_bits == 0 || end_bits == 0) {
+				printf("ERROR: The bounds of a range loop must be integers.\n");
+				return false;
+			}
+			// The counter takes the wider type of the bounds.
+			auto type = begin_bits >= end_bits ? begin->get_type() : end->get_type();
+			begin = this->value(bridge->int_cast(begin->get_handle(), type->get_handle()));
+			end = this->value(bridge->int_cast(end->get_handle(), type->get_handle()));
+			slot = this->alloc(counter, type, begin);
+			return true;
+		};
+		
+		auto cond = [&]() -> omis_value_t * {
+			auto value = this->load(slot);
+			return inclusive ? this->le(value, end) : this->lt(value, end);
+		};
+		
+		auto step = [&]() -> bool {
+			auto value = this->load(slot);
+			if (inclusive) {
+				auto loop_next = this->create_block("loop.next");
+				this->jump_cond(this->eq(value, end), this->break_point, loop_next);
+				this->set_active_block(loop_next);
+			}
+			this->store(slot, this->value(bridge->add_nsw(value->get_handle(), this->value_integer(1, this->get_int_bits(value->get_type()))->get_handle())));
+			return true;
+		};
+		
+		auto body = [&]() -> bool {
+			if (!this->add_value_symbol(counter, this->load(slot))) {
+				printf("ERROR: There is a symbol named %s in this scope.\n", counter.cstr());
+				return false;
+			}
+			return lambda_body();
+		};
+		
+		return this->stmt_loop(init, cond, step, body, hints);
+	}
+	
 	bool omis_module_t::stmt_break() {
 		if (this->break_point == nullptr)
 			return false;
@@ -48,6 +48,7 @@ namespace eokas {
         String name = "";
         omis_value_t* value = nullptr;
         omis_scope_t* scope = nullptr;
+        bool variable = false;
     };
 
     struct omis_type_symbol_t
@@ -74,11 +75,28 @@ namespace eokas {
         omis_type_symbol_t* get_type_symbol(const String& name, bool lookup);
         omis_type_symbol_t* get_type_symbol(omis_lambda_predicate_t<omis_type_symbol_t> predicate, bool lookup);
 
-        bool add_value_symbol(const String& name, omis_value_t* value);
+        bool add_value_symbol(const String& name, omis_value_t* value, bool variable = false);
         omis_value_symbol_t* get_value_symbol(const String& name, bool lookup);
         omis_value_symbol_t* get_value_symbol(omis_lambda_predicate_t<omis_value_symbol_t> predicate, bool lookup);
     };
 
+    enum class omis_fold_op_t {
+        ADD, SUB, MUL, DIV, MOD,
+        AND, OR, XOR, SHL, SHR,
+        EQ, NE, GT, GE, LT, LE,
+    };
+
+    // A 'try' being encoded, the exceptions of its landing pad are tested in 'dispatch'.
+    struct omis_try_t
+    {
+        omis_value_t* func = nullptr;
+        omis_value_t* landing = nullptr;
+        omis_value_t* dispatch = nullptr;
+        std::vector<omis_value_t*> infos = {};
+        // The landing pads of the 'try's inside which go on here if none of their catches match.
+        std::map<omis_value_t*, omis_value_t*> incomings = {};
+    };
+
     class omis_module_t {
     public:
         omis_module_t(omis_bridge_t* bridge, const String& name);
@@ -89,7 +107,10 @@ namespace eokas {
         omis_bridge_t* get_bridge();
         const String& get_name() const;
         omis_handle_t get_handle();
+        const omis_options_t& get_options() const;
+        void set_options(const omis_options_t& options);
         String dump();
+        bool finalize();
 
         bool using_module(omis_module_t* other);
 
@@ -100,7 +121,7 @@ namespace eokas {
         omis_type_symbol_t* get_type_symbol(const String& name, bool lookup = true);
         bool add_type_symbol(const String& name, omis_type_t* type);
         omis_value_symbol_t* get_value_symbol(const String& name, bool lookup = true);
-        bool add_value_symbol(const String& name, omis_value_t* type);
+        bool add_value_symbol(const String& name, omis_value_t* type, bool variable = false);
 
         omis_type_t* type(omis_handle_t handle);
         omis_type_t* type_void();
@@ -114,8 +135,17 @@ namespace eokas {
         omis_type_t* type_bytes();
         omis_type_t* type_pointer(omis_type_t* type);
         omis_type_t* type_func(omis_type_t* ret, const std::vector<omis_type_t*>& args, bool varg);
+        omis_struct_t* type_struct(const String& name);
+        omis_array_t* type_array(omis_type_t* element, u64_t length, bool soa = false);
+        omis_slice_t* type_slice(omis_type_t* item);
+        omis_vector_t* type_vector(omis_type_t* item, u32_t length);
+        omis_struct_t* type_closure(omis_type_t* ret, const std::vector<omis_type_t*>& args);
+        omis_struct_t* type_closure_env(omis_struct_t* closure, const std::vector<omis_type_t*>& captures);
+        omis_struct_t* type_box(omis_type_t* type);
+        omis_struct_t* get_closure_type(omis_type_t* type);
 		String get_type_name(omis_type_t* type);
         omis_value_t* get_type_size(omis_type_t* type);
+        u64_t get_type_alloc_size(omis_type_t* type);
         bool can_losslessly_bitcast(omis_type_t* a, omis_type_t* b);
 
         omis_value_t* value(omis_type_t* type, omis_handle_t handle);
@@ -125,11 +155,18 @@ namespace eokas {
         omis_value_t* value_bool(bool val);
         omis_value_t* value_string(const String& val);
         omis_value_t* value_func(const String& name, omis_type_t* ret, const std::vector<omis_type_t*>& args, bool varg);
+        void set_fp_model(omis_value_t* func, omis_fp_model_t model);
+        bool set_memo(omis_value_t* func, u32_t capacity, bool lru);
+        omis_value_t* value_builtin(const String& name, omis_type_t* type);
+        omis_value_t* value_array(omis_type_t* item, const std::vector<omis_value_t*>& items);
+        omis_value_t* value_vector(omis_vector_t* type, const std::vector<omis_value_t*>& items);
 
 		omis_type_t* get_func_ret_type(omis_value_t* func);
 		uint32_t get_func_arg_count(omis_value_t* func);
 		omis_type_t* get_func_arg_type(omis_value_t* func, uint32_t index);
 		omis_value_t* get_func_arg_value(omis_value_t* func, uint32_t index);
+		bool is_value_func(omis_value_t* value);
+		bool is_value_const(omis_value_t* value);
 		
         bool equals_type(omis_type_t* a, omis_type_t* b);
         bool equals_value(omis_value_t* a, omis_value_t* b);
@@ -143,6 +180,21 @@ namespace eokas {
 		omis_value_t* alloc(const String& name, omis_type_t* type, omis_value_t* value = nullptr);
 		omis_value_t* load(omis_value_t* ptr);
 		omis_value_t* store(omis_value_t* ptr, omis_value_t* val);
+		omis_value_t* gep_struct(omis_value_t* ptr, omis_struct_t* type, u32_t index);
+		omis_value_t* gep_array(omis_value_t* ptr, omis_array_t* type, omis_value_t* index);
+		omis_value_t* gep_soa(omis_value_t* ptr, omis_array_t* type, u32_t member, omis_value_t* index);
+		bool check_index(omis_value_t* ptr, omis_value_t* index);
+		omis_value_t* array_length(omis_value_t* ptr);
+		omis_value_t* array_append(omis_value_t* ptr, omis_value_t* value);
+		omis_value_t* array_fill(omis_value_t* ptr, omis_array_t* type, const std::vector<omis_value_t*>& items);
+		omis_value_t* slice(omis_value_t* value, omis_value_t* begin, omis_value_t* end);
+		omis_value_t* gep_slice(omis_value_t* slice, omis_value_t* index);
+		omis_value_t* cast_slice(omis_value_t* value, omis_type_t* type);
+		omis_value_t* vector_lane(omis_value_t* vec, omis_value_t* index);
+		omis_value_t* shuffle(omis_value_t* a, omis_value_t* b, const std::vector<int>& lanes);
+		omis_value_t* reduce(omis_reduce_op_t op, omis_value_t* vec);
+		omis_value_t* cast_vector(omis_value_t* value, omis_type_t* type);
+		omis_value_t* copy(omis_value_t* dst, omis_value_t* src, omis_value_t* size);
 		omis_value_t* neg(omis_value_t* a);
 		omis_value_t* add(omis_value_t* a, omis_value_t* b);
 		omis_value_t* sub(omis_value_t* a, omis_value_t* b);
@@ -166,46 +218,89 @@ namespace eokas {
 		omis_value_t* b_shr(omis_value_t* a, omis_value_t* b);
 		omis_value_t* jump(omis_value_t* pos);
 		omis_value_t* jump_cond(omis_value_t* cond, omis_value_t* branch_true, omis_value_t* branch_false);
+		omis_value_t* jump_switch(omis_value_t* value, omis_value_t* other, const std::vector<std::pair<omis_value_t*, omis_value_t*>>& cases);
 		omis_value_t* phi(omis_type_t* type, const std::map<omis_value_t*, omis_value_t*>& incomings);
+		omis_value_t* select(omis_value_t* cond, omis_value_t* a, omis_value_t* b);
 		omis_value_t* call(omis_value_t* func, const std::vector<omis_value_t*>& args);
 		omis_value_t* call(const String& func, const std::vector<omis_value_t*>& args);
 		omis_value_t* ret(omis_value_t* value = nullptr);
 		omis_value_t* bitcast(omis_value_t* value, omis_type_t* type);
+		omis_value_t* cast_const_float(omis_value_t* value, omis_type_t* type);
+		omis_value_t* cast_const_int(omis_value_t* value, omis_type_t* type);
+		omis_value_t* make_closure(omis_struct_t* env, omis_value_t* code, const std::vector<omis_value_t*>& captures);
+		omis_value_t* get_closure_code(omis_value_t* closure);
+		omis_value_t* call_closure(omis_value_t* code, omis_value_t* closure, const std::vector<omis_value_t*>& args);
+		omis_value_t* cast_closure(omis_value_t* value, omis_type_t* type);
 		
 		omis_value_t* get_ptr_val(omis_value_t* val);
 		omis_value_t* get_ptr_ref(omis_value_t* val);
 		omis_value_t* make(omis_type_t* type);
 		omis_value_t* make(omis_type_t* type, omis_value_t* count);
 		omis_value_t* drop(omis_value_t* ptr);
+		omis_value_t* drop(omis_value_t* ptr, omis_value_t* count);
+		u32_t get_size_class(omis_type_t* type, omis_value_t* count);
+		omis_value_t* gc_root(omis_value_t* value);
 		
 		omis_value_t* expr_branch(const omis_lambda_expr_t& lambda_cond, const omis_lambda_expr_t& lambda_true, const omis_lambda_expr_t& lambda_false);
+		omis_value_t* expr_select(const omis_lambda_expr_t& lambda_cond, const omis_lambda_expr_t& lambda_true, const omis_lambda_expr_t& lambda_false);
+		omis_value_t* expr_and(const omis_lambda_expr_t& lambda_lhs, const omis_lambda_expr_t& lambda_rhs);
+		omis_value_t* expr_or(const omis_lambda_expr_t& lambda_lhs, const omis_lambda_expr_t& lambda_rhs);
 		
 		bool stmt_block(const std::optional<omis_lambda_stmt_t>& lambda_body);
-		bool stmt_symbol_def(const String& name, const std::optional<omis_lambda_type_t>& lambda_type, const omis_lambda_expr_t& lambda_expr);
+		bool stmt_symbol_def(const String& name, bool variable, const std::optional<omis_lambda_type_t>& lambda_type, const omis_lambda_expr_t& lambda_expr);
 		bool stmt_assign(const omis_lambda_expr_t& lambda_left, const omis_lambda_expr_t& lambda_right);
 		bool stmt_return(const std::optional<omis_lambda_expr_t>& lambda_expr);
 		bool stmt_branch(const omis_lambda_expr_t& lambda_cond,
 						 const omis_lambda_stmt_t& lambda_true,
 						 const omis_lambda_stmt_t& lambda_false);
+		bool stmt_match(const omis_lambda_expr_t& lambda_value,
+						const std::vector<omis_match_case_t>& cases,
+						const omis_lambda_stmt_t& lambda_other);
 		bool stmt_loop(const omis_lambda_stmt_t& lambda_init,
 					   const omis_lambda_expr_t& lambda_cond,
 					   const omis_lambda_stmt_t& lambda_step,
-					   const omis_lambda_stmt_t& lambda_body);
+					   const omis_lambda_stmt_t& lambda_body,
+					   const omis_loop_hints_t& hints = {});
+		bool stmt_loop_range(const String& counter,
+							 const omis_lambda_expr_t& lambda_begin,
+							 const omis_lambda_expr_t& lambda_end,
+							 bool inclusive,
+							 const omis_lambda_stmt_t& lambda_body,
+							 const omis_loop_hints_t& hints = {});
 		bool stmt_break();
 		bool stmt_continue();
+		bool stmt_try(const omis_lambda_stmt_t& lambda_body, const std::vector<omis_catch_t>& catches);
+		bool stmt_throw(const omis_lambda_expr_t& lambda_value);
 		void stmt_ensure_tail_ret(omis_value_t* func);
 		
 	protected:
+		omis_value_t* expr_short_circuit(bool is_and, const omis_lambda_expr_t& lambda_lhs, const omis_lambda_expr_t& lambda_rhs);
+		bool get_const_int(omis_value_t* val, i64_t& out);
+		bool get_const_float(omis_value_t* val, f64_t& out);
+		u32_t get_int_bits(omis_type_t* type);
+		omis_value_t* cast_vector_item(omis_value_t* value, omis_type_t* item);
+		bool is_gc_ref(omis_type_t* type);
+		bool is_module_scope(omis_scope_t* scope);
+		omis_value_t* global(const String& name, omis_type_t* type, omis_value_t* value, bool variable);
+		omis_value_t* type_info(omis_struct_t* type);
+		omis_value_t* fold_binary(omis_fold_op_t op, omis_value_t* a, omis_value_t* b);
+		
         omis_bridge_t* bridge;
         String name;
         omis_handle_t handle;
+        omis_options_t options;
         omis_scope_t* root;
         omis_scope_t* scope;
         std::vector<omis_module_t*> usings;
         std::map<omis_handle_t, omis_type_t*> types;
+        std::map<std::tuple<omis_type_t*, u64_t, bool>, omis_array_t*> arrays;
+        std::map<omis_handle_t, omis_struct_t*> closures;
+        std::map<omis_type_t*, omis_struct_t*> box_types;
         std::map<omis_handle_t, omis_value_t*> values;
+		std::map<omis_value_t*, omis_value_t*> negations;
 		omis_value_t* break_point;
 		omis_value_t* continue_point;
+		std::vector<omis_try_t*> tries;
     };
 
     class omis_type_t {
@@ -222,6 +317,7 @@ namespace eokas {
         bool is_type_struct();
 
         omis_type_t* get_pointer_type();
+        omis_type_t* get_element_type();
 
     protected:
         omis_module_t* module;
@@ -236,6 +332,9 @@ namespace eokas {
             String name;
             omis_type_t* type;
             omis_value_t* value;
+            u64_t offset;
+            u32_t align;
+            u32_t field;
         };
 
         omis_struct_t(omis_module_t* module, omis_handle_t handle);
@@ -245,6 +344,7 @@ namespace eokas {
 
         bool extends(const String& base);
         bool extends(omis_struct_t* base);
+        omis_struct_t* get_base();
 
         member_t* add_member(const String& name, omis_type_t* type, omis_value_t* value = nullptr);
         member_t* add_member(const String& name, omis_value_t* value);
@@ -252,9 +352,79 @@ namespace eokas {
         member_t* get_member(const String& name);
         member_t* get_member(size_t index);
         size_t get_member_index(const String& name);
+        size_t get_member_count();
+
+        void set_layout(bool packed, bool reorder, u32_t align);
+        u32_t get_align();
+        bool is_explicit_layout();
+        bool resolve();
 
     protected:
+        omis_struct_t* base = nullptr;
         std::vector<member_t> members;
+        std::unordered_map<String, size_t, omis_string_hash_t> indices;
+        bool frozen = false;
+        bool packed = false;
+        bool reorder = false;
+        bool explicit_layout = false;
+        u32_t align = 0;
+    };
+
+    /**
+     * A fixed-size array stored inline. A '#soa' array of structs keeps
+     * every member in a column of its own, so 'a[i].x' walks a contiguous
+     * column instead of striding over whole elements.
+     * A growable 'array<T>' has no length in its type, it is a header
+     * matching eokas_array_t whose items are kept on the heap.
+     * */
+    class omis_array_t :public omis_type_t {
+    public:
+        omis_array_t(omis_module_t* module, omis_handle_t handle, omis_type_t* item, u64_t length, bool soa);
+        virtual ~omis_array_t();
+
+        omis_type_t* get_item_type();
+        u64_t get_length();
+        bool is_soa();
+        bool is_dynamic();
+
+    protected:
+        omis_type_t* item;
+        u64_t length;
+        bool soa;
+    };
+
+    /**
+     * A 'T[]' is a view of a run of items in an array, the pointer to the
+     * first one and the count. It is a value, copying or passing it never
+     * copies the items, and it does not keep the array alive.
+     * */
+    class omis_slice_t :public omis_type_t {
+    public:
+        omis_slice_t(omis_module_t* module, omis_handle_t handle, omis_type_t* item);
+        virtual ~omis_slice_t();
+
+        omis_type_t* get_item_type();
+
+    protected:
+        omis_type_t* item;
+    };
+
+    /**
+     * A 'vec4<f32>' holds its lanes in one SIMD register. It is a value like
+     * the scalars, the arithmetic, bitwise and comparison operators work on
+     * all lanes at once and a comparison gives a vector of bools, a mask.
+     * */
+    class omis_vector_t :public omis_type_t {
+    public:
+        omis_vector_t(omis_module_t* module, omis_handle_t handle, omis_type_t* item, u32_t length);
+        virtual ~omis_vector_t();
+
+        omis_type_t* get_item_type();
+        u32_t get_length();
+
+    protected:
+        omis_type_t* item;
+        u32_t length;
     };
 
     class omis_value_t {
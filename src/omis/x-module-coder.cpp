@@ -11,12 +11,25 @@ namespace eokas {
         if (node == nullptr)
             return false;
 
+        this->add_type_symbol("void", this->type_void());
+        this->add_type_symbol("i8", this->type_i8());
+        this->add_type_symbol("i16", this->type_i16());
+        this->add_type_symbol("i32", this->type_i32());
+        this->add_type_symbol("i64", this->type_i64());
+        this->add_type_symbol("f32", this->type_f32());
+        this->add_type_symbol("f64", this->type_f64());
+        this->add_type_symbol("bool", this->type_bool());
+
         omis_type_t *ret = type_i32();
         std::vector<omis_type_t *> args = {};
         omis_value_t *func = this->value_func("$main", ret, args, false);
         this->scope->add_value_symbol("$main", func);
         this->scope->func = func;
 
+        // Every closure is known to be lifted or not before the first one is encoded.
+        this->collect_lifted_funcs(node->entry);
+        this->boxed_vars = this->collect_boxed_vars(node->entry);
+
         this->push_scope(func);
         {
             auto entry = this->create_block("entry");
@@ -32,7 +45,7 @@ namespace eokas {
         }
         this->pop_scope();
 
-        return true;
+        return this->finalize();
     }
 
     bool omis_module_coder_t::encode_stmt(ast_node_stmt_t *node) {
@@ -50,12 +63,24 @@ namespace eokas {
                 return this->encode_stmt_return(dynamic_cast<ast_node_return_t *>(node));
             case ast_category_t::IF:
                 return this->encode_stmt_if(dynamic_cast<ast_node_if_t *>(node));
+            case ast_category_t::MATCH:
+                return this->encode_stmt_match(dynamic_cast<ast_node_match_t *>(node));
+            case ast_category_t::TRY:
+                return this->encode_stmt_try(dynamic_cast<ast_node_try_t *>(node));
+            case ast_category_t::THROW:
+                return this->encode_stmt_throw(dynamic_cast<ast_node_throw_t *>(node));
             case ast_category_t::LOOP:
                 return this->encode_stmt_loop(dynamic_cast<ast_node_loop_t *>(node));
             case ast_category_t::BREAK:
                 return this->encode_stmt_break(dynamic_cast<ast_node_break_t *>(node));
             case ast_category_t::CONTINUE:
                 return this->encode_stmt_continue(dynamic_cast<ast_node_continue_t *>(node));
+            case ast_category_t::INVOKE:
+                return this->encode_stmt_invoke(dynamic_cast<ast_node_invoke_t *>(node));
+            case ast_category_t::STRUCT_DEF:
+                return this->encode_stmt_struct_def(dynamic_cast<ast_node_struct_def_t *>(node));
+            case ast_category_t::ENUM_DEF:
+                return this->encode_stmt_enum_def(dynamic_cast<ast_node_enum_def_t *>(node));
             default:
                 return false;
         }
@@ -83,21 +108,80 @@ namespace eokas {
         std::optional<omis_lambda_type_t> lambda_type;
         if(node->type != nullptr) {
             lambda_type = [&]() -> omis_type_t * {
-                return this->encode_type_ref(node->type);
+                auto *type = this->encode_type_ref(node->type);
+                // Objects and arrays are held by reference.
+                if (type != nullptr && (type->is_type_struct() || type->is_type_array()))
+                    type = type->get_pointer_type();
+                return type;
+            };
+        }
+
+        // 'val name: func(...) = internal' binds a builtin the compiler provides.
+        if (!node->variable && node->type != nullptr && node->value->category == ast_category_t::SYMBOL_REF &&
+            dynamic_cast<ast_node_symbol_ref_t *>(node->value)->name == "internal") {
+            // A builtin is a plain function, not a closure.
+            auto lambda_func_type = [&]()->omis_type_t* {
+                omis_type_t *ret_type = nullptr;
+                std::vector<omis_type_t *> args_types;
+                if (!this->encode_func_sign(node->type, ret_type, args_types))
+                    return nullptr;
+                return this->type_func(ret_type, args_types, false)->get_pointer_type();
+            };
+            auto lambda_builtin = [&]()->omis_value_t* {
+                auto *type = lambda_func_type();
+                if (type == nullptr)
+                    return nullptr;
+                return this->value_builtin(node->name, type);
             };
+            return this->stmt_symbol_def(node->name, node->variable, lambda_func_type, lambda_builtin);
         }
 
         auto lambda_value = [&]()->omis_value_t* {
-            return this->encode_expr(node->value);
+            // An array literal takes the array or vector type it is declared with.
+            if (node->type != nullptr && node->value->category == ast_category_t::ARRAY_DEF) {
+                auto *type = this->encode_type_ref(node->type);
+                auto *array_type = dynamic_cast<omis_array_t *>(type);
+                if (array_type != nullptr)
+                    return this->encode_expr_array_def(dynamic_cast<ast_node_array_def_t *>(node->value), array_type);
+                auto *vector_type = dynamic_cast<omis_vector_t *>(type);
+                if (vector_type != nullptr)
+                    return this->encode_expr_vector_def(dynamic_cast<ast_node_array_def_t *>(node->value), vector_type);
+            }
+            auto value = this->encode_expr(node->value);
+            // An immutable function binding names the function itself.
+            if (value != nullptr && !node->variable && node->value->category == ast_category_t::FUNC_DEF)
+                value->set_name(node->name);
+            return value;
         };
 
-        return this->stmt_symbol_def(node->name, lambda_type, lambda_value);
+        if (!this->stmt_symbol_def(node->name, node->variable, lambda_type, lambda_value))
+            return false;
+
+        // A variable closures capture lives in a box they share.
+        if (node->variable && this->boxed_vars.count(node->name) > 0) {
+            auto *symbol = this->scope->get_value_symbol(node->name, false);
+            if (!this->is_module_scope(symbol->scope)) {
+                symbol->value = this->box_var(symbol->value);
+                if (symbol->value == nullptr)
+                    return false;
+            }
+        }
+        return true;
     }
 
     bool omis_module_coder_t::encode_stmt_assign(ast_node_assign_t *node) {
         if (node == nullptr)
             return false;
 		
+        if (node->left->category == ast_category_t::SYMBOL_REF) {
+            auto *ref = dynamic_cast<ast_node_symbol_ref_t *>(node->left);
+            auto *symbol = this->scope->get_value_symbol(ref->name, true);
+            if (symbol != nullptr && !symbol->variable) {
+                printf("ERROR: The symbol '%s' is immutable and can not be assigned.\n", ref->name.cstr());
+                return false;
+            }
+        }
+
         auto left = [&]()->omis_value_t* {
             return this->encode_expr(node->left);
         };
@@ -109,6 +193,13 @@ namespace eokas {
         return this->stmt_assign(left, right);
     }
 
+    bool omis_module_coder_t::encode_stmt_invoke(ast_node_invoke_t *node) {
+        if (node == nullptr)
+            return false;
+
+        return this->encode_expr_func_ref(node->expr) != nullptr;
+    }
+
     bool omis_module_coder_t::encode_stmt_return(ast_node_return_t *node) {
         if (node == nullptr)
             return false;
@@ -146,6 +237,72 @@ namespace eokas {
 		return this->stmt_branch(cond, branch_true, branch_false);
 	}
 
+    bool omis_module_coder_t::encode_stmt_match(ast_node_match_t *node) {
+        if (node == nullptr)
+            return false;
+
+        auto value = [&]()->omis_value_t* {
+            return this->encode_expr(node->value);
+        };
+
+        std::vector<omis_match_case_t> cases;
+        for (auto &match_case: node->cases) {
+            omis_match_case_t item;
+            for (auto *key: match_case.values) {
+                item.values.push_back([this, key]()->omis_value_t* {
+                    return this->encode_expr(key);
+                });
+            }
+            item.body = [this, &match_case]()->bool {
+                return this->encode_stmt(match_case.body);
+            };
+            cases.push_back(item);
+        }
+
+        auto other = [&]()->bool {
+            if (node->other == nullptr)
+                return true;
+            return this->encode_stmt(node->other);
+        };
+
+        return this->stmt_match(value, cases, other);
+    }
+
+    bool omis_module_coder_t::encode_stmt_try(ast_node_try_t *node) {
+        if (node == nullptr)
+            return false;
+
+        auto body = [&]()->bool {
+            return this->encode_stmt(node->body);
+        };
+
+        std::vector<omis_catch_t> catches;
+        for (auto &item: node->catches) {
+            omis_catch_t catch_item;
+            catch_item.name = item.name;
+            catch_item.type = [this, &item]()->omis_type_t* {
+                return this->encode_type_ref(item.type);
+            };
+            catch_item.body = [this, &item]()->bool {
+                return this->encode_stmt(item.body);
+            };
+            catches.push_back(catch_item);
+        }
+
+        return this->stmt_try(body, catches);
+    }
+
+    bool omis_module_coder_t::encode_stmt_throw(ast_node_throw_t *node) {
+        if (node == nullptr)
+            return false;
+
+        auto value = [&]()->omis_value_t* {
+            return this->encode_expr(node->value);
+        };
+
+        return this->stmt_throw(value);
+    }
+
     bool omis_module_coder_t::encode_stmt_loop(ast_node_loop_t *node) {
 		if (node == nullptr)
 			return false;
@@ -168,13 +325,39 @@ namespace eokas {
             return this->encode_stmt(node->step);
         };
 
+        safe_index_t safe_index;
+        bool counted = this->match_counted_loop(node, safe_index);
+
         auto body = [&]() -> auto {
             if (node->body == nullptr)
                 return true;
-            return this->encode_stmt(node->body);
+            if (!counted)
+                return this->encode_stmt(node->body);
+            this->safe_indices.push_back(safe_index);
+            bool ret = this->encode_stmt(node->body);
+            this->safe_indices.pop_back();
+            return ret;
         };
 
-		return this->stmt_loop(init, cond, step, body);
+        omis_loop_hints_t hints;
+        hints.unroll = node->unroll;
+        hints.unroll_full = node->unroll_full;
+        hints.vectorize = node->vectorize;
+        hints.vectorize_enable = node->vectorize_enable;
+        hints.interleave = node->interleave;
+        hints.no_alias = node->no_alias;
+
+        if (!node->counter.isEmpty()) {
+            auto begin = [&]() -> auto {
+                return this->encode_expr(node->begin);
+            };
+            auto end = [&]() -> auto {
+                return this->encode_expr(node->end);
+            };
+            return this->stmt_loop_range(node->counter, begin, end, node->inclusive, body, hints);
+        }
+
+		return this->stmt_loop(init, cond, step, body, hints);
 	}
 
     bool omis_module_coder_t::encode_stmt_break(ast_node_break_t *node) {
@@ -189,6 +372,87 @@ namespace eokas {
         return this->stmt_continue();
     }
 
+    // An enum is an i32, 'E.member' names the constant of a member.
+    bool omis_module_coder_t::encode_stmt_enum_def(ast_node_enum_def_t *node) {
+        if (node == nullptr)
+            return false;
+
+        if (!this->add_type_symbol(node->name, this->type_i32())) {
+            printf("ERROR: There is a same type named '%s' in this scope.\n", node->name.cstr());
+            return false;
+        }
+        for (auto &member: node->members) {
+            auto *value = this->value_integer((u64_t)(i64_t)member.second, 32);
+            if (!this->add_value_symbol(String::format("%s.%s", node->name.cstr(), member.first.cstr()), value))
+                return false;
+        }
+        return true;
+    }
+
+    bool omis_module_coder_t::encode_stmt_struct_def(ast_node_struct_def_t *node) {
+        if (node == nullptr)
+            return false;
+
+        // Declared before its members, so they can refer to the struct itself.
+        auto *struct_type = this->type_struct(node->name);
+        if (!this->add_type_symbol(node->name, struct_type)) {
+            printf("ERROR: There is a same type named '%s' in this scope.\n", node->name.cstr());
+            return false;
+        }
+
+        struct_type->set_layout(node->packed, node->reorder, node->align);
+
+        if (node->base != nullptr) {
+            auto *base_type = dynamic_cast<omis_struct_t *>(this->encode_type_ref(node->base));
+            if (base_type == nullptr) {
+                printf("ERROR: The base type of '%s' is not a struct.\n", node->name.cstr());
+                return false;
+            }
+            if (!struct_type->extends(base_type)) {
+                printf("ERROR: The struct '%s' can not extend '%s'.\n", node->name.cstr(), node->base->name.cstr());
+                return false;
+            }
+        }
+
+        for (auto &member: node->members) {
+            auto *member_type = this->encode_type_ref(member.type);
+            if (member_type == nullptr)
+                return false;
+            // Objects are held by reference.
+            if (member_type->is_type_struct())
+                member_type = member_type->get_pointer_type();
+
+            omis_value_t *member_value = nullptr;
+            if (member.value != nullptr) {
+                member_value = this->encode_expr(member.value);
+                if (member_value == nullptr)
+                    return false;
+                auto *narrowed = this->cast_const_float(member_value, member_type);
+                if (narrowed == nullptr)
+                    narrowed = this->cast_const_int(member_value, member_type);
+                if (narrowed == nullptr)
+                    narrowed = this->cast_closure(member_value, member_type);
+                if (narrowed != nullptr)
+                    member_value = narrowed;
+                if (!this->equals_type(member_value->get_type(), member_type)) {
+                    printf("ERROR: The default value of member '%s' does not match its type.\n", member.name.cstr());
+                    return false;
+                }
+            }
+
+            auto *struct_member = struct_type->add_member(member.name, member_type, member_value);
+            if (struct_member == nullptr) {
+                printf("ERROR: The member named '%s' is already exists.\n", member.name.cstr());
+                return false;
+            }
+            struct_member->align = member.align;
+        }
+
+        struct_type->resolve();
+
+        return true;
+    }
+
     omis_type_t *omis_module_coder_t::encode_type_ref(ast_node_type_t *node) {
         if (node == nullptr) {
             printf("ERROR: Type node is null. \n");
@@ -197,6 +461,46 @@ namespace eokas {
 
         const String &name = node->name;
 
+        // func(params...): ret, function values are closures held by reference.
+        if (name == "func" && !node->args.empty()) {
+            omis_type_t *ret_type = nullptr;
+            std::vector<omis_type_t *> args_types;
+            if (!this->encode_func_sign(node, ret_type, args_types))
+                return nullptr;
+            return this->type_closure(ret_type, args_types)->get_pointer_type();
+        }
+
+        // T[N], '#soa' arrays store their struct elements column by column.
+        // T[] is a slice.
+        if (name == "[]" && node->args.size() == 1) {
+            auto *element_type = this->encode_type_ref(node->args.front());
+            if (element_type == nullptr)
+                return nullptr;
+            if (node->length == 0)
+                return this->type_slice(element_type);
+            if (node->soa && dynamic_cast<omis_struct_t *>(element_type) == nullptr) {
+                printf("ERROR: The elements of a '#soa' array must be structs.\n");
+                return nullptr;
+            }
+            return this->type_array(element_type, node->length, node->soa);
+        }
+
+        // array<T>, a growable array.
+        if (name == "array" && node->args.size() == 1 && this->scope->get_type_symbol(name, true) == nullptr) {
+            auto *element_type = this->encode_type_ref(node->args.front());
+            if (element_type == nullptr)
+                return nullptr;
+            return this->type_array(element_type, 0);
+        }
+
+        // vec2<T>, vec4<T> and vec8<T>, SIMD vectors.
+        if ((name == "vec2" || name == "vec4" || name == "vec8") && node->args.size() == 1 && this->scope->get_type_symbol(name, true) == nullptr) {
+            auto *element_type = this->encode_type_ref(node->args.front());
+            if (element_type == nullptr)
+                return nullptr;
+            return this->type_vector(element_type, name == "vec2" ? 2 : name == "vec4" ? 4 : 8);
+        }
+
         auto *symbol = this->scope->get_type_symbol(name, true);
         if (symbol == nullptr) {
             printf("ERROR: The type '%s' is undefined.\n", name.cstr());
@@ -206,6 +510,29 @@ namespace eokas {
         return symbol->type;
     }
 
+    bool omis_module_coder_t::encode_func_sign(ast_node_type_t *node, omis_type_t *&ret_type, std::vector<omis_type_t *> &args_types) {
+        if (node->name != "func" || node->args.empty()) {
+            printf("ERROR: The type '%s' is not a function type.\n", node->name.cstr());
+            return false;
+        }
+
+        ret_type = this->encode_type_ref(node->args.back());
+        if (ret_type == nullptr)
+            return false;
+        if (ret_type->is_type_struct() || ret_type->is_type_array())
+            ret_type = ret_type->get_pointer_type();
+        for (size_t index = 0; index + 1 < node->args.size(); index++) {
+            auto *arg_type = this->encode_type_ref(node->args.at(index));
+            if (arg_type == nullptr)
+                return false;
+            if (arg_type->is_type_func() || arg_type->is_type_array() || arg_type->is_type_struct())
+                args_types.push_back(arg_type->get_pointer_type());
+            else
+                args_types.push_back(arg_type);
+        }
+        return true;
+    }
+
     omis_value_t *omis_module_coder_t::encode_expr(ast_node_expr_t *node) {
         if (node == nullptr)
             return nullptr;
@@ -231,16 +558,14 @@ namespace eokas {
                 return this->encode_expr_func_def(dynamic_cast<ast_node_func_def_t *>(node));
             case ast_category_t::FUNC_REF:
                 return this->encode_expr_func_ref(dynamic_cast<ast_node_func_ref_t *>(node));
-                /*
-                case ast_category_t::ARRAY_DEF:
-                    return this->encode_expr_array_def(dynamic_cast<ast_node_array_def_t *>(node));
-                case ast_category_t::ARRAY_REF:
-                    return this->encode_expr_index_ref(dynamic_cast<ast_node_array_ref_t *>(node));
-                case ast_category_t::OBJECT_DEF:
-                    return this->encode_expr_object_def(dynamic_cast<ast_node_object_def_t *>(node));
-                case ast_category_t::OBJECT_REF:
-                    return this->encode_expr_object_ref(dynamic_cast<ast_node_object_ref_t *>(node));
-                     */
+            case ast_category_t::OBJECT_DEF:
+                return this->encode_expr_object_def(dynamic_cast<ast_node_object_def_t *>(node));
+            case ast_category_t::OBJECT_REF:
+                return this->encode_expr_object_ref(dynamic_cast<ast_node_object_ref_t *>(node));
+            case ast_category_t::ARRAY_DEF:
+                return this->encode_expr_array_def(dynamic_cast<ast_node_array_def_t *>(node));
+            case ast_category_t::ARRAY_REF:
+                return this->encode_expr_index_ref(dynamic_cast<ast_node_array_ref_t *>(node));
             default:
                 return nullptr;
         }
@@ -261,15 +586,85 @@ namespace eokas {
 			return this->encode_expr(node->branch_false);
 		};
 		
+		// Cheap arms without side effects are cheaper to compute both than to branch on.
+		int budget = 8;
+		if (this->is_speculatable_expr(node->branch_true, budget) &&
+			this->is_speculatable_expr(node->branch_false, budget)) {
+			return this->expr_select(lambda_cond, lambda_true, lambda_false);
+		}
+		
 		return this->expr_branch(lambda_cond, lambda_true, lambda_false);
     }
 
+    /**
+     * Whether the expression can be evaluated even if its value is not used:
+     * no calls, no stores, no traps (division), and no more than 'budget' nodes.
+     * */
+    bool omis_module_coder_t::is_speculatable_expr(ast_node_expr_t *node, int &budget) {
+        if (node == nullptr || --budget < 0)
+            return false;
+
+        switch (node->category) {
+            case ast_category_t::LITERAL_INT:
+            case ast_category_t::LITERAL_FLOAT:
+            case ast_category_t::LITERAL_BOOL:
+            case ast_category_t::SYMBOL_REF:
+                return true;
+            case ast_category_t::EXPR_UNARY: {
+                auto *unary = dynamic_cast<ast_node_expr_unary_t *>(node);
+                switch (unary->op) {
+                    case ast_unary_oper_t::POS:
+                    case ast_unary_oper_t::NEG:
+                    case ast_unary_oper_t::FLIP:
+                    case ast_unary_oper_t::NOT:
+                        return this->is_speculatable_expr(unary->right, budget);
+                    default:
+                        return false;
+                }
+            }
+            case ast_category_t::EXPR_BINARY: {
+                auto *binary = dynamic_cast<ast_node_expr_binary_t *>(node);
+                switch (binary->op) {
+                    case ast_binary_oper_t::DIV:
+                    case ast_binary_oper_t::MOD:
+                    case ast_binary_oper_t::AND:
+                    case ast_binary_oper_t::OR:
+                        return false;
+                    default:
+                        return this->is_speculatable_expr(binary->left, budget) &&
+                               this->is_speculatable_expr(binary->right, budget);
+                }
+            }
+            case ast_category_t::EXPR_TRINARY: {
+                auto *trinary = dynamic_cast<ast_node_expr_trinary_t *>(node);
+                return this->is_speculatable_expr(trinary->cond, budget) &&
+                       this->is_speculatable_expr(trinary->branch_true, budget) &&
+                       this->is_speculatable_expr(trinary->branch_false, budget);
+            }
+            default:
+                return false;
+        }
+    }
+
     omis_value_t *omis_module_coder_t::encode_expr_binary(ast_node_expr_binary_t *node) {
         if (node == nullptr)
             return nullptr;
 
         auto func = this->scope->func;
 
+        // Logic operators must not evaluate rhs when lhs decides the result.
+        if (node->op == ast_binary_oper_t::AND || node->op == ast_binary_oper_t::OR) {
+            auto lambda_lhs = [&]()->omis_value_t* {
+                return this->encode_expr(node->left);
+            };
+            auto lambda_rhs = [&]()->omis_value_t* {
+                return this->encode_expr(node->right);
+            };
+            if (node->op == ast_binary_oper_t::AND)
+                return this->expr_and(lambda_lhs, lambda_rhs);
+            return this->expr_or(lambda_lhs, lambda_rhs);
+        }
+
         auto lhs = this->encode_expr(node->left);
         auto rhs = this->encode_expr(node->right);
         if (lhs == nullptr || rhs == nullptr)
@@ -279,10 +674,6 @@ namespace eokas {
         rhs = this->get_ptr_val(rhs);
 
         switch (node->op) {
-            case ast_binary_oper_t::OR:
-                return this->l_or(lhs, rhs);
-            case ast_binary_oper_t::AND:
-                return this->l_and(lhs, rhs);
             case ast_binary_oper_t::EQ:
                 return this->eq(lhs, rhs);
             case ast_binary_oper_t::NE:
@@ -324,6 +715,9 @@ namespace eokas {
         if (node == nullptr)
             return nullptr;
 
+        if (node->op == ast_unary_oper_t::SIZE_OF)
+            return this->encode_expr_size_of(node->right);
+
         auto rhs = this->encode_expr(node->right);
         if (rhs == nullptr)
             return nullptr;
@@ -344,6 +738,38 @@ namespace eokas {
         }
     }
 
+    /**
+     * '#T' is the size in bytes of type T, '#value' the size of its type.
+     * Objects are measured by what they refer to, with the layout their struct was given.
+     * */
+    omis_value_t *omis_module_coder_t::encode_expr_size_of(ast_node_expr_t *node) {
+        if (node == nullptr)
+            return nullptr;
+
+        omis_type_t *type = nullptr;
+        if (node->category == ast_category_t::SYMBOL_REF) {
+            const String &name = dynamic_cast<ast_node_symbol_ref_t *>(node)->name;
+            if (this->scope->get_value_symbol(name, true) == nullptr) {
+                auto *symbol = this->scope->get_type_symbol(name, true);
+                if (symbol != nullptr)
+                    type = symbol->type;
+            }
+        }
+
+        if (type == nullptr) {
+            auto *value = this->encode_expr(node);
+            if (value == nullptr)
+                return nullptr;
+            value = this->get_ptr_val(value);
+            type = value->get_type();
+            auto *element_type = type->get_element_type();
+            if (element_type != nullptr && (element_type->is_type_struct() || element_type->is_type_array()))
+                type = element_type;
+        }
+
+        return this->value_integer(this->get_type_alloc_size(type), 64);
+    }
+
     omis_value_t *omis_module_coder_t::encode_expr_int(ast_node_literal_int_t *node) {
         if (node == nullptr)
             return nullptr;
@@ -392,28 +818,12 @@ namespace eokas {
             return symbol->value;
         }
 
-        /*
-        // up-value-ref
-        {
-            auto upvalStruct = this->upvals[this->func];
-            int index = upvalStruct->get_member_index(node->name);
-            if(index < 0)
-            {
-                upvalStruct->add_member(node->name, symbol->type, symbol->value);
-                upvalStruct->resolve();
-                index = upvalStruct->get_member_index(node->name);
-            }
-            if(index < 0)
-            {
-                printf("Create up-value '%s' failed.\n", node->name.cstr());
-                return nullptr;
-            }
-
-            auto arg0 = this->func->getArg(0);
-            auto ptr = this->func->IR.CreateConstGEP2_32(arg0->getType()->getPointerElementType(), arg0, 0, index);
-            return ptr;
+        // The locals of outer functions are only seen through the captures of a closure,
+        // constants and the symbols of the module are seen everywhere.
+        if (!this->is_module_scope(symbol->scope) && !this->is_value_const(symbol->value)) {
+            printf("ERROR: The symbol '%s' of an outer function can't be used here.\n", node->name.cstr());
+            return nullptr;
         }
-        */
 
         return symbol->value;
     }
@@ -425,6 +835,8 @@ namespace eokas {
         auto *ret_type = this->encode_type_ref(node->rtype);
         if (ret_type == nullptr)
             return nullptr;
+        if (ret_type->is_type_struct() || ret_type->is_type_array())
+            ret_type = ret_type->get_pointer_type();
 
         std::vector<omis_type_t *> args_types;
         for (auto &arg: node->args) {
@@ -437,23 +849,101 @@ namespace eokas {
                 args_types.push_back(arg_type);
         }
 
-        auto newFunc = this->value_func("", ret_type, args_types, false);
+        // A function using locals of the outer functions is a closure. If it is only ever called
+        // by name where it is defined, it is lifted and takes the captures as leading args.
+        // Otherwise its captures are copied into a record made here, which its code takes first.
+        std::vector<capture_t> captures;
+        bool lifted = this->lifted_funcs.count(node) > 0;
+        if (!this->collect_captures(node, lifted, captures))
+            return nullptr;
+        bool closure = !captures.empty() && !lifted;
 
+        std::vector<omis_type_t *> params_types;
+        std::vector<omis_type_t *> captures_types;
+        for (auto &capture: captures) {
+            captures_types.push_back(capture.value->get_type());
+        }
+        if (lifted)
+            params_types = captures_types;
+        if (closure)
+            params_types.push_back(this->type_bytes());
+        u32_t hidden = (u32_t) params_types.size();
+        params_types.insert(params_types.end(), args_types.begin(), args_types.end());
+
+        omis_struct_t *env_type = nullptr;
+        if (closure) {
+            env_type = this->type_closure_env(this->type_closure(ret_type, args_types), captures_types);
+            if (env_type == nullptr)
+                return nullptr;
+        }
+
+        auto newFunc = this->value_func("", ret_type, params_types, false);
+        if (node->fastmath)
+            this->set_fp_model(newFunc, omis_fp_model_t::FAST);
+        if (node->memo > 0 && !this->set_memo(newFunc, node->memo, node->memo_lru))
+            return nullptr;
+
+        // The counted loops around the definition say nothing about the symbols in its body.
+        std::vector<safe_index_t> outer_indices;
+        outer_indices.swap(this->safe_indices);
+        std::set<String> outer_boxed = this->collect_boxed_vars(node);
+        outer_boxed.swap(this->boxed_vars);
+
+        auto outer = this->get_active_block();
         this->push_scope(newFunc);
         {
             auto *entry = this->create_block("entry");
             this->set_active_block(entry);
 
-            // self
+            // self, it passes the hidden params on.
             auto self = newFunc;
             this->scope->add_value_symbol("self", self);
+            std::vector<omis_value_t *> hidden_args;
+            for (u32_t index = 0; index < hidden; index++) {
+                hidden_args.push_back(this->get_func_arg_value(newFunc, index));
+            }
+            if (hidden > 0)
+                this->lifted_args[newFunc] = hidden_args;
+
+            // captures
+            omis_value_t *env = nullptr;
+            if (closure) {
+                hidden_args.front()->set_name("env");
+                env = this->bitcast(hidden_args.front(), env_type->get_pointer_type());
+                if (this->is_gc_ref(env->get_type()))
+                    this->gc_root(env);
+            }
+            for (u32_t index = 0; index < captures.size(); index++) {
+                auto &capture = captures.at(index);
+                omis_value_t *value = nullptr;
+                if (closure) {
+                    value = this->load(this->gep_struct(env, env_type, index + 1));
+                } else {
+                    value = hidden_args.at(index);
+                    value->set_name(capture.name);
+                }
+                if (capture.box != nullptr) {
+                    auto *member = this->gep_struct(value, capture.box, 0);
+                    this->box_refs[member] = value;
+                    value = member;
+                }
+                this->scope->add_value_symbol(capture.name, value, capture.variable);
+            }
 
             // args
             for (size_t index = 0; index < node->args.size(); index++) {
                 const char *name = node->args.at(index).name.cstr();
-                auto arg = this->get_func_arg_value(newFunc, index + 1);
+                auto arg = this->get_func_arg_value(newFunc, index + hidden);
                 arg->set_name(name);
-                if (!this->scope->add_value_symbol(name, arg)) {
+                bool variable = node->args.at(index).variable;
+                if (variable) {
+                    arg = this->alloc(name, arg->get_type(), arg);
+                    if (this->boxed_vars.count(name) > 0)
+                        arg = this->box_var(arg);
+                    if (arg == nullptr)
+                        return nullptr;
+                }
+                if (!this->scope->add_value_symbol(name, arg, variable)) {
                     printf("ERROR: The symbol name '%s' is already existed.\n", name);
                     return nullptr;
                 }
@@ -468,6 +958,22 @@ namespace eokas {
             this->stmt_ensure_tail_ret(newFunc);
         }
         this->pop_scope();
+        this->set_active_block(outer);
+        this->safe_indices.swap(outer_indices);
+        this->boxed_vars.swap(outer_boxed);
+
+        std::vector<omis_value_t *> captures_values;
+        for (auto &capture: captures) {
+            captures_values.push_back(capture.value);
+        }
+        if (lifted && hidden > 0) {
+            this->lifted_args[newFunc] = captures_values;
+            return newFunc;
+        }
+        if (closure) {
+            this->lifted_args.erase(newFunc);
+            return this->make_closure(env_type, newFunc, captures_values);
+        }
 
         return newFunc;
     }
@@ -476,58 +982,1017 @@ namespace eokas {
         if (node == nullptr)
             return nullptr;
 		
+        // 'length(a)' and 'append(a, value)' unless the program defines functions of these names.
+        if (node->func->category == ast_category_t::SYMBOL_REF) {
+            const String &name = dynamic_cast<ast_node_symbol_ref_t *>(node->func)->name;
+            if ((name == "length" || name == "append") && this->scope->get_value_symbol(name, true) == nullptr)
+                return this->encode_expr_array_builtin(name, node);
+            bool vector_builtin = name == "shuffle" || name == "reduce_add" || name == "reduce_mul" || name == "reduce_min" ||
+                                  name == "reduce_max" || name == "any" || name == "all" || name == "select";
+            if (vector_builtin && this->scope->get_value_symbol(name, true) == nullptr)
+                return this->encode_expr_vector_builtin(name, node);
+        }
+
         auto expr = this->encode_expr(node->func);
         if (expr == nullptr) {
             printf("The function is undefined.\n");
             return nullptr;
         }
+        // An immutable binding yields the function itself and the call is direct,
+        // a mutable one is loaded from its slot and called indirectly.
+        // A closure is called through its code, which takes the closure first,
+        // a lifted closure is called directly with its captures first.
         auto func = this->get_ptr_val(expr);
-
-        /*
-        omis_type_t* funcType = nullptr;
-        if (funcExpr->get_type()->is_type_func()) {
-            funcType = llvm::cast<llvm::FunctionType>(funcPtr->getType());
-        }
-        else if (funcExpr->getType()->isPointerTy() &&
-                   funcPtr->getType()->getPointerElementType()->isFunctionTy()) {
-            funcType = llvm::cast<llvm::FunctionType>(funcPtr->getType()->getPointerElementType());
+        omis_value_t *closure = nullptr;
+        std::vector<omis_value_t *> args;
+        if (this->get_closure_type(func->get_type()) != nullptr) {
+            closure = func;
+            func = this->get_closure_code(closure);
+        } else {
+            auto lifted = this->lifted_args.find(func);
+            if (lifted != this->lifted_args.end())
+                args = lifted->second;
         }
-        else {
+        if (!this->is_value_func(func)) {
             printf("ERROR: Invalid function type.\n");
             return nullptr;
         }
-        */
 
-        std::vector<omis_value_t *> args;
+        uint32_t hidden = closure != nullptr ? 1 : (uint32_t) args.size();
+        uint32_t args_count = this->get_func_arg_count(func) - hidden;
+        if (node->args.size() != args_count) {
+            printf("ERROR: The function expects %u arguments, but %u are given.\n", args_count, (uint32_t)node->args.size());
+            return nullptr;
+        }
+
         for (auto i = 0; i < node->args.size(); i++) {
-            auto *argT = this->get_func_arg_type(func, i);
+            auto *argT = this->get_func_arg_type(func, i + hidden);
             auto *argV = this->encode_expr(node->args.at(i));
             if (argV == nullptr)
                 return nullptr;
             argV = this->get_ptr_val(argV);
 
-            if (argT != argV->get_type()) {
-                if (equals_type(argT, argV->get_type())) {
-                    /*
-                    if (argT == this->type_cstr) {
-                        argV = func->cstr_from_value(argV);
-                    }
-                    if (argT == this->type_string_ptr) {
-                        argV = func->string_from_value(argV);
+            if (!this->equals_type(argT, argV->get_type())) {
+                auto *argC = this->cast_const_float(argV, argT);
+                if (argC == nullptr)
+                    argC = this->cast_slice(argV, argT);
+                if (argC == nullptr)
+                    argC = this->cast_vector(argV, argT);
+                if (argC == nullptr)
+                    argC = this->cast_closure(argV, argT);
+                if (argC != nullptr) {
+                    args.push_back(argC);
+                    continue;
+                }
+                if (!this->can_losslessly_bitcast(argV->get_type(), argT)) {
+                    printf("ERROR: The type of param[%d] can't cast to the param type of function.\n", i);
+                    return nullptr;
+                }
+                argV = this->bitcast(argV, argT);
+            }
+
+            args.push_back(argV);
+        }
+
+        if (closure != nullptr)
+            return this->call_closure(func, closure, args);
+
+        auto retval = this->call(func, args);
+
+        return retval;
+    }
+
+    omis_value_t *omis_module_coder_t::encode_expr_object_def(ast_node_object_def_t *node) {
+        if (node == nullptr)
+            return nullptr;
+
+        auto *type = this->encode_type_ref(node->type);
+        if (type == nullptr)
+            return nullptr;
+
+        if (dynamic_cast<omis_array_t *>(type) != nullptr) {
+            auto *array = this->make(type);
+            if (array == nullptr)
+                return nullptr;
+            this->store(array, type->get_default_value());
+            return array;
+        }
+
+        auto *struct_type = dynamic_cast<omis_struct_t *>(type);
+        if (struct_type == nullptr) {
+            printf("ERROR: The type '%s' is not a struct.\n", node->type->name.cstr());
+            return nullptr;
+        }
+
+        for (auto &object_member: node->members) {
+            if (struct_type->get_member(object_member.first) == nullptr) {
+                printf("ERROR: Object member '%s' is not defined in struct.\n", object_member.first.cstr());
+                return nullptr;
+            }
+        }
+
+        // Evaluate the member values before the object is made,
+        // so the object is only referenced by the stores below.
+        std::vector<omis_value_t *> values;
+        for (size_t index = 0; index < struct_type->get_member_count(); index++) {
+            auto *struct_member = struct_type->get_member(index);
+            auto object_member = node->members.find(struct_member->name);
+            omis_value_t *value = nullptr;
+            if (object_member != node->members.end()) {
+                value = this->encode_expr(object_member->second);
+                if (value == nullptr)
+                    return nullptr;
+                value = this->get_ptr_val(value);
+                auto *narrowed = this->cast_const_float(value, struct_member->type);
+                if (narrowed == nullptr)
+                    narrowed = this->cast_const_int(value, struct_member->type);
+                if (narrowed == nullptr)
+                    narrowed = this->cast_closure(value, struct_member->type);
+                if (narrowed != nullptr)
+                    value = narrowed;
+                if (!this->equals_type(value->get_type(), struct_member->type)) {
+                    printf("ERROR: The value of member '%s' does not match its type.\n", struct_member->name.cstr());
+                    return nullptr;
+                }
+            } else {
+                value = struct_member->value != nullptr ? struct_member->value : struct_member->type->get_default_value();
+            }
+            values.push_back(value);
+        }
+
+        auto *instance = this->make(struct_type);
+        if (instance == nullptr)
+            return nullptr;
+
+        for (u32_t index = 0; index < values.size(); index++) {
+            auto *ptr = this->gep_struct(instance, struct_type, index);
+            this->store(ptr, values.at(index));
+        }
+
+        return instance;
+    }
+
+    omis_value_t *omis_module_coder_t::encode_expr_object_ref(ast_node_object_ref_t *node) {
+        if (node == nullptr)
+            return nullptr;
+
+        if (node->obj->category == ast_category_t::SYMBOL_REF) {
+            const String &name = dynamic_cast<ast_node_symbol_ref_t *>(node->obj)->name;
+            auto *member = this->scope->get_value_symbol(String::format("%s.%s", name.cstr(), node->key.cstr()), true);
+            if (member != nullptr)
+                return member->value;
+        }
+
+        omis_value_t *object = nullptr;
+        if (node->obj->category == ast_category_t::ARRAY_REF) {
+            omis_value_t *array = nullptr;
+            omis_array_t *array_type = nullptr;
+            omis_value_t *index = nullptr;
+            if (!this->encode_array_index(dynamic_cast<ast_node_array_ref_t *>(node->obj), array, array_type, index))
+                return nullptr;
+
+            // 'a[i].x' of a '#soa' array is element 'i' of the column 'x'.
+            if (array_type != nullptr && array_type->is_soa()) {
+                auto *struct_type = dynamic_cast<omis_struct_t *>(array_type->get_item_type());
+                auto member = struct_type->get_member_index(node->key);
+                if (member == (size_t) -1) {
+                    printf("ERROR: The object doesn't have a member named '%s'.\n", node->key.cstr());
+                    return nullptr;
+                }
+                return this->gep_soa(array, array_type, member, index);
+            }
+
+            if (array_type != nullptr)
+                object = this->gep_array(array, array_type, index);
+            else if (dynamic_cast<omis_slice_t *>(array->get_type()) != nullptr)
+                object = this->gep_slice(array, index);
+            else
+                object = this->vector_lane(array, index);
+            if (object == nullptr)
+                return nullptr;
+        } else {
+            object = this->encode_expr(node->obj);
+            if (object == nullptr)
+                return nullptr;
+        }
+        object = this->get_ptr_val(object);
+
+        auto *element_type = object->get_type()->get_element_type();
+        auto *struct_type = dynamic_cast<omis_struct_t *>(element_type);
+        if (struct_type == nullptr) {
+            printf("ERROR: The value is not a object reference.\n");
+            return nullptr;
+        }
+
+        auto index = struct_type->get_member_index(node->key);
+        if (index == (size_t) -1) {
+            printf("ERROR: The object doesn't have a member named '%s'.\n", node->key.cstr());
+            return nullptr;
+        }
+
+        return this->gep_struct(object, struct_type, index);
+    }
+
+    omis_value_t *omis_module_coder_t::encode_expr_index_ref(ast_node_array_ref_t *node) {
+        if (node == nullptr)
+            return nullptr;
+
+        omis_value_t *array = nullptr;
+        omis_array_t *array_type = nullptr;
+        omis_value_t *index = nullptr;
+        if (node->slice)
+            return this->encode_expr_slice(node);
+
+        if (!this->encode_array_index(node, array, array_type, index))
+            return nullptr;
+
+        if (array_type == nullptr && dynamic_cast<omis_slice_t *>(array->get_type()) != nullptr)
+            return this->gep_slice(array, index);
+        if (array_type == nullptr)
+            return this->vector_lane(array, index);
+
+        if (array_type->is_soa()) {
+            printf("ERROR: The elements of a '#soa' array can only be accessed through their members.\n");
+            return nullptr;
+        }
+
+        return this->gep_array(array, array_type, index);
+    }
+
+    // 'a[i]' of an array, a slice or a vector, array_type is null for slices and vectors.
+    bool omis_module_coder_t::encode_array_index(ast_node_array_ref_t *node, omis_value_t *&array, omis_array_t *&array_type, omis_value_t *&index) {
+        if (node == nullptr)
+            return false;
+
+        if (node->slice) {
+            printf("ERROR: A slice has no members.\n");
+            return false;
+        }
+
+        array = this->encode_expr(node->obj);
+        if (array == nullptr)
+            return false;
+        // A vector in a variable stays in its slot, so that its lanes can be assigned to.
+        if (dynamic_cast<omis_vector_t *>(array->get_type()->get_element_type()) == nullptr)
+            array = this->get_ptr_val(array);
+
+        auto *element_type = array->get_type()->get_element_type();
+        array_type = dynamic_cast<omis_array_t *>(element_type);
+        bool indexable = dynamic_cast<omis_slice_t *>(array->get_type()) != nullptr ||
+                         dynamic_cast<omis_vector_t *>(array->get_type()) != nullptr ||
+                         dynamic_cast<omis_vector_t *>(element_type) != nullptr;
+        if (array_type == nullptr && !indexable) {
+            printf("ERROR: The value is not an array.\n");
+            return false;
+        }
+
+        index = this->encode_expr(node->key);
+        if (index == nullptr)
+            return false;
+        index = this->get_ptr_val(index);
+        if (this->get_int_bits(index->get_type()) == 0) {
+            printf("ERROR: The index of an array must be an integer.\n");
+            return false;
+        }
+
+        if (this->is_safe_index(node, array_type))
+            return true;
+        return this->check_index(array, index);
+    }
+
+    // 'a[begin..end]', 'a[..end]' and 'a[begin..]' view the items of an array or a slice in place.
+    omis_value_t *omis_module_coder_t::encode_expr_slice(ast_node_array_ref_t *node) {
+        auto *array = this->encode_expr(node->obj);
+        if (array == nullptr)
+            return nullptr;
+        array = this->get_ptr_val(array);
+
+        omis_value_t *begin = nullptr;
+        omis_value_t *end = nullptr;
+        if (node->key != nullptr) {
+            begin = this->encode_expr(node->key);
+            if (begin == nullptr)
+                return nullptr;
+            begin = this->get_ptr_val(begin);
+        }
+        if (node->end != nullptr) {
+            end = this->encode_expr(node->end);
+            if (end == nullptr)
+                return nullptr;
+            end = this->get_ptr_val(end);
+        }
+
+        return this->slice(array, begin, end);
+    }
+
+    /**
+     * 'length(a)' is the number of items in the array a.
+     * 'append(a, value)' adds value to the end of the growable array a.
+     * */
+    omis_value_t *omis_module_coder_t::encode_expr_array_builtin(const String &name, ast_node_func_ref_t *node) {
+        size_t args_count = name == "length" ? 1 : 2;
+        if (node->args.size() != args_count) {
+            printf("ERROR: The function expects %u arguments, but %u are given.\n", (uint32_t)args_count, (uint32_t)node->args.size());
+            return nullptr;
+        }
+
+        auto *array = this->encode_expr(node->args.at(0));
+        if (array == nullptr)
+            return nullptr;
+        array = this->get_ptr_val(array);
+
+        if (name == "length")
+            return this->array_length(array);
+
+        auto *value = this->encode_expr(node->args.at(1));
+        if (value == nullptr)
+            return nullptr;
+        value = this->get_ptr_val(value);
+        return this->array_append(array, value);
+    }
+
+    // '[a, b, c, d]' declared as a 'vec4<T>', the items are the lanes.
+    omis_value_t *omis_module_coder_t::encode_expr_vector_def(ast_node_array_def_t *node, omis_vector_t *vector_type) {
+        if (node == nullptr)
+            return nullptr;
+
+        std::vector<omis_value_t *> items;
+        for (auto &element: node->elements) {
+            auto *value = this->encode_expr(element);
+            if (value == nullptr)
+                return nullptr;
+            items.push_back(this->get_ptr_val(value));
+        }
+        return this->value_vector(vector_type, items);
+    }
+
+    /**
+     * 'shuffle(a, 3, 2, 1, 0)' and 'shuffle(a, b, 0, 4, 1, 5)' pick lanes by constant indexes.
+     * 'reduce_add(v)', 'reduce_mul(v)', 'reduce_min(v)' and 'reduce_max(v)' combine the lanes of v.
+     * 'any(m)' and 'all(m)' test the lanes of a mask, 'select(m, a, b)' picks the lanes of a where m is set.
+     * */
+    omis_value_t *omis_module_coder_t::encode_expr_vector_builtin(const String &name, ast_node_func_ref_t *node) {
+        std::vector<omis_value_t *> args;
+        for (auto &arg: node->args) {
+            auto *value = this->encode_expr(arg);
+            if (value == nullptr)
+                return nullptr;
+            args.push_back(this->get_ptr_val(value));
+        }
+
+        size_t args_count = name == "shuffle" ? 2 : name == "select" ? 3 : 1;
+        bool exact = name != "shuffle";
+        if (args.size() < args_count || (exact && args.size() != args_count)) {
+            printf("ERROR: The function expects %u arguments, but %u are given.\n", (uint32_t)args_count, (uint32_t)args.size());
+            return nullptr;
+        }
+
+        if (name == "shuffle") {
+            omis_value_t *other = nullptr;
+            size_t first = 1;
+            if (dynamic_cast<omis_vector_t *>(args.at(1)->get_type()) != nullptr) {
+                other = args.at(1);
+                first = 2;
+            }
+            std::vector<int> lanes;
+            for (size_t index = first; index < args.size(); index++) {
+                i64_t lane = 0;
+                if (!this->get_const_int(args.at(index), lane)) {
+                    printf("ERROR: The lanes of a shuffle must be constants.\n");
+                    return nullptr;
+                }
+                lanes.push_back((int)lane);
+            }
+            return this->shuffle(args.at(0), other, lanes);
+        }
+
+        if (name == "select") {
+            auto *mask = args.at(0);
+            auto *a = args.at(1);
+            auto *b = args.at(2);
+            // A scalar picked by a mask is repeated in every lane.
+            auto *cast_a = this->cast_vector(a, b->get_type());
+            auto *cast_b = this->cast_vector(b, a->get_type());
+            a = cast_a != nullptr ? cast_a : a;
+            b = cast_b != nullptr ? cast_b : b;
+            auto *mask_type = dynamic_cast<omis_vector_t *>(mask->get_type());
+            auto *item_type = mask_type != nullptr ? mask_type->get_item_type() : mask->get_type();
+            if (!this->equals_type(item_type, this->type_bool()) || !this->equals_type(a->get_type(), b->get_type())) {
+                printf("ERROR: 'select' expects a mask and two values of the same type.\n");
+                return nullptr;
+            }
+            auto *value_type = dynamic_cast<omis_vector_t *>(a->get_type());
+            if (mask_type != nullptr && (value_type == nullptr || value_type->get_length() != mask_type->get_length())) {
+                printf("ERROR: The mask and the values of 'select' must have the same number of lanes.\n");
+                return nullptr;
+            }
+            return this->select(mask, a, b);
+        }
+
+        auto *vec = args.at(0);
+        if (name == "any" || name == "all") {
+            auto *mask_type = dynamic_cast<omis_vector_t *>(vec->get_type());
+            if (mask_type == nullptr || !this->equals_type(mask_type->get_item_type(), this->type_bool())) {
+                printf("ERROR: '%s' expects a mask.\n", name.cstr());
+                return nullptr;
+            }
+            return this->reduce(name == "any" ? omis_reduce_op_t::OR : omis_reduce_op_t::AND, vec);
+        }
+
+        auto op = omis_reduce_op_t::ADD;
+        if (name == "reduce_mul")
+            op = omis_reduce_op_t::MUL;
+        else if (name == "reduce_min")
+            op = omis_reduce_op_t::MIN;
+        else if (name == "reduce_max")
+            op = omis_reduce_op_t::MAX;
+        return this->reduce(op, vec);
+    }
+
+    /**
+     * '[a, b, c]' is a fixed-size array of the type of 'a', or of the array type it is declared with.
+     * The array is made like an object, the heap-to-stack promotion keeps local ones on the stack.
+     * */
+    omis_value_t *omis_module_coder_t::encode_expr_array_def(ast_node_array_def_t *node, omis_array_t *array_type) {
+        if (node == nullptr)
+            return nullptr;
+
+        omis_type_t *item_type = array_type != nullptr ? array_type->get_item_type() : nullptr;
+        std::vector<omis_value_t *> items;
+        for (auto &element: node->elements) {
+            auto *value = this->encode_expr(element);
+            if (value == nullptr)
+                return nullptr;
+            value = this->get_ptr_val(value);
+            if (item_type == nullptr) {
+                item_type = value->get_type();
+                auto *element_type = item_type->get_element_type();
+                if (element_type != nullptr && (element_type->is_type_struct() || element_type->is_type_array()))
+                    item_type = element_type;
+            }
+            auto *narrowed = this->cast_const_float(value, item_type);
+            if (narrowed == nullptr)
+                narrowed = this->cast_const_int(value, item_type);
+            if (narrowed != nullptr)
+                value = narrowed;
+            // Struct items are stored inline, the objects are copied into the array.
+            if ((item_type->is_type_struct() || item_type->is_type_array()) && this->equals_type(value->get_type(), item_type->get_pointer_type()))
+                value = this->load(value);
+            if (!this->equals_type(value->get_type(), item_type)) {
+                printf("ERROR: The items of an array must all be of the same type.\n");
+                return nullptr;
+            }
+            items.push_back(value);
+        }
+
+        if (array_type == nullptr) {
+            if (items.empty()) {
+                printf("ERROR: The type of an empty array can not be inferred.\n");
+                return nullptr;
+            }
+            array_type = this->type_array(item_type, items.size());
+            if (array_type == nullptr)
+                return nullptr;
+        } else if (!array_type->is_dynamic() && array_type->get_length() != items.size()) {
+            printf("ERROR: The array has %llu items, but %u are given.\n", (unsigned long long)array_type->get_length(), (uint32_t)items.size());
+            return nullptr;
+        }
+
+        auto *array = this->make(array_type);
+        if (array == nullptr)
+            return nullptr;
+        // Fixed-size arrays are filled completely, only the header of a growable one needs clearing.
+        if (array_type->is_dynamic())
+            this->store(array, array_type->get_default_value());
+        if (this->array_fill(array, array_type, items) == nullptr)
+            return nullptr;
+        return array;
+    }
+
+    /**
+     * loop(var i = <int >= 0>; i < length(a) | <int>; i = i + 1) { ... }
+     * loop(i in <int >= 0>..length(a) | <int>) { ... }
+     * While the body leaves 'i' and 'a' alone, 'i' stays in [0, length(a)) in the body,
+     * arrays only ever grow and slices never change. Indexing 'a' with 'i' needs no bounds check there.
+     * */
+    bool omis_module_coder_t::match_counted_loop(ast_node_loop_t *node, safe_index_t &safe_index) {
+        // Sets the bound or the array of 'i < end'.
+        auto match_end = [&](ast_node_expr_t *end) -> bool {
+            safe_index.array = "";
+            safe_index.bound = -1;
+            if (end->category == ast_category_t::LITERAL_INT) {
+                safe_index.bound = dynamic_cast<ast_node_literal_int_t *>(end)->value;
+                return true;
+            }
+            auto *length = dynamic_cast<ast_node_func_ref_t *>(end);
+            if (length == nullptr || length->func->category != ast_category_t::SYMBOL_REF || length->args.size() != 1)
+                return false;
+            if (dynamic_cast<ast_node_symbol_ref_t *>(length->func)->name != "length" || this->scope->get_value_symbol("length", true) != nullptr)
+                return false;
+            if (length->args.front()->category != ast_category_t::SYMBOL_REF)
+                return false;
+            safe_index.array = dynamic_cast<ast_node_symbol_ref_t *>(length->args.front())->name;
+            // A variable of the module may be assigned by any function the body calls,
+            // a captured one by any closure.
+            auto *symbol = this->scope->get_value_symbol(safe_index.array, true);
+            if (symbol == nullptr || !symbol->variable)
+                return true;
+            return !this->is_module_scope(symbol->scope) && this->captured_vars.count(symbol) == 0;
+        };
+
+        if (!node->counter.isEmpty()) {
+            auto *begin = dynamic_cast<ast_node_literal_int_t *>(node->begin);
+            if (begin == nullptr || begin->value < 0 || !match_end(node->end))
+                return false;
+            safe_index.index = node->counter;
+            if (node->inclusive) {
+                // 'i in 0...n' stays below n + 1, and past any length.
+                if (safe_index.bound < 0)
+                    return false;
+                safe_index.bound += 1;
+            }
+            if (this->writes_symbol(node->body, node->counter) || this->captures_symbol(node->body, node->counter))
+                return false;
+            if (safe_index.array.isEmpty())
+                return true;
+            return !this->writes_symbol(node->body, safe_index.array) && !this->captures_symbol(node->body, safe_index.array);
+        }
+
+        auto *init = dynamic_cast<ast_node_symbol_def_t *>(node->init);
+        if (init == nullptr || !init->variable || init->value == nullptr || init->value->category != ast_category_t::LITERAL_INT)
+            return false;
+        if (dynamic_cast<ast_node_literal_int_t *>(init->value)->value < 0)
+            return false;
+        const String &counter = init->name;
+
+        auto is_counter = [&](ast_node_expr_t *expr) -> bool {
+            return expr != nullptr && expr->category == ast_category_t::SYMBOL_REF && dynamic_cast<ast_node_symbol_ref_t *>(expr)->name == counter;
+        };
+
+        auto *cond = dynamic_cast<ast_node_expr_binary_t *>(node->cond);
+        if (cond == nullptr || cond->op != ast_binary_oper_t::LT || !is_counter(cond->left))
+            return false;
+        safe_index.index = counter;
+        if (!match_end(cond->right))
+            return false;
+        // An i32 counter overflows before it reaches the length of an array longer than INT32_MAX.
+        if (!safe_index.array.isEmpty() && (init->type == nullptr || init->type->name != "i64")) {
+            auto *symbol = this->scope->get_value_symbol(safe_index.array, true);
+            // The symbol holds the array, or a reference to it.
+            omis_array_t *array_type = nullptr;
+            for (auto *type = symbol != nullptr ? symbol->value->get_type() : nullptr; type != nullptr && array_type == nullptr; type = type->get_element_type())
+                array_type = dynamic_cast<omis_array_t *>(type);
+            if (array_type == nullptr || array_type->is_dynamic() || array_type->get_length() > INT32_MAX)
+                return false;
+        }
+
+        auto *step = dynamic_cast<ast_node_assign_t *>(node->step);
+        if (step == nullptr || !is_counter(step->left))
+            return false;
+        auto *increment = dynamic_cast<ast_node_expr_binary_t *>(step->right);
+        if (increment == nullptr || increment->op != ast_binary_oper_t::ADD || !is_counter(increment->left))
+            return false;
+        auto *one = dynamic_cast<ast_node_literal_int_t *>(increment->right);
+        if (one == nullptr || one->value != 1)
+            return false;
+
+        if (this->writes_symbol(node->body, counter) || this->captures_symbol(node->body, counter))
+            return false;
+        if (!safe_index.array.isEmpty() && (this->writes_symbol(node->body, safe_index.array) || this->captures_symbol(node->body, safe_index.array)))
+            return false;
+        return true;
+    }
+
+    // Whether the statement assigns or redefines the symbol.
+    bool omis_module_coder_t::writes_symbol(ast_node_stmt_t *node, const String &name) {
+        if (node == nullptr)
+            return false;
+
+        switch (node->category) {
+            case ast_category_t::BLOCK:
+                for (auto *stmt: dynamic_cast<ast_node_block_t *>(node)->stmts) {
+                    if (this->writes_symbol(stmt, name))
+                        return true;
+                }
+                return false;
+            case ast_category_t::ASSIGN: {
+                auto *left = dynamic_cast<ast_node_assign_t *>(node)->left;
+                return left->category == ast_category_t::SYMBOL_REF && dynamic_cast<ast_node_symbol_ref_t *>(left)->name == name;
+            }
+            case ast_category_t::SYMBOL_DEF:
+                return dynamic_cast<ast_node_symbol_def_t *>(node)->name == name;
+            case ast_category_t::IF: {
+                auto *branch = dynamic_cast<ast_node_if_t *>(node);
+                return this->writes_symbol(branch->branch_true, name) || this->writes_symbol(branch->branch_false, name);
+            }
+            case ast_category_t::MATCH: {
+                auto *match = dynamic_cast<ast_node_match_t *>(node);
+                for (auto &match_case: match->cases) {
+                    if (this->writes_symbol(match_case.body, name))
+                        return true;
+                }
+                return this->writes_symbol(match->other, name);
+            }
+            case ast_category_t::TRY: {
+                auto *branch = dynamic_cast<ast_node_try_t *>(node);
+                for (auto &item: branch->catches) {
+                    if (item.name == name || this->writes_symbol(item.body, name))
+                        return true;
+                }
+                return this->writes_symbol(branch->body, name);
+            }
+            case ast_category_t::LOOP: {
+                auto *loop = dynamic_cast<ast_node_loop_t *>(node);
+                if (loop->counter == name)
+                    return true;
+                return this->writes_symbol(loop->init, name) || this->writes_symbol(loop->step, name) || this->writes_symbol(loop->body, name);
+            }
+            default:
+                return false;
+        }
+    }
+
+    // Whether a closure defined in the statement uses the symbol.
+    bool omis_module_coder_t::captures_symbol(ast_node_stmt_t *node, const String &name) {
+        bool captured = false;
+        this->walk_nodes(node, [&](ast_node_t *item) -> bool {
+            if (captured)
+                return false;
+            if (item->category != ast_category_t::FUNC_DEF)
+                return true;
+            std::vector<String> names;
+            this->collect_free_names(dynamic_cast<ast_node_func_def_t *>(item), names);
+            captured = std::find(names.begin(), names.end(), name) != names.end();
+            return false;
+        });
+        return captured;
+    }
+
+    bool omis_module_coder_t::is_safe_index(ast_node_array_ref_t *node, omis_array_t *array_type) {
+        if (node->key->category != ast_category_t::SYMBOL_REF)
+            return false;
+        const String &index = dynamic_cast<ast_node_symbol_ref_t *>(node->key)->name;
+        for (auto &safe_index: this->safe_indices) {
+            if (safe_index.index != index)
+                continue;
+            if (safe_index.bound >= 0) {
+                if (array_type != nullptr && !array_type->is_dynamic() && (u64_t)safe_index.bound <= array_type->get_length())
+                    return true;
+                continue;
+            }
+            if (node->obj->category == ast_category_t::SYMBOL_REF && dynamic_cast<ast_node_symbol_ref_t *>(node->obj)->name == safe_index.array)
+                return true;
+        }
+        return false;
+    }
+
+    // Visits the node and, as long as visit returns true for them, the nodes in it.
+    void omis_module_coder_t::walk_nodes(ast_node_t *node, const std::function<bool(ast_node_t *)> &visit) {
+        if (node == nullptr || !visit(node))
+            return;
+
+        switch (node->category) {
+            case ast_category_t::FUNC_DEF:
+                for (auto *stmt: dynamic_cast<ast_node_func_def_t *>(node)->body) {
+                    this->walk_nodes(stmt, visit);
+                }
+                break;
+            case ast_category_t::FUNC_REF: {
+                auto *ref = dynamic_cast<ast_node_func_ref_t *>(node);
+                this->walk_nodes(ref->func, visit);
+                for (auto *arg: ref->args) {
+                    this->walk_nodes(arg, visit);
+                }
+                break;
+            }
+            case ast_category_t::SYMBOL_DEF:
+                this->walk_nodes(dynamic_cast<ast_node_symbol_def_t *>(node)->value, visit);
+                break;
+            case ast_category_t::EXPR_TRINARY: {
+                auto *expr = dynamic_cast<ast_node_expr_trinary_t *>(node);
+                this->walk_nodes(expr->cond, visit);
+                this->walk_nodes(expr->branch_true, visit);
+                this->walk_nodes(expr->branch_false, visit);
+                break;
+            }
+            case ast_category_t::EXPR_BINARY: {
+                auto *expr = dynamic_cast<ast_node_expr_binary_t *>(node);
+                this->walk_nodes(expr->left, visit);
+                this->walk_nodes(expr->right, visit);
+                break;
+            }
+            case ast_category_t::EXPR_UNARY:
+                this->walk_nodes(dynamic_cast<ast_node_expr_unary_t *>(node)->right, visit);
+                break;
+            case ast_category_t::ARRAY_DEF:
+                for (auto *element: dynamic_cast<ast_node_array_def_t *>(node)->elements) {
+                    this->walk_nodes(element, visit);
+                }
+                break;
+            case ast_category_t::ARRAY_REF: {
+                auto *ref = dynamic_cast<ast_node_array_ref_t *>(node);
+                this->walk_nodes(ref->obj, visit);
+                this->walk_nodes(ref->key, visit);
+                this->walk_nodes(ref->end, visit);
+                break;
+            }
+            case ast_category_t::OBJECT_DEF:
+                for (auto &member: dynamic_cast<ast_node_object_def_t *>(node)->members) {
+                    this->walk_nodes(member.second, visit);
+                }
+                break;
+            case ast_category_t::OBJECT_REF:
+                this->walk_nodes(dynamic_cast<ast_node_object_ref_t *>(node)->obj, visit);
+                break;
+            case ast_category_t::STRUCT_DEF:
+                for (auto &member: dynamic_cast<ast_node_struct_def_t *>(node)->members) {
+                    this->walk_nodes(member.value, visit);
+                }
+                break;
+            case ast_category_t::RETURN:
+                this->walk_nodes(dynamic_cast<ast_node_return_t *>(node)->value, visit);
+                break;
+            case ast_category_t::IF: {
+                auto *branch = dynamic_cast<ast_node_if_t *>(node);
+                this->walk_nodes(branch->cond, visit);
+                this->walk_nodes(branch->branch_true, visit);
+                this->walk_nodes(branch->branch_false, visit);
+                break;
+            }
+            case ast_category_t::MATCH: {
+                auto *match = dynamic_cast<ast_node_match_t *>(node);
+                this->walk_nodes(match->value, visit);
+                for (auto &match_case: match->cases) {
+                    for (auto *value: match_case.values) {
+                        this->walk_nodes(value, visit);
                     }
-                    else if(this->can_losslessly_bitcast(argV->get_type(), argT)) {
-                        printf("ERROR: The type of param[%d] can't cast to the param type of function.\n", i);
-                        return nullptr;
+                    this->walk_nodes(match_case.body, visit);
+                }
+                this->walk_nodes(match->other, visit);
+                break;
+            }
+            case ast_category_t::LOOP: {
+                auto *loop = dynamic_cast<ast_node_loop_t *>(node);
+                this->walk_nodes(loop->init, visit);
+                this->walk_nodes(loop->cond, visit);
+                this->walk_nodes(loop->step, visit);
+                this->walk_nodes(loop->begin, visit);
+                this->walk_nodes(loop->end, visit);
+                this->walk_nodes(loop->body, visit);
+                break;
+            }
+            case ast_category_t::TRY: {
+                auto *branch = dynamic_cast<ast_node_try_t *>(node);
+                this->walk_nodes(branch->body, visit);
+                for (auto &item: branch->catches) {
+                    this->walk_nodes(item.body, visit);
+                }
+                break;
+            }
+            case ast_category_t::THROW:
+                this->walk_nodes(dynamic_cast<ast_node_throw_t *>(node)->value, visit);
+                break;
+            case ast_category_t::BLOCK:
+                for (auto *stmt: dynamic_cast<ast_node_block_t *>(node)->stmts) {
+                    this->walk_nodes(stmt, visit);
+                }
+                break;
+            case ast_category_t::ASSIGN: {
+                auto *assign = dynamic_cast<ast_node_assign_t *>(node);
+                this->walk_nodes(assign->left, visit);
+                this->walk_nodes(assign->right, visit);
+                break;
+            }
+            case ast_category_t::INVOKE:
+                this->walk_nodes(dynamic_cast<ast_node_invoke_t *>(node)->expr, visit);
+                break;
+            default:
+                break;
+        }
+    }
+
+    /**
+     * A 'val name = func...' defined in the function is lifted if every use of the name,
+     * in nested functions as well, calls it from the function itself. It is never a value
+     * then, so it needs no record and its captures are passed as args.
+     * */
+    void omis_module_coder_t::collect_lifted_funcs(ast_node_func_def_t *node) {
+        std::map<String, ast_node_func_def_t *> candidates;
+        std::map<String, u32_t> calls;
+        std::map<String, u32_t> refs;
+        std::vector<ast_node_func_def_t *> nested;
+
+        for (auto *stmt: node->body) {
+            this->walk_nodes(stmt, [&](ast_node_t *item) -> bool {
+                if (item->category == ast_category_t::FUNC_DEF) {
+                    nested.push_back(dynamic_cast<ast_node_func_def_t *>(item));
+                    return false;
+                }
+                if (item->category == ast_category_t::SYMBOL_DEF) {
+                    auto *def = dynamic_cast<ast_node_symbol_def_t *>(item);
+                    bool func = !def->variable && def->value != nullptr && def->value->category == ast_category_t::FUNC_DEF;
+                    // A name defined twice is not followed.
+                    if (candidates.count(def->name) > 0)
+                        candidates[def->name] = nullptr;
+                    else if (func)
+                        candidates[def->name] = dynamic_cast<ast_node_func_def_t *>(def->value);
+                }
+                if (item->category == ast_category_t::FUNC_REF) {
+                    auto *ref = dynamic_cast<ast_node_func_ref_t *>(item);
+                    if (ref->func->category == ast_category_t::SYMBOL_REF)
+                        calls[dynamic_cast<ast_node_symbol_ref_t *>(ref->func)->name] += 1;
+                }
+                return true;
+            });
+            this->walk_nodes(stmt, [&](ast_node_t *item) -> bool {
+                if (item->category == ast_category_t::SYMBOL_REF)
+                    refs[dynamic_cast<ast_node_symbol_ref_t *>(item)->name] += 1;
+                return true;
+            });
+        }
+
+        for (auto &pair: candidates) {
+            if (pair.second != nullptr && refs[pair.first] == calls[pair.first])
+                this->lifted_funcs.insert(pair.second);
+        }
+        for (auto *func: nested) {
+            this->collect_lifted_funcs(func);
+        }
+    }
+
+    // The names the body of the function uses but does not define, nested functions included.
+    void omis_module_coder_t::collect_free_names(ast_node_func_def_t *node, std::vector<String> &names) {
+        std::vector<std::set<String>> scopes;
+        this->collect_free_names(node, scopes, names);
+    }
+
+    /**
+     * A name is defined from its definition to the end of the scope, like the encoder looks it up:
+     * a use before it, in a sibling block or next to a nested function's arg refers to the outer symbol.
+     * */
+    void omis_module_coder_t::collect_free_names(ast_node_t *node, std::vector<std::set<String>> &scopes, std::vector<String> &names) {
+        if (node == nullptr)
+            return;
+
+        switch (node->category) {
+            case ast_category_t::FUNC_DEF: {
+                auto *func = dynamic_cast<ast_node_func_def_t *>(node);
+                scopes.push_back({"self"});
+                for (auto &arg: func->args) {
+                    scopes.back().insert(arg.name);
+                }
+                for (auto *stmt: func->body) {
+                    this->collect_free_names(stmt, scopes, names);
+                }
+                scopes.pop_back();
+                return;
+            }
+            case ast_category_t::SYMBOL_DEF: {
+                auto *def = dynamic_cast<ast_node_symbol_def_t *>(node);
+                this->collect_free_names(def->value, scopes, names);
+                scopes.back().insert(def->name);
+                return;
+            }
+            case ast_category_t::BLOCK:
+                scopes.push_back({});
+                for (auto *stmt: dynamic_cast<ast_node_block_t *>(node)->stmts) {
+                    this->collect_free_names(stmt, scopes, names);
+                }
+                scopes.pop_back();
+                return;
+            case ast_category_t::IF: {
+                auto *branch = dynamic_cast<ast_node_if_t *>(node);
+                this->collect_free_names(branch->cond, scopes, names);
+                this->collect_free_names(branch->branch_true, scopes, names);
+                this->collect_free_names(branch->branch_false, scopes, names);
+                return;
+            }
+            case ast_category_t::MATCH: {
+                auto *match = dynamic_cast<ast_node_match_t *>(node);
+                this->collect_free_names(match->value, scopes, names);
+                for (auto &match_case: match->cases) {
+                    for (auto *value: match_case.values) {
+                        this->collect_free_names(value, scopes, names);
                     }
-                    */
+                    this->collect_free_names(match_case.body, scopes, names);
+                }
+                this->collect_free_names(match->other, scopes, names);
+                return;
+            }
+            case ast_category_t::LOOP: {
+                auto *loop = dynamic_cast<ast_node_loop_t *>(node);
+                scopes.push_back({});
+                this->collect_free_names(loop->init, scopes, names);
+                this->collect_free_names(loop->begin, scopes, names);
+                this->collect_free_names(loop->end, scopes, names);
+                if (!loop->counter.isEmpty())
+                    scopes.back().insert(loop->counter);
+                this->collect_free_names(loop->cond, scopes, names);
+                this->collect_free_names(loop->step, scopes, names);
+                this->collect_free_names(loop->body, scopes, names);
+                scopes.pop_back();
+                return;
+            }
+            case ast_category_t::TRY: {
+                auto *branch = dynamic_cast<ast_node_try_t *>(node);
+                this->collect_free_names(branch->body, scopes, names);
+                for (auto &item: branch->catches) {
+                    scopes.push_back({item.name});
+                    this->collect_free_names(item.body, scopes, names);
+                    scopes.pop_back();
                 }
+                return;
+            }
+            default:
+                break;
+        }
 
-                args.push_back(argV);
+        // Expressions and the other statements, their nested functions and statements have scopes of their own.
+        this->walk_nodes(node, [&](ast_node_t *item) -> bool {
+            switch (item->category) {
+                case ast_category_t::SYMBOL_REF: {
+                    auto &name = dynamic_cast<ast_node_symbol_ref_t *>(item)->name;
+                    bool defined = false;
+                    for (auto &scope: scopes) {
+                        defined = defined || scope.count(name) > 0;
+                    }
+                    if (!defined && std::find(names.begin(), names.end(), name) == names.end())
+                        names.push_back(name);
+                    return true;
+                }
+                case ast_category_t::FUNC_DEF:
+                case ast_category_t::SYMBOL_DEF:
+                case ast_category_t::BLOCK:
+                case ast_category_t::IF:
+                case ast_category_t::MATCH:
+                case ast_category_t::LOOP:
+                case ast_category_t::TRY:
+                    this->collect_free_names(item, scopes, names);
+                    return false;
+                default:
+                    return true;
             }
+        });
+    }
 
-            auto retval = this->call(func, args);
+    // The variables of the function which closures that are not lifted use, they are boxed.
+    std::set<String> omis_module_coder_t::collect_boxed_vars(ast_node_func_def_t *node) {
+        std::set<String> boxed;
+        for (auto *stmt: node->body) {
+            this->walk_nodes(stmt, [&](ast_node_t *item) -> bool {
+                auto *func = dynamic_cast<ast_node_func_def_t *>(item);
+                if (func == nullptr || this->lifted_funcs.count(func) > 0)
+                    return true;
+                std::vector<String> names;
+                this->collect_free_names(func, names);
+                boxed.insert(names.begin(), names.end());
+                return true;
+            });
+        }
+        return boxed;
+    }
 
-            return retval;
+    /**
+     * The locals of the outer functions the function uses, looked up where it is defined.
+     * A closure which is not lifted may outlive the frame of a variable, it can only
+     * capture the variables which are boxed.
+     * */
+    bool omis_module_coder_t::collect_captures(ast_node_func_def_t *node, bool lifted, std::vector<capture_t> &captures) {
+        std::vector<String> names;
+        this->collect_free_names(node, names);
+        for (auto &name: names) {
+            auto *symbol = this->scope->get_value_symbol(name, true);
+            if (symbol == nullptr || this->is_module_scope(symbol->scope))
+                continue;
+            if (this->is_value_const(symbol->value))
+                continue;
+
+            capture_t capture = {name, symbol->value, nullptr, symbol->variable};
+            if (symbol->variable) {
+                auto box = this->box_refs.find(symbol->value);
+                if (box != this->box_refs.end()) {
+                    capture.value = box->second;
+                    capture.box = dynamic_cast<omis_struct_t *>(box->second->get_type()->get_element_type());
+                } else if (!lifted) {
+                    printf("ERROR: The variable '%s' can't be captured by a closure which escapes.\n", name.cstr());
+                    return false;
+                }
+                this->captured_vars.insert(symbol);
+            }
+            captures.push_back(capture);
         }
+        return true;
+    }
+
+    // Moves the value of a variable into a box, its member is the slot of the variable from now on.
+    omis_value_t *omis_module_coder_t::box_var(omis_value_t *slot) {
+        auto *type = this->type_box(slot->get_type()->get_element_type());
+        auto *box = this->make(type);
+        if (box == nullptr)
+            return nullptr;
+        auto *member = this->gep_struct(box, type, 0);
+        this->store(member, this->load(slot));
+        this->box_refs[member] = box;
+        return member;
     }
 }
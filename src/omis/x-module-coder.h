@@ -4,6 +4,8 @@
 
 #include "./model.h"
 
+#include <set>
+
 namespace eokas {
     class omis_module_coder_t :public omis_module_t {
     public:
@@ -16,16 +18,24 @@ namespace eokas {
         bool encode_stmt_assign(ast_node_assign_t* node);
         bool encode_stmt_return(ast_node_return_t* node);
         bool encode_stmt_if(ast_node_if_t* node);
+        bool encode_stmt_match(ast_node_match_t* node);
+        bool encode_stmt_try(ast_node_try_t* node);
+        bool encode_stmt_throw(ast_node_throw_t* node);
         bool encode_stmt_loop(ast_node_loop_t* node);
         bool encode_stmt_break(ast_node_break_t* node);
         bool encode_stmt_continue(ast_node_continue_t* node);
+        bool encode_stmt_invoke(ast_node_invoke_t* node);
+        bool encode_stmt_struct_def(ast_node_struct_def_t* node);
+        bool encode_stmt_enum_def(ast_node_enum_def_t* node);
 
         omis_type_t* encode_type_ref(ast_node_type_t* node);
+        bool encode_func_sign(ast_node_type_t* node, omis_type_t*& ret_type, std::vector<omis_type_t*>& args_types);
 
         omis_value_t* encode_expr(ast_node_expr_t *node);
         omis_value_t* encode_expr_trinary(struct ast_node_expr_trinary_t *node);
         omis_value_t* encode_expr_binary(ast_node_expr_binary_t *node);
         omis_value_t *encode_expr_unary(ast_node_expr_unary_t *node);
+        omis_value_t *encode_expr_size_of(ast_node_expr_t *node);
         omis_value_t *encode_expr_int(ast_node_literal_int_t *node);
         omis_value_t *encode_expr_float(ast_node_literal_float_t *node);
         omis_value_t *encode_expr_bool(ast_node_literal_bool_t *node);
@@ -33,10 +43,57 @@ namespace eokas {
         omis_value_t *encode_expr_symbol_ref(ast_node_symbol_ref_t *node);
         omis_value_t* encode_expr_func_def(ast_node_func_def_t* node);
         omis_value_t* encode_expr_func_ref(ast_node_func_ref_t* node);
+        omis_value_t* encode_expr_object_def(ast_node_object_def_t* node);
+        omis_value_t* encode_expr_object_ref(ast_node_object_ref_t* node);
+        omis_value_t* encode_expr_index_ref(ast_node_array_ref_t* node);
+        omis_value_t* encode_expr_slice(ast_node_array_ref_t* node);
+        omis_value_t* encode_expr_array_def(ast_node_array_def_t* node, omis_array_t* array_type = nullptr);
+        omis_value_t* encode_expr_array_builtin(const String& name, ast_node_func_ref_t* node);
+        omis_value_t* encode_expr_vector_def(ast_node_array_def_t* node, omis_vector_t* vector_type);
+        omis_value_t* encode_expr_vector_builtin(const String& name, ast_node_func_ref_t* node);
 
     private:
+        // In the body of a counted loop, 'index' stays in the bounds of 'array', or below 'bound' if it is not negative.
+        struct safe_index_t {
+            String index;
+            String array;
+            i64_t bound;
+        };
+
+        // A local of an outer function a closure uses, an immutable one by value,
+        // a mutable one by its box, or by its slot if the closure is lifted.
+        struct capture_t {
+            String name;
+            omis_value_t* value;
+            omis_struct_t* box;
+            bool variable;
+        };
+
+        void walk_nodes(ast_node_t* node, const std::function<bool(ast_node_t*)>& visit);
+        void collect_lifted_funcs(ast_node_func_def_t* node);
+        void collect_free_names(ast_node_func_def_t* node, std::vector<String>& names);
+        void collect_free_names(ast_node_t* node, std::vector<std::set<String>>& scopes, std::vector<String>& names);
+        std::set<String> collect_boxed_vars(ast_node_func_def_t* node);
+        bool collect_captures(ast_node_func_def_t* node, bool lifted, std::vector<capture_t>& captures);
+        bool captures_symbol(ast_node_stmt_t* node, const String& name);
+        omis_value_t* box_var(omis_value_t* slot);
+
+        bool is_speculatable_expr(ast_node_expr_t* node, int& budget);
+        bool encode_array_index(ast_node_array_ref_t* node, omis_value_t*& array, omis_array_t*& array_type, omis_value_t*& index);
+        bool match_counted_loop(ast_node_loop_t* node, safe_index_t& safe_index);
+        bool writes_symbol(ast_node_stmt_t* node, const String& name);
+        bool is_safe_index(ast_node_array_ref_t* node, omis_array_t* array_type);
+
         omis_value_t* continue_point;
         omis_value_t* break_point;
+        std::vector<safe_index_t> safe_indices;
+        // Closures only ever called by name in the function defining them, they take their captures as leading args.
+        std::set<ast_node_func_def_t*> lifted_funcs;
+        std::map<omis_value_t*, std::vector<omis_value_t*>> lifted_args;
+        // The variables of the function being encoded which closures capture, and the boxes they live in.
+        std::set<String> boxed_vars;
+        std::map<omis_value_t*, omis_value_t*> box_refs;
+        std::set<omis_value_symbol_t*> captured_vars;
     };
 }
 
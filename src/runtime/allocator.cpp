@@ -0,0 +1,200 @@
+#include "./allocator.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+namespace eokas {
+    static const uint64_t size_classes[EOKAS_SIZE_CLASS_COUNT] = {16, 32, 48, 64, 96, 128, 192, 256};
+
+    // Every slab is carved into blocks of one class, a refill moves a batch into the thread cache
+    // and a thread cache holding too many free blocks gives a batch back.
+    static const uint64_t slab_size = 64 * 1024;
+    static const uint32_t batch_size = 64;
+    static const uint32_t cache_limit = 4 * batch_size;
+
+    struct central_list_t {
+        std::mutex mutex;
+        void* head = nullptr;
+        uint32_t count = 0;
+    };
+
+    struct thread_cache_t;
+
+    struct allocator_registry_t {
+        std::mutex mutex;
+        std::vector<thread_cache_t*> caches;
+        central_list_t centrals[EOKAS_SIZE_CLASS_COUNT];
+        std::atomic<uint64_t> slab_bytes{0};
+        // Counters of the threads which have exited.
+        eokas_allocator_stats_t retired = {};
+    };
+
+    static allocator_registry_t& registry() {
+        static allocator_registry_t instance;
+        return instance;
+    }
+
+    static inline void*& next_of(void* block) {
+        return *reinterpret_cast<void**>(block);
+    }
+
+    struct thread_cache_t {
+        void* heads[EOKAS_SIZE_CLASS_COUNT] = {};
+        uint32_t counts[EOKAS_SIZE_CLASS_COUNT] = {};
+        // Only the owner thread writes these, relaxed atomics let eokas_allocator_stats read them.
+        std::atomic<uint64_t> allocs[EOKAS_SIZE_CLASS_COUNT] = {};
+        std::atomic<uint64_t> frees[EOKAS_SIZE_CLASS_COUNT] = {};
+        std::atomic<uint64_t> refills{0};
+
+        thread_cache_t() {
+            auto& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            reg.caches.push_back(this);
+        }
+
+        ~thread_cache_t() {
+            auto& reg = registry();
+            for (uint32_t size_class = 0; size_class < EOKAS_SIZE_CLASS_COUNT; size_class++) {
+                this->release(size_class, this->counts[size_class]);
+            }
+
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            this->collect(reg.retired);
+            for (auto iter = reg.caches.begin(); iter != reg.caches.end(); ++iter) {
+                if (*iter == this) {
+                    reg.caches.erase(iter);
+                    break;
+                }
+            }
+        }
+
+        void collect(eokas_allocator_stats_t& stats) {
+            for (uint32_t size_class = 0; size_class < EOKAS_SIZE_CLASS_COUNT; size_class++) {
+                auto allocs = this->allocs[size_class].load(std::memory_order_relaxed);
+                auto frees = this->frees[size_class].load(std::memory_order_relaxed);
+                stats.class_allocs[size_class] += allocs;
+                stats.class_frees[size_class] += frees;
+                stats.allocs += allocs;
+                stats.frees += frees;
+            }
+            stats.refills += this->refills.load(std::memory_order_relaxed);
+        }
+
+        void* refill(uint32_t size_class) {
+            auto& reg = registry();
+            auto& central = reg.centrals[size_class];
+            this->refills.store(this->refills.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            {
+                std::lock_guard<std::mutex> lock(central.mutex);
+                while (central.head != nullptr && this->counts[size_class] < batch_size) {
+                    void* block = central.head;
+                    central.head = next_of(block);
+                    central.count--;
+                    next_of(block) = this->heads[size_class];
+                    this->heads[size_class] = block;
+                    this->counts[size_class]++;
+                }
+            }
+
+            if (this->heads[size_class] == nullptr) {
+                auto* slab = static_cast<char*>(std::malloc(slab_size));
+                if (slab == nullptr) {
+                    fprintf(stderr, "ERROR: Out of memory.\n");
+                    std::abort();
+                }
+                reg.slab_bytes.fetch_add(slab_size, std::memory_order_relaxed);
+
+                auto stride = size_classes[size_class];
+                for (uint64_t offset = 0; offset + stride <= slab_size; offset += stride) {
+                    void* block = slab + offset;
+                    next_of(block) = this->heads[size_class];
+                    this->heads[size_class] = block;
+                    this->counts[size_class]++;
+                }
+            }
+
+            return this->heads[size_class];
+        }
+
+        void release(uint32_t size_class, uint32_t count) {
+            if (count == 0)
+                return;
+
+            auto& central = registry().centrals[size_class];
+            std::lock_guard<std::mutex> lock(central.mutex);
+            while (count > 0 && this->heads[size_class] != nullptr) {
+                void* block = this->heads[size_class];
+                this->heads[size_class] = next_of(block);
+                this->counts[size_class]--;
+                next_of(block) = central.head;
+                central.head = block;
+                central.count++;
+                count--;
+            }
+        }
+    };
+
+    static thread_local thread_cache_t thread_cache;
+}
+
+using namespace eokas;
+
+uint32_t eokas_size_class(uint64_t size) {
+    for (uint32_t size_class = 0; size_class < EOKAS_SIZE_CLASS_COUNT; size_class++) {
+        if (size <= size_classes[size_class])
+            return size_class;
+    }
+    return EOKAS_SIZE_CLASS_NONE;
+}
+
+uint64_t eokas_size_class_bytes(uint32_t size_class) {
+    if (size_class >= EOKAS_SIZE_CLASS_COUNT)
+        return 0;
+    return size_classes[size_class];
+}
+
+void* eokas_alloc(uint32_t size_class) {
+    auto& cache = thread_cache;
+    void* block = cache.heads[size_class];
+    if (block == nullptr)
+        block = cache.refill(size_class);
+    cache.heads[size_class] = next_of(block);
+    cache.counts[size_class]--;
+
+    auto& allocs = cache.allocs[size_class];
+    allocs.store(allocs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return block;
+}
+
+void eokas_free(void* ptr, uint32_t size_class) {
+    if (ptr == nullptr)
+        return;
+
+    auto& cache = thread_cache;
+    next_of(ptr) = cache.heads[size_class];
+    cache.heads[size_class] = ptr;
+    cache.counts[size_class]++;
+
+    auto& frees = cache.frees[size_class];
+    frees.store(frees.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if (cache.counts[size_class] > cache_limit)
+        cache.release(size_class, batch_size);
+}
+
+void eokas_allocator_stats(eokas_allocator_stats_t* stats) {
+    if (stats == nullptr)
+        return;
+
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    *stats = reg.retired;
+    for (auto* cache: reg.caches) {
+        cache->collect(*stats);
+    }
+    stats->slab_bytes = reg.slab_bytes.load(std::memory_order_relaxed);
+}
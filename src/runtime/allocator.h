@@ -0,0 +1,36 @@
+#ifndef _EOKAS_RUNTIME_ALLOCATOR_H_
+#define _EOKAS_RUNTIME_ALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Small objects are served from per-thread free lists, one per size class.
+ * The compiler knows the size of every 'make T' and passes the size class,
+ * so the runtime never has to look it up. Objects larger than the largest
+ * class use malloc/free directly.
+ * */
+
+#define EOKAS_SIZE_CLASS_COUNT 8
+#define EOKAS_SIZE_CLASS_NONE 0xFFFFFFFFu
+
+extern "C" {
+    struct eokas_allocator_stats_t {
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t refills;
+        uint64_t slab_bytes;
+        uint64_t class_allocs[EOKAS_SIZE_CLASS_COUNT];
+        uint64_t class_frees[EOKAS_SIZE_CLASS_COUNT];
+    };
+
+    uint32_t eokas_size_class(uint64_t size);
+    uint64_t eokas_size_class_bytes(uint32_t size_class);
+
+    void* eokas_alloc(uint32_t size_class);
+    void eokas_free(void* ptr, uint32_t size_class);
+
+    void eokas_allocator_stats(eokas_allocator_stats_t* stats);
+}
+
+#endif //_EOKAS_RUNTIME_ALLOCATOR_H_
@@ -0,0 +1,48 @@
+#include "./array.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace eokas {
+    static const uint64_t min_capacity = 4;
+}
+
+using namespace eokas;
+
+void eokas_array_reserve(eokas_array_t* array, uint64_t item_size, uint64_t capacity) {
+    if (capacity <= array->capacity)
+        return;
+
+    uint64_t target = array->capacity * 2;
+    if (target < min_capacity)
+        target = min_capacity;
+    if (target < capacity)
+        target = capacity;
+
+    void* data = std::realloc(array->data, target * item_size);
+    if (data == nullptr) {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        std::abort();
+    }
+    array->data = data;
+    array->capacity = target;
+}
+
+void eokas_array_release(eokas_array_t* array) {
+    if (array == nullptr)
+        return;
+    std::free(array->data);
+    array->data = nullptr;
+    array->length = 0;
+    array->capacity = 0;
+}
+
+void eokas_bounds_error(int64_t index, uint64_t length) {
+    fprintf(stderr, "ERROR: The index %lld is out of the bounds of an array of length %llu.\n", (long long)index, (unsigned long long)length);
+    std::abort();
+}
+
+void eokas_range_error(int64_t begin, int64_t end, uint64_t length) {
+    fprintf(stderr, "ERROR: The range [%lld, %lld) is out of the bounds of an array of length %llu.\n", (long long)begin, (long long)end, (unsigned long long)length);
+    std::abort();
+}
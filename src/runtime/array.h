@@ -0,0 +1,33 @@
+#ifndef _EOKAS_RUNTIME_ARRAY_H_
+#define _EOKAS_RUNTIME_ARRAY_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Growable 'array<T>' values point to a header holding the length, the
+ * capacity and the elements. The compiler appends in place while there is
+ * room and only calls into the runtime to grow the elements, which doubles
+ * the capacity so appending stays amortized O(1).
+ *
+ * Growing may move the elements, slices taken before it still point to the
+ * old ones and must not be used afterwards.
+ * */
+
+extern "C" {
+    struct eokas_array_t {
+        uint64_t length;
+        uint64_t capacity;
+        void* data;
+    };
+
+    void eokas_array_reserve(eokas_array_t* array, uint64_t item_size, uint64_t capacity);
+    void eokas_array_release(eokas_array_t* array);
+
+    // Called by checked 'a[i]' when i is not in [0, length), never returns.
+    void eokas_bounds_error(int64_t index, uint64_t length);
+    // Called by checked 'a[begin..end]' when not 0 <= begin <= end <= length, never returns.
+    void eokas_range_error(int64_t begin, int64_t end, uint64_t length);
+}
+
+#endif //_EOKAS_RUNTIME_ARRAY_H_
@@ -0,0 +1,16 @@
+#include "./exception.h"
+
+#include <cxxabi.h>
+#include <typeinfo>
+
+void eokas_throw(void* object, const void* type_info) {
+    auto* slot = static_cast<void**>(__cxxabiv1::__cxa_allocate_exception(sizeof(void*)));
+    *slot = object;
+    __cxxabiv1::__cxa_throw(slot, const_cast<std::type_info*>(static_cast<const std::type_info*>(type_info)), nullptr);
+}
+
+void* eokas_catch(void* exception) {
+    void* object = *static_cast<void**>(__cxxabiv1::__cxa_begin_catch(exception));
+    __cxxabiv1::__cxa_end_catch();
+    return object;
+}
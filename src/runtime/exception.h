@@ -0,0 +1,22 @@
+#ifndef _EOKAS_RUNTIME_EXCEPTION_H_
+#define _EOKAS_RUNTIME_EXCEPTION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Exceptions are C++ exceptions, unwound by the C++ runtime through the
+ * DWARF unwind tables of the compiled code. The compiler emits a type_info
+ * of the Itanium ABI for every struct which is thrown or caught, deriving
+ * from the type_info of its base, so the personality routine picks the
+ * matching 'catch' before any frame is unwound. The exception holds the
+ * reference to the thrown object only.
+ * */
+
+extern "C" {
+    [[noreturn]] void eokas_throw(void* object, const void* type_info);
+    // The object of the exception caught by a landing pad, the C++ catch ends right away.
+    void* eokas_catch(void* exception);
+}
+
+#endif //_EOKAS_RUNTIME_EXCEPTION_H_
@@ -0,0 +1,283 @@
+#include "./gc.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace eokas {
+    // The layout LLVM's shadow-stack GC strategy gives every frame with roots.
+    struct gc_frame_map_t {
+        int32_t root_count;
+        int32_t meta_count;
+    };
+
+    struct gc_stack_entry_t {
+        gc_stack_entry_t* next;
+        const gc_frame_map_t* map;
+        void* roots[1];
+    };
+
+    struct gc_header_t {
+        const eokas_gc_type_t* type;
+        uint32_t size;
+        uint32_t flags;
+    };
+
+    static const uint32_t gc_marked = 1;
+    static const uint32_t gc_free = 2;
+
+    static const uint64_t header_size = sizeof(gc_header_t);
+    static const uint64_t chunk_size = 1024 * 1024;
+    // Larger objects get a chunk of their own, which is released as soon as they die.
+    static const uint64_t small_size = 4096;
+    static const uint64_t initial_threshold = 4 * 1024 * 1024;
+
+    struct gc_chunk_t {
+        char* begin;
+        char* top;
+        char* end;
+        // Holds a single object, the chunk is released with it.
+        bool single;
+        // One bit per 16 bytes, set where a header is, interior pointers are traced back to it.
+        std::vector<uint64_t> starts;
+    };
+
+    struct gc_heap_t {
+        gc_stack_entry_t** root_chain = nullptr;
+        std::vector<void**> global_roots;
+        std::map<char*, gc_chunk_t> chunks;
+        gc_chunk_t* nursery = nullptr;
+        void* free_lists[small_size / 16 + 1] = {};
+        std::vector<gc_header_t*> worklist;
+        uint64_t threshold = initial_threshold;
+        uint64_t since_collect = 0;
+        eokas_gc_stats_t stats = {};
+    };
+
+    static gc_heap_t& heap() {
+        static gc_heap_t instance;
+        return instance;
+    }
+
+    static inline void*& next_of(void* block) {
+        return *reinterpret_cast<void**>(block);
+    }
+
+    static gc_chunk_t* gc_new_chunk(uint64_t size, bool single) {
+        auto& gc = heap();
+        auto* begin = static_cast<char*>(std::malloc(size));
+        if (begin == nullptr) {
+            fprintf(stderr, "ERROR: Out of memory.\n");
+            std::abort();
+        }
+        gc.stats.heap_bytes += size;
+        auto& chunk = gc.chunks[begin];
+        chunk.begin = begin;
+        chunk.top = begin;
+        chunk.end = begin + size;
+        chunk.single = single;
+        if (!single)
+            chunk.starts.resize(size / 16 / 64 + 1);
+        return &chunk;
+    }
+
+    static gc_chunk_t* gc_find_chunk(void* ptr) {
+        auto& gc = heap();
+        auto* pos = static_cast<char*>(ptr);
+        auto iter = gc.chunks.upper_bound(pos);
+        if (iter == gc.chunks.begin())
+            return nullptr;
+        --iter;
+        auto& chunk = iter->second;
+        // The end of the last object is still a pointer to it, a slice may end there.
+        if (pos < chunk.begin + header_size || pos > chunk.top)
+            return nullptr;
+        return &chunk;
+    }
+
+    /**
+     * The header of the object a pointer points into, references may point
+     * to a member or an item, or just past the end of a slice of the items.
+     * */
+    static gc_header_t* gc_find_header(void* ptr) {
+        auto* chunk = gc_find_chunk(ptr);
+        if (chunk == nullptr)
+            return nullptr;
+        auto* pos = static_cast<char*>(ptr);
+
+        if (chunk->single) {
+            // The object is the only block that is not free, an over-aligned one is padded by one.
+            for (char* block = chunk->begin; block < chunk->top;) {
+                auto* header = reinterpret_cast<gc_header_t*>(block);
+                if ((header->flags & gc_free) == 0)
+                    return header;
+                block += header->size;
+            }
+            return nullptr;
+        }
+
+        // The last header before the pointer, a pointer to a payload finds its header at once.
+        uint64_t index = (pos - chunk->begin - header_size) / 16;
+        while ((chunk->starts[index / 64] >> (index % 64) & 1) == 0)
+            index--;
+        return reinterpret_cast<gc_header_t*>(chunk->begin + index * 16);
+    }
+
+    static void gc_mark(void* ptr) {
+        if (ptr == nullptr)
+            return;
+        auto* header = gc_find_header(ptr);
+        if (header == nullptr || (header->flags & (gc_marked | gc_free)) != 0)
+            return;
+        header->flags |= gc_marked;
+        heap().worklist.push_back(header);
+    }
+
+    static void gc_trace() {
+        auto& gc = heap();
+        for (auto* entry = *gc.root_chain; entry != nullptr; entry = entry->next) {
+            for (int32_t index = 0; index < entry->map->root_count; index++) {
+                gc_mark(entry->roots[index]);
+            }
+        }
+        for (auto* slot: gc.global_roots) {
+            gc_mark(*slot);
+        }
+
+        while (!gc.worklist.empty()) {
+            auto* header = gc.worklist.back();
+            gc.worklist.pop_back();
+            auto* payload = reinterpret_cast<char*>(header + 1);
+            auto* type = header->type;
+            for (uint64_t index = 0; index < type->ref_count; index++) {
+                gc_mark(*reinterpret_cast<void**>(payload + type->ref_offsets[index]));
+            }
+        }
+    }
+
+    static uint64_t gc_sweep() {
+        auto& gc = heap();
+        uint64_t live = 0;
+        std::vector<char*> released;
+
+        for (auto& pair: gc.chunks) {
+            auto& chunk = pair.second;
+            for (char* pos = chunk.begin; pos < chunk.top;) {
+                auto* header = reinterpret_cast<gc_header_t*>(pos);
+                pos += header->size;
+                if ((header->flags & gc_free) != 0)
+                    continue;
+                if ((header->flags & gc_marked) != 0) {
+                    header->flags &= ~gc_marked;
+                    live += header->size;
+                    continue;
+                }
+
+                gc.stats.freed_bytes += header->size;
+                if (chunk.single) {
+                    released.push_back(chunk.begin);
+                    continue;
+                }
+                header->flags = gc_free;
+                auto& list = gc.free_lists[header->size / 16];
+                next_of(header + 1) = list;
+                list = header + 1;
+            }
+        }
+
+        for (auto* begin: released) {
+            auto iter = gc.chunks.find(begin);
+            gc.stats.heap_bytes -= iter->second.end - iter->second.begin;
+            gc.chunks.erase(iter);
+            std::free(begin);
+        }
+
+        return live;
+    }
+}
+
+using namespace eokas;
+
+void eokas_gc_set_root_chain(void* chain) {
+    heap().root_chain = static_cast<gc_stack_entry_t**>(chain);
+}
+
+void eokas_gc_add_root(void** slot) {
+    heap().global_roots.push_back(slot);
+}
+
+void* eokas_gc_alloc(const eokas_gc_type_t* type) {
+    return eokas_gc_alloc_aligned(type, 16);
+}
+
+void* eokas_gc_alloc_aligned(const eokas_gc_type_t* type, uint64_t align) {
+    auto& gc = heap();
+    uint64_t size = (header_size + type->size + 15) & ~uint64_t(15);
+
+    if (gc.since_collect >= gc.threshold)
+        eokas_gc_collect();
+
+    gc_header_t* header = nullptr;
+    if (align > 16) {
+        // A chunk of its own, a free block in front of the object pads its payload to the alignment.
+        auto* chunk = gc_new_chunk(header_size + align + size, true);
+        auto payload = (reinterpret_cast<uintptr_t>(chunk->begin) + header_size * 2 + align - 1) & ~uintptr_t(align - 1);
+        auto* pad = reinterpret_cast<gc_header_t*>(chunk->begin);
+        pad->type = nullptr;
+        pad->size = (uint32_t)(payload - header_size - reinterpret_cast<uintptr_t>(chunk->begin));
+        pad->flags = gc_free;
+        header = reinterpret_cast<gc_header_t*>(payload) - 1;
+        chunk->top = reinterpret_cast<char*>(header) + size;
+    } else if (size <= small_size) {
+        auto& list = gc.free_lists[size / 16];
+        if (list != nullptr) {
+            header = static_cast<gc_header_t*>(list) - 1;
+            list = next_of(list);
+        } else {
+            if (gc.nursery == nullptr || gc.nursery->top + size > gc.nursery->end)
+                gc.nursery = gc_new_chunk(chunk_size, false);
+            header = reinterpret_cast<gc_header_t*>(gc.nursery->top);
+            auto index = (gc.nursery->top - gc.nursery->begin) / 16;
+            gc.nursery->starts[index / 64] |= uint64_t(1) << (index % 64);
+            gc.nursery->top += size;
+        }
+    } else {
+        auto* chunk = gc_new_chunk(size, true);
+        header = reinterpret_cast<gc_header_t*>(chunk->top);
+        chunk->top += size;
+    }
+
+    header->type = type;
+    header->size = (uint32_t)size;
+    header->flags = 0;
+    // References must read as null until they are stored, the collector may trace them before.
+    std::memset(header + 1, 0, size - header_size);
+
+    gc.since_collect += size;
+    gc.stats.allocs += 1;
+    gc.stats.alloc_bytes += size;
+    return header + 1;
+}
+
+void eokas_gc_collect() {
+    auto& gc = heap();
+    // Without the roots every object would look dead.
+    if (gc.root_chain == nullptr)
+        return;
+
+    gc_trace();
+    auto live = gc_sweep();
+
+    gc.stats.collections += 1;
+    gc.stats.live_bytes = live;
+    gc.since_collect = 0;
+    gc.threshold = live * 2 > initial_threshold ? live * 2 : initial_threshold;
+}
+
+void eokas_gc_stats(eokas_gc_stats_t* stats) {
+    if (stats == nullptr)
+        return;
+    *stats = heap().stats;
+}
@@ -0,0 +1,48 @@
+#ifndef _EOKAS_RUNTIME_GC_H_
+#define _EOKAS_RUNTIME_GC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Precise mark-sweep collector for objects made with '--gc'.
+ * The compiler emits one type descriptor per struct, listing where its
+ * references are, and keeps every live reference in a shadow-stack root
+ * ('gc "shadow-stack"' in LLVM), references held by the globals of a module
+ * are registered once. Objects are bump-allocated from chunks,
+ * the blocks freed by a sweep are reused for objects of the same size.
+ * A reference may point inside an object, to a member, an item or the items
+ * of a slice, it keeps the whole object alive.
+ * Objects never move, and only one thread may run collected code.
+ * */
+
+extern "C" {
+    struct eokas_gc_type_t {
+        uint64_t size;
+        uint64_t ref_count;
+        const uint64_t* ref_offsets;
+    };
+
+    struct eokas_gc_stats_t {
+        uint64_t collections;
+        uint64_t allocs;
+        uint64_t alloc_bytes;
+        uint64_t freed_bytes;
+        uint64_t live_bytes;
+        uint64_t heap_bytes;
+    };
+
+    // The 'llvm_gc_root_chain' of the code being run.
+    void eokas_gc_set_root_chain(void* chain);
+    // A global holding a reference, it is a root for the rest of the run.
+    void eokas_gc_add_root(void** slot);
+
+    void* eokas_gc_alloc(const eokas_gc_type_t* type);
+    // For structs aligned beyond the 16 bytes every object gets, 'align' is a power of two.
+    void* eokas_gc_alloc_aligned(const eokas_gc_type_t* type, uint64_t align);
+    void eokas_gc_collect();
+
+    void eokas_gc_stats(eokas_gc_stats_t* stats);
+}
+
+#endif //_EOKAS_RUNTIME_GC_H_
@@ -0,0 +1,92 @@
+#include "./memo.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace eokas {
+    // An entry is its age, the result and the key, 0 is the age of an empty entry.
+    struct memo_table_t {
+        uint64_t clock;
+        uint64_t words[1];
+    };
+
+    // The descriptors live in the compiled code, their locks and tables are picked by address.
+    struct memo_stripe_t {
+        std::mutex lock;
+        std::unordered_map<const eokas_memo_t*, memo_table_t*> tables;
+    };
+
+    static const uint32_t stripe_count = 64;
+
+    static memo_stripe_t& memo_stripe(const eokas_memo_t* memo) {
+        static memo_stripe_t stripes[stripe_count];
+        return stripes[(reinterpret_cast<uintptr_t>(memo) >> 4) % stripe_count];
+    }
+
+    static inline uint64_t entry_words(const eokas_memo_t* memo) {
+        return 2 + memo->key_count;
+    }
+
+    // The stripe of the descriptor must be locked.
+    static memo_table_t* memo_table(memo_stripe_t& stripe, const eokas_memo_t* memo) {
+        auto& table = stripe.tables[memo];
+        if (table == nullptr) {
+            uint64_t size = sizeof(memo_table_t) + memo->capacity * entry_words(memo) * sizeof(uint64_t);
+            table = static_cast<memo_table_t*>(std::calloc(1, size));
+            if (table == nullptr) {
+                fprintf(stderr, "ERROR: Out of memory.\n");
+                std::abort();
+            }
+        }
+        return table;
+    }
+
+    static uint64_t* memo_set(const eokas_memo_t* memo, memo_table_t* table, const uint64_t* key) {
+        uint64_t hash = 0x9E3779B97F4A7C15ull;
+        for (uint32_t index = 0; index < memo->key_count; index++) {
+            hash ^= key[index] + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+        }
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+
+        uint64_t sets = memo->capacity / memo->ways;
+        return table->words + (hash % sets) * memo->ways * entry_words(memo);
+    }
+}
+
+using namespace eokas;
+
+int32_t eokas_memo_lookup(const eokas_memo_t* memo, const uint64_t* key, uint64_t* result) {
+    auto& stripe = memo_stripe(memo);
+    std::lock_guard<std::mutex> lock(stripe.lock);
+    auto* table = memo_table(stripe, memo);
+    auto* entry = memo_set(memo, table, key);
+    for (uint32_t way = 0; way < memo->ways; way++, entry += entry_words(memo)) {
+        if (entry[0] == 0 || std::memcmp(entry + 2, key, memo->key_count * sizeof(uint64_t)) != 0)
+            continue;
+        entry[0] = ++table->clock;
+        *result = entry[1];
+        return 1;
+    }
+    return 0;
+}
+
+void eokas_memo_store(const eokas_memo_t* memo, const uint64_t* key, uint64_t result) {
+    auto& stripe = memo_stripe(memo);
+    std::lock_guard<std::mutex> lock(stripe.lock);
+    auto* table = memo_table(stripe, memo);
+    auto* entry = memo_set(memo, table, key);
+    auto* victim = entry;
+    for (uint32_t way = 1; way < memo->ways; way++) {
+        entry += entry_words(memo);
+        if (entry[0] < victim[0])
+            victim = entry;
+    }
+    victim[0] = ++table->clock;
+    victim[1] = result;
+    std::memcpy(victim + 2, key, memo->key_count * sizeof(uint64_t));
+}
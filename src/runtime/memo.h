@@ -0,0 +1,29 @@
+#ifndef _EOKAS_RUNTIME_MEMO_H_
+#define _EOKAS_RUNTIME_MEMO_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Result caches of '#memo' functions. The compiler emits one descriptor per
+ * function and packs the arguments into 64-bit words. The runtime keeps the
+ * results in a table of 'capacity' entries split into sets of 'ways' entries:
+ * with one way the table is direct-mapped, otherwise a new result replaces
+ * the least recently used one of its set. A table is made on first use and
+ * every access holds its lock, so memoized functions may run on any thread.
+ * The descriptors are constant, the tables are only seen by the runtime.
+ * */
+
+extern "C" {
+    struct eokas_memo_t {
+        uint32_t capacity;
+        uint32_t ways;
+        uint32_t key_count;
+    };
+
+    // Returns 1 and stores the cached result if the key is in the cache.
+    int32_t eokas_memo_lookup(const eokas_memo_t* memo, const uint64_t* key, uint64_t* result);
+    void eokas_memo_store(const eokas_memo_t* memo, const uint64_t* key, uint64_t result);
+}
+
+#endif //_EOKAS_RUNTIME_MEMO_H_